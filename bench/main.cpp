@@ -0,0 +1,343 @@
+//-----------------------------------------------------------------------------
+// cppbmpfile benchmark
+//-----------------------------------------------------------------------------
+
+#include <cppbmpfile/cppbmpfile.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /// Describes the kind of file a case is run on.
+    enum class file_kind
+    {
+        mono8, //!< 8 bit with a linear gray color table.
+        mono8_non_linear, //!< 8 bit with a gray color table in reverse order.
+        indexed, //!< 8 bit with a color table, loaded as BGR8.
+        bgr8, //!< 24 bit.
+        bgra8, //!< 32 bit.
+    };
+
+    const char* to_string(file_kind kind)
+    {
+        switch (kind)
+        {
+        case file_kind::mono8:
+            return "mono8";
+        case file_kind::mono8_non_linear:
+            return "mono8_non_linear";
+        case file_kind::indexed:
+            return "indexed";
+        case file_kind::bgr8:
+            return "bgr8";
+        case file_kind::bgra8:
+            return "bgra8";
+        default:
+            return "invalid";
+        }
+    }
+
+    struct settings
+    {
+        bool json = false; //!< Writes JSON lines instead of CSV.
+        uint32_t min_size = 64; //!< The smallest width and height.
+        uint32_t max_size = 4096; //!< The largest width and height.
+        double min_time = 0.2; //!< The minimum time in seconds each case is repeated for.
+        std::string filename = "cppbmpfile_bench.bmp"; //!< The file written and read by the cases.
+    };
+
+    void append_value(std::vector<uint8_t>& data, uint32_t value, size_t byte_count)
+    {
+        for (size_t i = 0; i < byte_count; ++i)
+        {
+            data.push_back(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+
+    /// Creates an 8 bit file with the given color table, the pixels are a deterministic pattern.
+    std::vector<uint8_t> create_indexed_file(uint32_t width, uint32_t height, bool top_down, const std::vector<uint32_t>& color_table)
+    {
+        const size_t stride = (width + 3) / 4 * 4;
+        const uint32_t offset = static_cast<uint32_t>(54 + color_table.size() * 4);
+        std::vector<uint8_t> data;
+        data.reserve(offset + stride * height);
+        append_value(data, 0x4D42, 2);
+        append_value(data, static_cast<uint32_t>(offset + stride * height), 4);
+        append_value(data, 0, 4);
+        append_value(data, offset, 4);
+        append_value(data, 40, 4);
+        append_value(data, width, 4);
+        append_value(data, top_down ? static_cast<uint32_t>(-static_cast<int32_t>(height)) : height, 4);
+        append_value(data, 1, 2);
+        append_value(data, 8, 2);
+        append_value(data, 0, 4);
+        append_value(data, static_cast<uint32_t>(stride * height), 4);
+        append_value(data, 0, 4);
+        append_value(data, 0, 4);
+        append_value(data, static_cast<uint32_t>(color_table.size()), 4);
+        append_value(data, 0, 4);
+        for (uint32_t entry : color_table)
+        {
+            append_value(data, entry, 4);
+        }
+        for (uint32_t line = 0; line < height; ++line)
+        {
+            for (size_t column = 0; column < stride; ++column)
+            {
+                data.push_back(column < width ? static_cast<uint8_t>(line * 7 + column) : 0);
+            }
+        }
+        return data;
+    }
+
+    /// Creates the content of a file of the given kind.
+    std::vector<uint8_t> create_file(file_kind kind, uint32_t width, uint32_t height, bool top_down)
+    {
+        std::vector<uint8_t> data;
+        if (kind == file_kind::mono8_non_linear || kind == file_kind::indexed)
+        {
+            std::vector<uint32_t> color_table(256);
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                const uint32_t gray = 255 - i;
+                color_table[i] = kind == file_kind::indexed ? (i << 16) | ((i * 3) & 0xFF) << 8 | gray : (gray << 16) | (gray << 8) | gray;
+            }
+            data = create_indexed_file(width, height, top_down, color_table);
+        }
+        else
+        {
+            cppbmpfile::image_properties props;
+            props.width = width;
+            props.height = height;
+            props.pixel_format = kind == file_kind::mono8 ? cppbmpfile::pixel_format_type::Mono8 : kind == file_kind::bgr8 ? cppbmpfile::pixel_format_type::BGR8 : cppbmpfile::pixel_format_type::BGRA8;
+            props.orientation = top_down ? cppbmpfile::orientation_type::top_down : cppbmpfile::orientation_type::bottom_up;
+            const size_t line_size = width * (kind == file_kind::mono8 ? 1 : kind == file_kind::bgr8 ? 3 : 4);
+            props.line_padding = (line_size + 3) / 4 * 4 - line_size;
+            std::vector<uint8_t> pixels(cppbmpfile::bmp_file::compute_buffer_size(props));
+            for (size_t i = 0; i < pixels.size(); ++i)
+            {
+                pixels[i] = static_cast<uint8_t>(i * 13 + (i >> 12));
+            }
+            cppbmpfile::bmp_file::save_to_memory(data, pixels.data(), pixels.size(), props, !top_down);
+        }
+        return data;
+    }
+
+    void write_file(const std::string& filename, const std::vector<uint8_t>& data)
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+
+    /// Removes the file of a case when it ends, also if it ends by an exception.
+    class file_remover
+    {
+    public:
+        explicit file_remover(const std::string& filename)
+            : m_filename(filename)
+        {
+        }
+
+        file_remover(const file_remover&) = delete;
+        file_remover& operator=(const file_remover&) = delete;
+
+        ~file_remover()
+        {
+            std::remove(m_filename.c_str());
+        }
+
+    private:
+        const std::string& m_filename;
+    };
+
+    /// Repeats an operation for at least the minimum time, returns the number of iterations and the time taken.
+    template <typename operation_type>
+    bool measure(const settings& the_settings, const operation_type& operation, size_t& iterations, double& seconds)
+    {
+        typedef std::chrono::steady_clock clock;
+        iterations = 0;
+        const clock::time_point start = clock::now();
+        clock::time_point now = start;
+        do
+        {
+            if (!operation())
+            {
+                return false;
+            }
+            ++iterations;
+            now = clock::now();
+        } while (std::chrono::duration<double>(now - start).count() < the_settings.min_time);
+        seconds = std::chrono::duration<double>(now - start).count();
+        return true;
+    }
+
+    void report(const settings& the_settings, const char* operation, file_kind kind, uint32_t width, uint32_t height, bool top_down, size_t bytes, size_t iterations, double seconds)
+    {
+        const double megabytes_per_second = static_cast<double>(bytes) * iterations / seconds / 1e6;
+        const double images_per_second = iterations / seconds;
+        char line[512];
+        if (the_settings.json)
+        {
+            snprintf(line, sizeof(line), "{\"operation\":\"%s\",\"file\":\"%s\",\"width\":%u,\"height\":%u,\"orientation\":\"%s\",\"bytes\":%zu,\"iterations\":%zu,\"seconds\":%.6f,\"mb_per_s\":%.3f,\"images_per_s\":%.3f}",
+                operation, to_string(kind), width, height, top_down ? "top_down" : "bottom_up", bytes, iterations, seconds, megabytes_per_second, images_per_second);
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "%s,%s,%u,%u,%s,%zu,%zu,%.6f,%.3f,%.3f",
+                operation, to_string(kind), width, height, top_down ? "top_down" : "bottom_up", bytes, iterations, seconds, megabytes_per_second, images_per_second);
+        }
+        std::cout << line << std::endl;
+    }
+
+    /// Runs all operations on a file, returns false if an operation failed.
+    bool run_case(const settings& the_settings, file_kind kind, uint32_t width, uint32_t height, bool top_down)
+    {
+        const std::vector<uint8_t> data = create_file(kind, width, height, top_down);
+        const file_remover remover(the_settings.filename);
+        write_file(the_settings.filename, data);
+        const char* filename = the_settings.filename.c_str();
+
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> pixels;
+        if (!cppbmpfile::bmp_file::load(filename, pixels, props))
+        {
+            return false;
+        }
+        const size_t bytes = pixels.size();
+        cppbmpfile::bmp_decoder decoder;
+        cppbmpfile::bmp_probe probe;
+        std::vector<uint8_t> encoded;
+        size_t iterations = 0;
+        double seconds = 0;
+
+        if (!measure(the_settings, [&]() { return static_cast<bool>(decoder.load(filename, pixels, props)); }, iterations, seconds))
+        {
+            return false;
+        }
+        report(the_settings, "load", kind, width, height, top_down, bytes, iterations, seconds);
+
+        if (!measure(the_settings, [&]() { return static_cast<bool>(decoder.load(data.data(), data.size(), pixels, props)); }, iterations, seconds))
+        {
+            return false;
+        }
+        report(the_settings, "load_memory", kind, width, height, top_down, bytes, iterations, seconds);
+
+        if (!measure(the_settings, [&]() { return probe.open(filename) && probe.properties(props); }, iterations, seconds))
+        {
+            return false;
+        }
+        report(the_settings, "probe", kind, width, height, top_down, bytes, iterations, seconds);
+
+        if (!measure(the_settings, [&]() { return static_cast<bool>(cppbmpfile::bmp_file::save_to_memory(encoded, pixels.data(), pixels.size(), props, false)); }, iterations, seconds))
+        {
+            return false;
+        }
+        report(the_settings, "save_memory", kind, width, height, top_down, bytes, iterations, seconds);
+
+        if (!measure(the_settings, [&]() { return static_cast<bool>(cppbmpfile::bmp_file::save(filename, pixels.data(), pixels.size(), props, false)); }, iterations, seconds))
+        {
+            return false;
+        }
+        report(the_settings, "save", kind, width, height, top_down, bytes, iterations, seconds);
+        return true;
+    }
+
+    void print_usage()
+    {
+        std::cerr << "usage: cppbmpfile_bench [--json] [--min-size N] [--max-size N] [--min-time SECONDS] [--file NAME]\n"
+            "Runs load, load_memory, probe, save_memory and save on synthetic images with widths and heights\n"
+            "from min-size to max-size (default 64 to 4096, up to 16384), each with an odd width plus one.\n"
+            "Writes CSV with a header line or JSON lines to stdout.\n";
+    }
+
+    bool parse_arguments(int argc, char** argv, settings& the_settings)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (argument == "--json")
+            {
+                the_settings.json = true;
+            }
+            else if (argument == "--min-size" && has_value)
+            {
+                the_settings.min_size = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--max-size" && has_value)
+            {
+                the_settings.max_size = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--min-time" && has_value)
+            {
+                the_settings.min_time = std::stod(argv[++i]);
+            }
+            else if (argument == "--file" && has_value)
+            {
+                the_settings.filename = argv[++i];
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return the_settings.min_size > 0 && the_settings.min_size <= the_settings.max_size && the_settings.max_size <= 16384;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    settings the_settings;
+    try
+    {
+        if (!parse_arguments(argc, argv, the_settings))
+        {
+            print_usage();
+            return 2;
+        }
+    }
+    catch (const std::exception&)
+    {
+        print_usage();
+        return 2;
+    }
+
+    if (!the_settings.json)
+    {
+        std::cout << "operation,file,width,height,orientation,bytes,iterations,seconds,mb_per_s,images_per_s" << std::endl;
+    }
+    const file_kind kinds[] = { file_kind::mono8, file_kind::mono8_non_linear, file_kind::indexed, file_kind::bgr8, file_kind::bgra8 };
+    int exit_code = 0;
+    for (uint32_t size = the_settings.min_size; size <= the_settings.max_size; size *= 4)
+    {
+        for (file_kind kind : kinds)
+        {
+            for (uint32_t width : { size, size + 1 })
+            {
+                for (bool top_down : { false, true })
+                {
+                    bool succeeded = false;
+                    try
+                    {
+                        succeeded = run_case(the_settings, kind, width, size, top_down);
+                    }
+                    catch (const std::exception&)
+                    {
+                        // e.g., out of memory for the largest images, the file of the case has been removed
+                    }
+                    if (!succeeded)
+                    {
+                        std::cerr << "failed: " << to_string(kind) << " " << width << "x" << size << std::endl;
+                        exit_code = 1;
+                    }
+                }
+            }
+        }
+    }
+    return exit_code;
+}
@@ -49,9 +49,9 @@ Load and save BMP files for image processing.
 - Cross-platform support
 - Generates no build warnings on common compilers
 - High test coverage
-- Capable of loading BMP data into a buffer
-- Supports saving data from a buffer to a BMP file
-- Handles 8-bit, 24-bit, and 32-bit formats without compression
+- Capable of loading BMP data from a file or from memory into a buffer
+- Supports saving data from a buffer to a BMP file or to memory
+- Loads 1-bit, 4-bit, 8-bit, 16-bit, 24-bit, and 32-bit formats including bit fields, saves 8-bit, 24-bit, and 32-bit formats, loads and saves RLE8 and loads RLE4 compressed files
 - Intended to be encapsulated within a lightweight wrapper that can be easily adapted to specific use cases
 
 ##When to Use##
@@ -59,11 +59,82 @@ Load and save BMP files for image processing.
 */
 #pragma once
 #include <fstream>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
 #include <cstdlib>
 #include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Overloads taking a std::filesystem::path are available with C++17.
+#if (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L
+#if defined(__has_include)
+#if __has_include(<filesystem>)
+#include <filesystem>
+#define CPPBMPFILE_HAS_FILESYSTEM
+#endif
+#endif
+#endif
+
+// Define CPPBMPFILE_ENABLE_STATISTICS to fill the operation_statistics given in the options, otherwise they are ignored without overhead.
+
+// SIMD kernels are selected at runtime, define CPPBMPFILE_DISABLE_SIMD to use the portable implementation only.
+#if !defined(CPPBMPFILE_DISABLE_SIMD)
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPPBMPFILE_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define CPPBMPFILE_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define CPPBMPFILE_TARGET_AVX2 __attribute__((target("avx2")))
+#define CPPBMPFILE_TARGET_AVX512VBMI __attribute__((target("avx512f,avx512bw,avx512vbmi")))
+#else
+#define CPPBMPFILE_TARGET_SSSE3
+#define CPPBMPFILE_TARGET_AVX2
+#define CPPBMPFILE_TARGET_AVX512VBMI
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define CPPBMPFILE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+#endif
+
 namespace cppbmpfile
 {
     /// Defines what pixels are used by an image.
@@ -72,6 +143,8 @@ namespace cppbmpfile
         Mono8,  //!< 8 Bit pixel data as uint8_t luminance values.
         BGR8,   //!< 24 Bit pixel data in the order uint8_t blue, uint8_t green, uint8_t red. Sometimes confusingly referred to as RGB.
         BGRA8,  //!< 32 Bit pixel data in the order uint8_t blue, uint8_t green, uint8_t red, uint8_t alpha.Sometimes confusingly referred to as RGBA.
+        RGB8,   //!< 24 Bit pixel data in the order uint8_t red, uint8_t green, uint8_t blue. Converted to BGR8 in files.
+        RGBA8,  //!< 32 Bit pixel data in the order uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha. Converted to BGRA8 in files.
         invalid //!< Invalid value used for initialization purposes.
     };
 
@@ -93,6 +166,140 @@ namespace cppbmpfile
         orientation_type orientation = orientation_type::bottom_up; //!< Defines at which line the image starts.
     };
 
+    /// Describes a rectangular part of an image.
+    struct image_region
+    {
+        uint32_t x = 0; //!< The first column.
+        uint32_t y = 0; //!< The first line counted from the top of the image, independent of the orientation.
+        uint32_t width = 0; //!< The number of columns.
+        uint32_t height = 0; //!< The number of lines.
+    };
+
+    /**
+        \brief Describes pixels in memory owned by the caller, e.g., a part of a larger image or an image stored with a negative row pitch.
+        Only the pixels of the lines are accessed, the bytes between the lines are kept.
+    */
+    struct image_view
+    {
+        void* data = nullptr; //!< Points to the first pixel of the top line.
+        uint32_t width = 0; //!< Width of the image in pixel.
+        uint32_t height = 0; //!< Height of the image in lines.
+        std::ptrdiff_t row_pitch = 0; //!< The distance in bytes from the top line to the line below, negative if the lines are stored bottom up. At least the size of the pixels of a line.
+        pixel_format_type pixel_format = pixel_format_type::invalid; //!< Defines what pixels are used by the image.
+    };
+
+#if defined(_WIN32)
+    typedef HANDLE native_file_handle; //!< A file handle of the operating system.
+#else
+    typedef int native_file_handle; //!< A file descriptor of the operating system.
+#endif
+
+    /**
+        \brief Refers to a file opened for reading by the caller, e.g., to load many images without resolving their paths again.
+        The BMP file must start at the beginning of the file. It is read with positional reads, so that the file position is kept, and it is not closed.
+    */
+    struct open_file
+    {
+        /// Refers to a file handle or descriptor.
+        explicit open_file(native_file_handle file_handle)
+            : handle(file_handle)
+        {
+        }
+
+        /// Refers to the file of a C stream, data held in the buffer of the stream is not taken into account.
+        explicit open_file(FILE* file)
+#if defined(_WIN32)
+            : handle(file != nullptr ? reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file))) : INVALID_HANDLE_VALUE)
+#else
+            : handle(file != nullptr ? fileno(file) : -1)
+#endif
+        {
+        }
+
+        /// Returns true if the handle refers to a file.
+        bool is_valid() const
+        {
+#if defined(_WIN32)
+            return handle != INVALID_HANDLE_VALUE && handle != nullptr;
+#else
+            return handle >= 0;
+#endif
+        }
+
+        native_file_handle handle; //!< The handle of the file.
+    };
+
+    /// Defines how the pixels of an image are reduced while loading a smaller image.
+    enum class downscale_filter_type
+    {
+        decimate, //!< Takes the top left pixel of each block, only the lines of these pixels are read.
+        box, //!< Averages the pixels of each block.
+    };
+
+    /**
+        \brief Counters and timings of loads into a buffer and saves, added up over all operations given the same statistics.
+        They are only filled if CPPBMPFILE_ENABLE_STATISTICS is defined. The counters can be updated by several threads.
+    */
+    struct operation_statistics
+    {
+        std::atomic<uint64_t> bytes_read{0}; //!< The number of bytes read from the file or memory.
+        std::atomic<uint64_t> read_calls{0}; //!< The number of reads from the file or memory.
+        std::atomic<uint64_t> bytes_written{0}; //!< The number of bytes written to files.
+        std::atomic<uint64_t> write_calls{0}; //!< The number of writes to files.
+        std::atomic<uint64_t> open_nanoseconds{0}; //!< The time spent opening files.
+        std::atomic<uint64_t> header_nanoseconds{0}; //!< The time spent reading and checking or creating and writing headers.
+        std::atomic<uint64_t> color_table_nanoseconds{0}; //!< The time spent reading and classifying color tables or bit masks.
+        std::atomic<uint64_t> pixel_nanoseconds{0}; //!< The time spent reading or writing and converting the pixels.
+        std::atomic<uint64_t> read_nanoseconds{0}; //!< The time spent in reads, part of the phases above.
+        std::atomic<uint64_t> write_nanoseconds{0}; //!< The time spent in writes to files, part of the phases above.
+        std::atomic<uint64_t> bulk_reads{0}; //!< The number of images read with a single call into the buffer.
+        std::atomic<uint64_t> flips{0}; //!< The number of images stored in reversed line order.
+        std::atomic<uint64_t> copies{0}; //!< The number of images copied without pixel conversion, e.g., Mono8 with a linear color table.
+        std::atomic<uint64_t> lookups{0}; //!< The number of images whose indices are mapped to gray values, e.g., Mono8 with a non-linear color table.
+        std::atomic<uint64_t> expansions{0}; //!< The number of images whose indices are expanded to color table entries.
+        std::atomic<uint64_t> shuffles{0}; //!< The number of images whose channels are rearranged.
+        std::atomic<uint64_t> luminance_conversions{0}; //!< The number of images converted to gray values.
+        std::atomic<uint64_t> run_length_images{0}; //!< The number of images decoded or encoded as run length encoded.
+        std::atomic<uint64_t> downscaled_images{0}; //!< The number of images loaded downscaled.
+        std::atomic<uint64_t> banded_images{0}; //!< The number of images processed in bands by several threads.
+
+        /// Sets all counters to zero.
+        void reset()
+        {
+            std::atomic<uint64_t>* counters[] = { &bytes_read, &read_calls, &bytes_written, &write_calls, &open_nanoseconds, &header_nanoseconds, &color_table_nanoseconds,
+                &pixel_nanoseconds, &read_nanoseconds, &write_nanoseconds, &bulk_reads, &flips, &copies, &lookups, &expansions, &shuffles, &luminance_conversions,
+                &run_length_images, &downscaled_images, &banded_images };
+            for (std::atomic<uint64_t>* p_counter : counters)
+            {
+                p_counter->store(0);
+            }
+        }
+    };
+
+    /// Holds optional settings for loading an image.
+    struct load_options
+    {
+        pixel_format_type pixel_format = pixel_format_type::invalid; //!< The pixel format of the buffer, the pixels are converted while loading. Invalid keeps the pixel format of the file.
+        image_region region; //!< Loads only this part of the image, the image properties describe the region. An empty region loads the whole image.
+        uint32_t downscale_factor = 1; //!< Loads an image reduced by this factor, each pixel in the buffer covers a block of factor x factor pixels of the file or region. Pixels beyond the last complete block to the right and bottom are dropped.
+        downscale_filter_type downscale_filter = downscale_filter_type::decimate; //!< Defines how the pixels of a block are reduced.
+        size_t thread_count = 1; //!< The number of threads loading bands of lines from a file or memory, zero uses one thread per processor core. Run length encoded files are loaded by one thread.
+        operation_statistics* statistics = nullptr; //!< Optional, receives counters and timings of loads into a buffer if CPPBMPFILE_ENABLE_STATISTICS is defined.
+        bool sequential_access = false; //!< Advises the operating system that the pixels of a file are read once in order, so that it reads ahead (posix_fadvise() where available).
+        bool drop_cache = false; //!< Advises the operating system to drop the pages of a file from its cache after loading, e.g., for one pass ingest jobs (posix_fadvise() where available).
+        bool direct_io = false; //!< Reads a file bypassing the cache of the operating system into aligned memory and decodes it from there (O_DIRECT where available). Falls back to buffered reads if the file system does not support it or the memory cannot be allocated. The whole file is held in memory next to the image while decoding, a bmp_decoder keeps this memory for the next load.
+    };
+
+    /// Holds optional settings for saving an image.
+    struct save_options
+    {
+        pixel_format_type pixel_format = pixel_format_type::invalid; //!< The pixel format stored in the file, Mono8, BGR8 or BGRA8. The pixels are converted while saving. Invalid stores RGB8 as BGR8, RGBA8 as BGRA8 and keeps the other pixel formats.
+        bool run_length_encoding = false; //!< Stores the pixels as BI_RLE8, which is compact for images with large flat areas. Requires Mono8 pixels in the file, the file is always bottom up.
+        size_t chunk_size = 1 << 20; //!< The size of the writes to a file, 0 encodes the whole file in memory and writes it with a single call. Smaller chunks need less memory, larger spans of pixels are written directly.
+        size_t thread_count = 1; //!< The number of threads encoding bands of lines, zero uses one thread per processor core. Each thread encodes pieces of its band of about chunk_size bytes and writes them at their position in the file. Run length encoding uses one thread.
+        operation_statistics* statistics = nullptr; //!< Optional, receives counters and timings if CPPBMPFILE_ENABLE_STATISTICS is defined.
+    };
+
     /// Defines at which line an image starts.
     enum class operation_result_type
     {
@@ -110,6 +317,9 @@ namespace cppbmpfile
         corrupt, //!< The file that is loaded seems to be a BMP file, but checking the header data and the size of the file failed.
         null_argument, //!< null pointer passed as argument.
         invalid_argument, //!< argument given is not valid.
+        incomplete, //!< Not all lines of the image have been written.
+        thread_start_error, //!< No worker thread could be started for an asynchronous operation.
+        queue_full, //!< The queue of pending operations is full, the operation has been dropped.
         invalid //!< Invalid value used for initialization purposes.
     };
 
@@ -145,6 +355,12 @@ namespace cppbmpfile
             return "Argument must not be null.";
         case operation_result_type::invalid_argument:
             return "An argument passed is invalid.";
+        case operation_result_type::incomplete:
+            return "BMP file write error. Not all lines have been written.";
+        case operation_result_type::thread_start_error:
+            return "Failed to start a worker thread.";
+        case operation_result_type::queue_full:
+            return "Queue of pending operations full. Operation dropped.";
         case operation_result_type::invalid:
             return "Invalid operation type. No operation executed.";
         default:
@@ -181,6 +397,66 @@ namespace cppbmpfile
         operation_result_type m_result_type = operation_result_type::invalid;
     };
 
+    /// Describes a file loaded by bmp_file::load_batch().
+    struct batch_load_job
+    {
+        std::string filename; //!< The name of the file.
+        void* buffer = nullptr; //!< The buffer to store the image data in, pixels is used instead if this is nullptr.
+        size_t buffer_size = 0; //!< The size of buffer.
+        std::vector<uint8_t> pixels; //!< Receives the image data if buffer is nullptr, it is resized as needed.
+        image_properties properties; //!< The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+        bool force_line_padding = false; //!< Use the line padding set in properties instead.
+        bool force_orientation = false; //!< Use the orientation set in properties instead.
+        load_options options; //!< Optional settings, e.g., the pixel format to convert to.
+        operation_result result; //!< The result of loading the file.
+    };
+
+    /// Describes a file saved by a bmp_save_queue.
+    struct save_queue_job
+    {
+        std::string filename; //!< The name of the file.
+        std::vector<uint8_t> pixels; //!< The image data, owned by the queue until the job has been saved.
+        image_properties properties; //!< The properties of the image.
+        bool force_bottom_up = true; //!< Force bottom up when saving to disk for best compatibility.
+        save_options options; //!< Optional settings, e.g., the pixel format stored in the file.
+    };
+
+    /// Counters of a bmp_save_queue, they are updated while the queue is running.
+    struct save_queue_statistics
+    {
+        size_t queued = 0; //!< The number of jobs accepted.
+        size_t saved = 0; //!< The number of jobs saved successfully.
+        size_t failed = 0; //!< The number of jobs that failed to save.
+        size_t dropped = 0; //!< The number of jobs rejected because the queue was full.
+        size_t depth = 0; //!< The number of jobs accepted but not yet completed.
+        size_t max_depth = 0; //!< The largest depth seen.
+    };
+
+    /// Holds an image decoded by a bmp_image_cache, it is shared by all users of the entry.
+    struct cached_image
+    {
+        std::vector<uint8_t> pixels; //!< The image data.
+        image_properties properties; //!< The properties of the image data.
+    };
+
+    /// Counters of a bmp_image_cache.
+    struct image_cache_statistics
+    {
+        size_t hits = 0; //!< The number of loads served from the cache.
+        size_t misses = 0; //!< The number of loads that decoded the image.
+        size_t invalidations = 0; //!< The number of entries dropped because their file has changed or disappeared.
+        size_t evictions = 0; //!< The number of entries dropped to stay within the capacity.
+        size_t entries = 0; //!< The number of cached images.
+        size_t bytes = 0; //!< The size of the pixels of the cached images.
+    };
+
+    class bmp_decoder;
+    class bmp_mapped_file;
+    class bmp_probe;
+    class bmp_reader;
+    class bmp_sequence_reader;
+    class bmp_writer;
+
     /// Used for loading and saving data from and to a BMP file.
     class bmp_file
     {
@@ -208,14 +484,15 @@ namespace cppbmpfile
             \brief Loads the image properties. This can be used, e.g., to determine the needed buffer size.
             \param[in] filename  The name of the file.
             \param[out] the_image_properties  The properties of the image stored in the file.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
             \return Returns information about the result of the operation.
         */
         template <typename char_type>
-        static operation_result load(const char_type* filename, image_properties& the_image_properties)
+        static operation_result load(const char_type* filename, image_properties& the_image_properties, const load_options& options = load_options())
         {
             operation_result result;
             bmp_header header = {};
-            std::vector<color_table_entry> color_table;
+            color_table_info color_table;
             if (filename == nullptr)
             {
                 result = operation_result_type::null_argument;
@@ -223,7 +500,20 @@ namespace cppbmpfile
             else
             {
                 std::ifstream file(filename, std::ios::binary);
-                result = load_image_properties(file, header, color_table, the_image_properties);
+                if (!file.is_open())
+                {
+                    result = operation_result_type::file_not_found;
+                    the_image_properties = image_properties(); // clear
+                }
+                else
+                {
+                    stream_input input(file);
+                    result = load_image_properties(input, header, color_table, the_image_properties);
+                    if (result)
+                    {
+                        result = apply_load_options(options, the_image_properties);
+                    }
+                }
                 file.close();
             }
             return result;
@@ -237,505 +527,401 @@ namespace cppbmpfile
             \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
             \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
             \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
             \return Returns information about the result of the operation.
         */
         template <typename char_type>
-        static operation_result load(const char_type* filename, void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false)
+        static operation_result load(const char_type* filename, void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
         {
-            operation_result result;
-            bmp_header header = {};
-            std::vector<color_table_entry> color_table;
+            decoder_scratch scratch;
+            return load_reusing(filename, buffer, buffer_size, the_image_properties, force_line_padding, force_orientation, options, scratch);
+        }
 
-            if (buffer == nullptr || filename == nullptr)
-            {
-                result = operation_result_type::null_argument;
-            }
-            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
+        /**
+            \brief Loads the image and its properties opening and parsing the file only once.
+            \param[in] filename  The name of the file.
+            \param[out] buffer  The vector to store the image data in, it is resized as needed and cleared on failure.
+            \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation.
+        */
+        template <typename char_type>
+        static operation_result load(const char_type* filename, std::vector<uint8_t>& buffer, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            decoder_scratch scratch;
+            return load_reusing(filename, buffer, the_image_properties, force_line_padding, force_orientation, options, scratch);
+        }
+
+        /**
+            \brief Loads the image and its properties opening and parsing the file only once.
+            \param[in] filename  The name of the file.
+            \param[in] allocate  Called with the needed buffer size in bytes once the properties are known, returns the buffer to store the image data in or nullptr.
+            \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation, buffer_too_small if allocate returned nullptr.
+        */
+        template <typename char_type>
+        static operation_result load(const char_type* filename, const std::function<void*(size_t)>& allocate, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            decoder_scratch scratch;
+            return load_reusing(filename, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+        }
+
+        /**
+            \brief Loads many files using a pool of worker threads.
+            Each worker reuses its scratch memory between files. Using more threads than processor cores
+            overlaps waiting for the disk with decoding. An exception thrown while loading a job, e.g., std::bad_alloc,
+            skips the remaining jobs and is rethrown after all threads have finished.
+            \param[inout] jobs  The files to load, the results are stored in the jobs.
+            \param[in] thread_count  The number of threads to use including the calling thread, zero uses one thread per processor core.
+            \return Returns ok if all files have been loaded, otherwise the result of the first job that failed.
+        */
+        static operation_result load_batch(std::vector<batch_load_job>& jobs, size_t thread_count = 0)
+        {
+            if (thread_count == 0)
             {
-                result = operation_result_type::invalid_argument;
+                thread_count = std::max(std::thread::hardware_concurrency(), 1u);
             }
-            else
-            {
-                std::ifstream file(filename, std::ios::binary);
-                orientation_type suggested_orientation = the_image_properties.orientation;
-                size_t suggested_line_padding = the_image_properties.line_padding;
-                result = load_image_properties(file, header, color_table, the_image_properties);
-                orientation_type orientation_in_file = the_image_properties.orientation;
+            thread_count = std::min(thread_count, jobs.size());
 
-                if (result)
+            std::atomic<size_t> next_job(0);
+            first_exception failure;
+            auto work = [&jobs, &next_job, &failure]()
+            {
+                failure.run([&jobs, &next_job, &failure]()
                 {
-                    if (force_line_padding)
-                    {
-                        the_image_properties.line_padding = suggested_line_padding;
-                    }
-                    if (force_orientation)
+                    // the remaining jobs are skipped once a job has thrown
+                    decoder_scratch scratch;
+                    for (size_t index = next_job++; index < jobs.size() && !failure.caught(); index = next_job++)
                     {
-                        the_image_properties.orientation = suggested_orientation;
+                        load_job(jobs[index], scratch);
                     }
+                });
+            };
 
-                    const size_t stride_in_file = determine_stride(header.bits_per_pixel, header.width);
-                    const size_t stride_in_buffer = determine_stride(the_image_properties);
-                    const size_t line_padding_in_file = determine_line_padding(header.bits_per_pixel, header.width);
-                    const size_t image_size_in_buffer = stride_in_buffer * abs(header.height);
+            worker_threads workers;
+            workers.start(thread_count > 1 ? thread_count - 1 : 0, [&work](size_t) { work(); });
+            work();
+            workers.join();
+            failure.rethrow();
 
-                    if (image_size_in_buffer > buffer_size)
-                    {
-                        result = operation_result_type::buffer_too_small;
-                    }
-                    else
-                    {
-                        file.seekg(header.offset);
-                        if (!file)
-                        {
-                            result = operation_result_type::file_read_error;
-                        }
-                        else
-                        {
-                            if (header.bits_per_pixel > 8 && (the_image_properties.pixel_format == pixel_format_type::BGR8 || the_image_properties.pixel_format == pixel_format_type::BGRA8))
-                            {
-                                for (uint32_t line = 0; line < the_image_properties.height; ++line)
-                                {
-                                    uint8_t* p_target = reinterpret_cast<uint8_t*>(buffer);
-                                    if (the_image_properties.orientation == orientation_in_file)
-                                    {
-                                        p_target += line * stride_in_buffer;
-                                    }
-                                    else
-                                    {
-                                        p_target += (the_image_properties.height - line - 1) * stride_in_buffer;
-                                    }
-                                    file.read(reinterpret_cast<char*>(p_target), static_cast<std::streamsize>(stride_in_file - line_padding_in_file));
-                                    if (!file)
-                                    {
-                                        result = operation_result_type::file_read_error;
-                                        break;
-                                    }
-                                    if (line_padding_in_file)
-                                    {
-                                        file.seekg(static_cast<std::streamsize>(line_padding_in_file), std::ios_base::cur);
-                                        if (!file)
-                                        {
-                                            result = operation_result_type::file_write_error;
-                                            break;
-                                        }
-                                    }
-                                }
-                            }
-                            else if (the_image_properties.pixel_format == pixel_format_type::Mono8)
-                            {
-                                bool linear_lut = check_is_linear_mono8(color_table);
-                                // read line by line, b == g == r in color table
-                                for (int32_t line = 0; line < abs(header.height); ++line)
-                                {
-                                    uint8_t* p_target = reinterpret_cast<uint8_t*>(buffer);
-                                    if (the_image_properties.orientation == orientation_in_file)
-                                    {
-                                        p_target += line * stride_in_buffer;
-                                    }
-                                    else
-                                    {
-                                        p_target += (the_image_properties.height - line - 1) * stride_in_buffer;
-                                    }
-                                    file.read(reinterpret_cast<char*>(p_target), static_cast<std::streamsize>(stride_in_file - line_padding_in_file));
-                                    if (!file)
-                                    {
-                                        result = operation_result_type::file_read_error;
-                                        break;
-                                    }
-                                    if (!linear_lut)
-                                    {
-                                        for (int32_t column = 0; column < abs(header.width); ++column, ++p_target)
-                                        {
-                                            *p_target = color_table[*p_target].b;
-                                        }
-                                    }
-                                    if (line_padding_in_file)
-                                    {
-                                        file.seekg(static_cast<std::streamsize>(line_padding_in_file), std::ios_base::cur);
-                                        if (!file)
-                                        {
-                                            result = operation_result_type::file_write_error;
-                                            break;
-                                        }
-                                    }
-                                }
-                            }
-                            else if (the_image_properties.pixel_format == pixel_format_type::BGR8 && header.bits_per_pixel == 8)
-                            {
-                                // read line by line, b != g != r somewhere in color table
-                                std::vector<uint8_t> stride_buffer(stride_in_file);
-                                for (int32_t line = 0; line < abs(header.height); ++line)
-                                {
-                                    file.read(reinterpret_cast<char*>(stride_buffer.data()), static_cast<std::streamsize>(stride_buffer.size()));
-                                    if (file.gcount() != static_cast<std::streamsize>(stride_buffer.size()))
-                                    {
-                                        result = operation_result_type::file_read_error;
-                                        break;
-                                    }
-                                    uint8_t* p_target = reinterpret_cast<uint8_t*>(buffer);
-                                    if (the_image_properties.orientation == orientation_in_file)
-                                    {
-                                        p_target += line * stride_in_buffer;
-                                    }
-                                    else
-                                    {
-                                        p_target += (the_image_properties.height - line - 1) * stride_in_buffer;
-                                    }
-                                    for (int32_t column = 0; column < abs(header.width); ++column, ++p_target)
-                                    {
-                                        const color_table_entry& entry = color_table[stride_buffer[column]];
-                                        *p_target = entry.b;
-                                        ++p_target;
-                                        *p_target = entry.g;
-                                        ++p_target;
-                                        *p_target = entry.r;
-                                    }
-                                }
-                            }
-                            else
-                            {
-                                result = operation_result_type::unsupported_bit_per_pixel;
-                            }
-                        }
-                    }
+            operation_result result(operation_result_type::ok);
+            for (const batch_load_job& job : jobs)
+            {
+                if (!job.result)
+                {
+                    result = job.result;
+                    break;
                 }
-                file.close();
             }
             return result;
         }
 
         /**
-            \brief Save the image and its properties.
-            \param[in] filename  The name of the file.
-            \param[in] buffer  The buffer holding the image data.
-            \param[in] buffer_size  The size of buffer.
-            \param[in] the_image_properties  The properties of the image.
-            \param[in] force_bottom_up  Force bottom up when saving to disk for best compatibility.
+            \brief Loads the image properties from a BMP file held in memory.
+            \param[in] data  The content of the BMP file.
+            \param[in] data_size  The size of data in bytes.
+            \param[out] the_image_properties  The properties of the image stored in data.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
             \return Returns information about the result of the operation.
         */
-        template <typename char_type>
-        static operation_result save(const char_type* filename, const void* buffer, size_t buffer_size, const image_properties& the_image_properties, bool force_bottom_up = true)
+        static operation_result load(const void* data, size_t data_size, image_properties& the_image_properties, const load_options& options = load_options())
         {
-            operation_result result(operation_result_type::ok);
+            operation_result result;
             bmp_header header = {};
-            std::vector<color_table_entry> color_table;
-
-            if (buffer == nullptr || filename == nullptr)
+            color_table_info color_table;
+            if (data == nullptr)
             {
                 result = operation_result_type::null_argument;
             }
-            else if (
-                the_image_properties.height == 0
-                || the_image_properties.width == 0
-                || the_image_properties.pixel_format == pixel_format_type::invalid
-                || the_image_properties.orientation == orientation_type::invalid
-                || buffer_size == 0
-                || determine_stride(the_image_properties) == 0
-                )
-            {
-                result = operation_result_type::invalid_argument;
-            }
-            else if (determine_stride(the_image_properties) * the_image_properties.height > buffer_size)
-            {
-                result = operation_result_type::buffer_too_small;
-            }
             else
             {
-                std::ofstream file(filename, std::ios::binary);
-                if (!file.is_open())
-                {
-                    result = operation_result_type::file_open_for_writing_error;
-                }
-                else
+                memory_input input(data, data_size);
+                result = load_image_properties(input, header, color_table, the_image_properties);
+                if (result)
                 {
-                    const size_t stride_in_buffer = determine_stride(the_image_properties);
-                    orientation_type orientation_in_file = orientation_type::bottom_up;
-
-                    // fill in initial values
-                    header.type = 0x4D42;
-                    header.size = sizeof(bmp_header);
-                    header.reserved1 = 0;
-                    header.reserved2 = 0;
-                    header.offset = sizeof(bmp_header);
-                    header.bitmap_info_header_size = sizeof(bmp_header) - 14;
-                    header.width = static_cast<int32_t>(the_image_properties.width);
-                    header.height = static_cast<int32_t>(the_image_properties.height);
-                    if (!force_bottom_up && the_image_properties.orientation == orientation_type::top_down)
-                    {
-                        header.height = -header.height;
-                        orientation_in_file = orientation_type::top_down;
-                    }
-                    header.num_planes = 1;
-                    if (the_image_properties.pixel_format == pixel_format_type::Mono8)
-                    {
-                        header.bits_per_pixel = 8;
-                    }
-                    else if (the_image_properties.pixel_format == pixel_format_type::BGR8)
-                    {
-                        header.bits_per_pixel = 24;
-                    }
-                    else if (the_image_properties.pixel_format == pixel_format_type::BGRA8)
-                    {
-                        header.bits_per_pixel = 32;
-                    }
-                    else
-                    {
-                        assert(false); //invalid path
-                    }
-                    header.compression = 0; // BI_RGB, no compression
-                    header.image_size_bytes = 0; //keeping it 0
-                    header.x_resolution = 0;
-                    header.y_resolution = 0;
-                    header.num_colors = 0;
-                    header.important_colors = 0;
-
-                    if (the_image_properties.pixel_format == pixel_format_type::Mono8)
-                    {
-                        header.size += 256 * sizeof(color_table_entry);
-                        header.offset += 256 * sizeof(color_table_entry);
-                        header.num_colors = 256;
-                        header.important_colors = 256;
-                    }
-
-                    const size_t stride_in_file = determine_stride(header.bits_per_pixel, header.width);
-                    const size_t image_size_in_file = stride_in_file * abs(header.height);
-                    header.size += static_cast<uint32_t>(image_size_in_file);
-
-                    // write header
-                    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
-                    if (!file)
-                    {
-                        result = operation_result_type::file_write_error;
-                    }
-                    // write color table if needed
-                    if (result && the_image_properties.pixel_format == pixel_format_type::Mono8)
-                    {
-                        color_table_entry entry = { 0, 0, 0, 255 };
-                        for (size_t i = 0; i < 256; ++i)
-                        {
-                            entry.b = entry.g = entry.r = static_cast<uint8_t>(i);
-                            file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
-                            if (!file)
-                            {
-                                result = operation_result_type::file_write_error;
-                                break;
-                            }
-                        }
-                    }
-                    // write image data, line wise
-                    const size_t line_padding_in_file = determine_line_padding(header.bits_per_pixel, header.width);
-                    for (uint32_t line = 0; line < the_image_properties.height; ++line)
-                    {
-                        const uint8_t* p_source = reinterpret_cast<const uint8_t*>(buffer);
-                        if (the_image_properties.orientation == orientation_in_file)
-                        {
-                            p_source += line * stride_in_buffer;
-                        }
-                        else
-                        {
-                            p_source += (the_image_properties.height - line - 1) * stride_in_buffer;
-                        }
-                        file.write(reinterpret_cast<const char*>(p_source), static_cast<std::streamsize>(stride_in_buffer - the_image_properties.line_padding));
-                        if (!file)
-                        {
-                            result = operation_result_type::file_write_error;
-                            break;
-                        }
-                        if (line_padding_in_file && line_padding_in_file <= 4)
-                        {
-                            const uint32_t padding = 0;
-                            file.write(reinterpret_cast<const char*>(&padding), static_cast<std::streamsize>(line_padding_in_file));
-                            if (!file)
-                            {
-                                result = operation_result_type::file_write_error;
-                                break;
-                            }
-                        }
-                        else if (line_padding_in_file == 0)
-                        {
-                            // nothing to do
-                        }
-                        else
-                        {
-                            assert(false); // invalid path
-                        }
-                    }
+                    result = apply_load_options(options, the_image_properties);
                 }
             }
-
             return result;
         }
-    private:
 
-#pragma pack(push)
-#pragma pack(1)
-        struct bmp_header
+        /**
+            \brief Loads the image and its properties from a BMP file held in memory.
+            \param[in] data  The content of the BMP file.
+            \param[in] data_size  The size of data in bytes.
+            \param[out] buffer  The buffer to store the image data in.
+            \param[in] buffer_size  The size of buffer.
+            \param[inout] the_image_properties  The properties of the image stored in data. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation.
+        */
+        static operation_result load(const void* data, size_t data_size, void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
         {
-            uint16_t  type;             //!< Header magic value.
-            uint32_t  size;             //!< Image file size in bytes.
-            uint16_t  reserved1;        //!< Not used
-            uint16_t  reserved2;        //!< Not used
-            uint32_t  offset;           //!< Offset in bytes to image data in bytes from beginning of file.
-            uint32_t  bitmap_info_header_size;  //!< Bitmap info header size in bytes (40 bytes).
-            int32_t   width;           //!< Width of the image.
-            int32_t   height   ;        //!< Height of image.
-            uint16_t  num_planes;       //!< Number of color planes.
-            uint16_t  bits_per_pixel;   //!< Bits per pixel.
-            uint32_t  compression;      //!< Compression type.
-            uint32_t  image_size_bytes; //!< Image size in bytes.
-            int32_t   x_resolution;     //!< X resolution in pixels per meter.
-            int32_t   y_resolution;     //!< Y resolution in pixels per meter.
-            uint32_t  num_colors;       //!< Number of colors.
-            uint32_t  important_colors; //!< Important colors.
-        };
+            decoder_scratch scratch;
+            return load_reusing(data, data_size, buffer, buffer_size, the_image_properties, force_line_padding, force_orientation, options, scratch);
+        }
 
-        struct color_table_entry
+        /**
+            \brief Loads the image and its properties from a BMP file held in memory parsing it only once.
+            \param[in] data  The content of the BMP file.
+            \param[in] data_size  The size of data in bytes.
+            \param[out] buffer  The vector to store the image data in, it is resized as needed and cleared on failure.
+            \param[inout] the_image_properties  The properties of the image stored in data. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation.
+        */
+        static operation_result load(const void* data, size_t data_size, std::vector<uint8_t>& buffer, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
         {
-            uint8_t b;
-            uint8_t g;
-            uint8_t r;
-            uint8_t reserved;
-        };
-#pragma pack(pop)
+            decoder_scratch scratch;
+            return load_reusing(data, data_size, buffer, the_image_properties, force_line_padding, force_orientation, options, scratch);
+        }
 
-        static size_t byte_per_pixel_in_file(uint16_t  bits_per_pixel)
+        /**
+            \brief Loads the image and its properties from a BMP file held in memory parsing it only once.
+            \param[in] data  The content of the BMP file.
+            \param[in] data_size  The size of data in bytes.
+            \param[in] allocate  Called with the needed buffer size in bytes once the properties are known, returns the buffer to store the image data in or nullptr.
+            \param[inout] the_image_properties  The properties of the image stored in data. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation, buffer_too_small if allocate returned nullptr.
+        */
+        static operation_result load(const void* data, size_t data_size, const std::function<void*(size_t)>& allocate, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
         {
-            if (bits_per_pixel == 8)
-            {
-                return 1;
-            }
-            if (bits_per_pixel == 24)
-            {
-                return 3;
-            }
-            if (bits_per_pixel == 32)
-            {
-                return 4;
-            }
-            assert(false); // bits_per_pixel is expected to be checked before calling this helper method
-            return 0;
+            decoder_scratch scratch;
+            return load_reusing(data, data_size, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
         }
 
-        static size_t determine_stride(uint16_t bits_per_pixel, int32_t width)
+        /**
+            \brief Loads the image directly into memory described by a view, the pixels are converted to the pixel format of the view.
+            \param[in] filename  The name of the file.
+            \param[in] view  The memory to store the image data in, its width and height must match the loaded image.
+            \param[out] the_image_properties  The properties of the image as stored in the view.
+            \param[in] options  Optional settings, e.g., a region of the file. The pixel format of the options is replaced by the one of the view.
+            \return Returns information about the result of the operation, buffer_too_small if the size of the image differs from the view.
+        */
+        template <typename char_type>
+        static operation_result load(const char_type* filename, const image_view& view, image_properties& the_image_properties, const load_options& options = load_options())
         {
-            size_t stride = byte_per_pixel_in_file(bits_per_pixel) * abs(width);
-            bool dividableByFour = stride % 4 == 0;
-            if (!dividableByFour)
-            {
-                stride += 4 - stride % 4;
-            }
-            return stride;
+            decoder_scratch scratch;
+            return load_reusing(filename, view, the_image_properties, options, scratch);
         }
 
-        static size_t determine_line_padding(uint16_t bits_per_pixel, int32_t width)
+        /**
+            \brief Loads the image from memory directly into memory described by a view, the pixels are converted to the pixel format of the view.
+            \param[in] data  The content of a BMP file.
+            \param[in] data_size  The size of data.
+            \param[in] view  The memory to store the image data in, its width and height must match the loaded image.
+            \param[out] the_image_properties  The properties of the image as stored in the view.
+            \param[in] options  Optional settings, e.g., a region of the file. The pixel format of the options is replaced by the one of the view.
+            \return Returns information about the result of the operation, buffer_too_small if the size of the image differs from the view.
+        */
+        static operation_result load(const void* data, size_t data_size, const image_view& view, image_properties& the_image_properties, const load_options& options = load_options())
         {
-            size_t line_padding = 0;
-            size_t stride = byte_per_pixel_in_file(bits_per_pixel) * abs(width);
-            bool dividableByFour = stride % 4 == 0;
-            if (!dividableByFour)
-            {
-                line_padding = 4 - stride % 4;
-            }
-            return line_padding;
+            decoder_scratch scratch;
+            return load_reusing(data, data_size, view, the_image_properties, options, scratch);
         }
 
-        static size_t determine_stride(const image_properties& the_image_properties)
-        {
-            size_t byte_per_pixel = 0;
-            if (the_image_properties.pixel_format == pixel_format_type::Mono8)
+        /**
+            \brief Loads the image and its properties from a file opened by the caller.
+            \param[in] file  The open file, it is neither moved nor closed.
+            \param[out] buffer  The buffer to store the image data in.
+            \param[in] buffer_size  The size of buffer.
+            \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation.
+        */
+        static operation_result load(const open_file& file, void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            operation_result result;
+            if (buffer == nullptr || !file.is_valid())
             {
-                byte_per_pixel = 1;
+                result = operation_result_type::null_argument;
             }
-            else if (the_image_properties.pixel_format == pixel_format_type::BGR8)
+            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
             {
-                byte_per_pixel = 3;
+                result = operation_result_type::invalid_argument;
             }
-            else if (the_image_properties.pixel_format == pixel_format_type::BGRA8)
+            else
             {
-                byte_per_pixel = 4;
+                decoder_scratch scratch;
+                file_input input;
+                input.attach(file.handle);
+                fixed_buffer allocate(buffer, buffer_size);
+                result = load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            return result;
+        }
+
+        /**
+            \brief Loads the image and its properties from a file opened by the caller.
+            \param[in] file  The open file, it is neither moved nor closed.
+            \param[out] buffer  The vector to store the image data in, it is resized as needed and cleared on failure.
+            \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation.
+        */
+        static operation_result load(const open_file& file, std::vector<uint8_t>& buffer, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            operation_result result;
+            if (!file.is_valid())
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
+            {
+                result = operation_result_type::invalid_argument;
             }
             else
             {
-                assert(false); // invalid path
+                decoder_scratch scratch;
+                file_input input;
+                input.attach(file.handle);
+                vector_buffer allocate(buffer);
+                result = load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            if (!result)
+            {
+                buffer.clear();
             }
+            return result;
+        }
 
-            size_t stride = the_image_properties.width * byte_per_pixel + the_image_properties.line_padding;
-            return stride;
+#if defined(CPPBMPFILE_HAS_FILESYSTEM)
+        /// Same as load() with the native name of the path, which is not converted.
+        static operation_result load(const std::filesystem::path& filename, image_properties& the_image_properties, const load_options& options = load_options())
+        {
+            return load(filename.c_str(), the_image_properties, options);
         }
 
-        static operation_result load_and_check_header(std::istream& stream, bmp_header& header_out)
+        /// Same as load() with the native name of the path, which is not converted.
+        static operation_result load(const std::filesystem::path& filename, void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
         {
-            operation_result result(operation_result_type::ok);
-            const bmp_header& header = header_out;
+            return load(filename.c_str(), buffer, buffer_size, the_image_properties, force_line_padding, force_orientation, options);
+        }
+
+        /// Same as load() with the native name of the path, which is not converted.
+        static operation_result load(const std::filesystem::path& filename, std::vector<uint8_t>& buffer, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            return load(filename.c_str(), buffer, the_image_properties, force_line_padding, force_orientation, options);
+        }
+
+        /// Same as save() with the native name of the path, which is not converted.
+        static operation_result save(const std::filesystem::path& filename, const void* buffer, size_t buffer_size, const image_properties& the_image_properties, bool force_bottom_up = true, const save_options& options = save_options())
+        {
+            return save(filename.c_str(), buffer, buffer_size, the_image_properties, force_bottom_up, options);
+        }
+#endif
 
-            stream.read(reinterpret_cast<char*>(&header_out), sizeof(header_out));
-            if (!stream)
+        /**
+            \brief Computes the size of a BMP file holding an image with the given properties.
+            \param[in] the_image_properties  The properties of the image.
+            \param[in] options  Optional settings, e.g., the pixel format stored in the file.
+            \return Returns the file size in bytes or zero on invalid arguments. With run length encoding it is the size needed in the worst case.
+        */
+        static size_t compute_file_size(const image_properties& the_image_properties, const save_options& options = save_options())
+        {
+            size_t file_size = 0;
+            if (!(
+                  the_image_properties.height == 0
+                || the_image_properties.width == 0
+                || the_image_properties.pixel_format == pixel_format_type::invalid
+                || !check_save_options(the_image_properties, options)
+                ))
             {
-                result = operation_result_type::not_a_bmp_file;
+                bmp_header header = {};
+                create_header(determine_file_properties(the_image_properties, options), true, options.run_length_encoding, header);
+                file_size = header.size;
+            }
+            return file_size;
+        }
+
+        /**
+            \brief Save the image and its properties.
+            \param[in] filename  The name of the file.
+            \param[in] buffer  The buffer holding the image data.
+            \param[in] buffer_size  The size of buffer.
+            \param[in] the_image_properties  The properties of the image.
+            \param[in] force_bottom_up  Force bottom up when saving to disk for best compatibility.
+            \param[in] options  Optional settings, e.g., the pixel format stored in the file.
+            \return Returns information about the result of the operation.
+        */
+        template <typename char_type>
+        static operation_result save(const char_type* filename, const void* buffer, size_t buffer_size, const image_properties& the_image_properties, bool force_bottom_up = true, const save_options& options = save_options())
+        {
+            operation_result result;
+
+            if (buffer == nullptr || filename == nullptr)
+            {
+                result = operation_result_type::null_argument;
             }
             else
             {
-                // header.type; -> expected to be BM
-                // header.size; -> ignored, because it is unreliable
-                // header.reserved1; -> ignored
-                // header.reserved2; -> ignored
-                // header.offset; -> checked
-                // header.dib_header_size; -> checked
-                // header.width; -> checked
-                // header.height; -> checked
-                // header.num_planes; -> ignored, not used for bmp
-                // header.bits_per_pixel; -> checked
-                // header.compression; -> checked
-                // header.image_size_bytes; -> checked
-                // header.x_resolution; -> ignored, not used
-                // header.y_resolution; -> ignored, not used
-                // header.num_colors; -> checked
-                // header.important_colors; -> checked
-            
-                //check the header
-                if (header.type != 0x4D42)
-                {
-                    result = operation_result_type::not_a_bmp_file;
-                }
-                else if (header.bitmap_info_header_size < 40)
-                {
-                    result = operation_result_type::corrupt;
-                }
-                else if (header.offset < sizeof(header))
-                {
-                    result = operation_result_type::corrupt;
-                }
-                else if (header.height == 0 || header.width <= 0)
-                {
-                    result = operation_result_type::corrupt;
-                }
-                else if (!(header.bits_per_pixel == 1 || header.bits_per_pixel == 4 || header.bits_per_pixel == 8 || header.bits_per_pixel == 16 || header.bits_per_pixel == 24 || header.bits_per_pixel == 32))
+                result = check_save_arguments(buffer_size, the_image_properties, options);
+            }
+
+            if (result && options.thread_count != 1 && !options.run_length_encoding)
+            {
+                // the bands of lines are encoded by several threads, each writes its lines at their position in the file
+                file_output output(options.statistics);
+                bool opened = false;
                 {
-                    result = operation_result_type::corrupt;
+                    scoped_timer timer(get_counter(options.statistics, &operation_statistics::open_nanoseconds));
+                    opened = output.open(filename);
                 }
-                else if (header.compression != 0 /* BI_RGB, no compression */)
+                if (!opened)
                 {
-                    result = operation_result_type::unsupported_compression;
+                    result = operation_result_type::file_open_for_writing_error;
                 }
-                else if (!(header.bits_per_pixel == 8 || header.bits_per_pixel == 24 || header.bits_per_pixel == 32))
+                else
                 {
-                    result = operation_result_type::unsupported_bit_per_pixel;
+                    result = save_image(output, buffer, the_image_properties, force_bottom_up, options);
+                    if (!output.close() && result)
+                    {
+                        result = operation_result_type::file_write_error;
+                    }
                 }
-                else if ((header.bits_per_pixel == 24 || header.bits_per_pixel == 32) && (header.num_colors != 0 || header.important_colors != 0))
+            }
+            else if (result)
+            {
+                std::ofstream file;
                 {
-                    result = operation_result_type::unsupported_use_of_color_table;
+                    scoped_timer timer(get_counter(options.statistics, &operation_statistics::open_nanoseconds));
+                    file.open(filename, std::ios::binary);
                 }
-                else if (header.bits_per_pixel == 8 && (header.num_colors > 256 || header.important_colors > 256))
+                if (!file.is_open())
                 {
-                    result = operation_result_type::too_large_color_table;
+                    result = operation_result_type::file_open_for_writing_error;
                 }
                 else
                 {
-                    size_t image_data_size = determine_stride(header.bits_per_pixel, header.width) * abs(header.height);
-
-                    if (!(header.image_size_bytes == 0 || header.image_size_bytes == image_data_size))
+                    // the file is encoded into chunks, a small file fits into a single chunk
+                    const size_t file_size = compute_file_size(the_image_properties, options);
+                    std::vector<uint8_t> chunk(options.chunk_size != 0 ? std::min(options.chunk_size, file_size) : file_size);
+                    stream_output output(file, chunk.data(), chunk.size(), options.statistics);
+                    result = save_image(output, buffer, the_image_properties, force_bottom_up, options);
+                    if (result && !output.flush())
                     {
-                        result = operation_result_type::corrupt;
+                        result = operation_result_type::file_write_error;
+                    }
+                    file.close();
+                    if (result && !file)
+                    {
+                        result = operation_result_type::file_write_error;
                     }
                 }
             }
@@ -743,138 +929,5692 @@ namespace cppbmpfile
             return result;
         }
 
-        static operation_result load_color_table(std::istream& stream, const bmp_header& header, std::vector<color_table_entry>& color_table_out)
+        /**
+            \brief Save the image and its properties into a memory buffer.
+            \param[out] data  The buffer to store the content of the BMP file in.
+            \param[in] data_size  The size of data, use compute_file_size() to determine the needed size. With run length encoding the file is usually smaller, its size is stored in the header.
+            \param[in] buffer  The buffer holding the image data.
+            \param[in] buffer_size  The size of buffer.
+            \param[in] the_image_properties  The properties of the image.
+            \param[in] force_bottom_up  Force bottom up when saving for best compatibility.
+            \param[in] options  Optional settings, e.g., the pixel format stored in the file.
+            \return Returns information about the result of the operation.
+        */
+        static operation_result save_to_memory(void* data, size_t data_size, const void* buffer, size_t buffer_size, const image_properties& the_image_properties, bool force_bottom_up = true, const save_options& options = save_options())
         {
-            operation_result result(operation_result_type::ok);
-            stream.seekg(header.bitmap_info_header_size + 14 /* file header size */);
-            if (!stream)
+            operation_result result;
+
+            if (buffer == nullptr || data == nullptr)
             {
-                result = operation_result_type::file_read_error;
+                result = operation_result_type::null_argument;
             }
             else
             {
-                if (header.num_colors)
-                {
-                    color_table_out.resize(header.num_colors);
-                }
-                else if (header.num_colors == 0 && header.bits_per_pixel == 1)
-                {
-                    color_table_out.resize(1);
-                }
-                else if (header.num_colors == 0 && header.bits_per_pixel == 4)
-                {
-                    color_table_out.resize(16);
-                }
-                else if (header.num_colors == 0 && header.bits_per_pixel == 8)
-                {
-                    color_table_out.resize(256);
-                }
+                result = check_save_arguments(buffer_size, the_image_properties, options);
+            }
 
-                if (!color_table_out.empty())
+            if (result)
+            {
+                if (compute_file_size(the_image_properties, options) > data_size)
                 {
-                    const size_t size_of_color_table_bytes = color_table_out.size() * sizeof(color_table_entry);
-                    stream.read(reinterpret_cast<char*>(color_table_out.data()), static_cast<std::streamsize>(size_of_color_table_bytes));
-                    if (!stream)
-                    {
-                        result = operation_result_type::file_read_error;
-                    }
+                    result = operation_result_type::buffer_too_small;
                 }
                 else
                 {
-                    result = operation_result_type::unsupported_use_of_color_table;
+                    memory_output output(data, data_size);
+                    result = save_image(output, buffer, the_image_properties, force_bottom_up, options);
                 }
             }
+
             return result;
         }
 
-        static bool check_is_linear_mono8(const std::vector<color_table_entry>& color_table)
+        /**
+            \brief Save the image and its properties into a memory buffer which is resized as needed.
+            \param[out] data  The vector to store the content of the BMP file in.
+            \param[in] buffer  The buffer holding the image data.
+            \param[in] buffer_size  The size of buffer.
+            \param[in] the_image_properties  The properties of the image.
+            \param[in] force_bottom_up  Force bottom up when saving for best compatibility.
+            \param[in] options  Optional settings, e.g., the pixel format stored in the file.
+            \return Returns information about the result of the operation.
+        */
+        static operation_result save_to_memory(std::vector<uint8_t>& data, const void* buffer, size_t buffer_size, const image_properties& the_image_properties, bool force_bottom_up = true, const save_options& options = save_options())
         {
-            uint8_t i = 0;
-            for (const color_table_entry& entry : color_table)
+            operation_result result;
+            if (buffer == nullptr)
             {
-                if (!(entry.b == i && entry.g == i && entry.r == i))
-                {
-                    return false;
-                }
-                ++i;
+                result = operation_result_type::null_argument;
             }
-            return true;
-        }
-
-        static bool check_is_mono8(const std::vector<color_table_entry>& color_table)
-        {
-            for (const color_table_entry& entry : color_table)
+            else
             {
-                // not all values are equal
-                if (!(entry.r == entry.g && entry.r == entry.b))
-                {
-                    return false;
-                }
+                result = check_save_arguments(buffer_size, the_image_properties, options);
             }
-            return true;
-        }
 
-        static void determine_image_properties(const bmp_header& header, std::vector<color_table_entry>& color_table_out, image_properties& the_image_properties)
-        {
-            
-            the_image_properties.height = abs(header.height);
-            the_image_properties.width = abs(header.width);
-            if (header.bits_per_pixel <= 8)
-            {
-                if (check_is_mono8(color_table_out))
-                {
-                    the_image_properties.pixel_format = pixel_format_type::Mono8;
-                }
-                else
-                {
-                    the_image_properties.pixel_format = pixel_format_type::BGR8;
-                }
-            }
-            else if (header.bits_per_pixel == 24)
+            if (result)
             {
-                the_image_properties.pixel_format = pixel_format_type::BGR8;
+                data.resize(compute_file_size(the_image_properties, options));
+                memory_output output(data.data(), data.size());
+                result = save_image(output, buffer, the_image_properties, force_bottom_up, options);
+                data.resize(output.position());
             }
-            else if (header.bits_per_pixel == 32)
+            if (!result)
             {
-                the_image_properties.pixel_format = pixel_format_type::BGRA8;
+                data.clear();
             }
-            else
+            return result;
+        }
+
+        /**
+            \brief Save the image described by a view.
+            \param[in] filename  The name of the file.
+            \param[in] view  The image to save, only its pixels are read.
+            \param[in] force_bottom_up  Force bottom up when saving to disk for best compatibility.
+            \param[in] options  Optional settings, e.g., the pixel format stored in the file.
+            \return Returns information about the result of the operation.
+        */
+        template <typename char_type>
+        static operation_result save(const char_type* filename, const image_view& view, bool force_bottom_up = true, const save_options& options = save_options())
+        {
+            image_properties the_image_properties;
+            const uint8_t* p_lines = nullptr;
+            operation_result result = describe_view(view, the_image_properties, p_lines);
+            if (result)
             {
-                assert(false); // not supported yet
+                result = save(filename, p_lines, determine_stride(the_image_properties) * the_image_properties.height, the_image_properties, force_bottom_up, options);
             }
-            
-            the_image_properties.orientation = header.height < 0 ? orientation_type::top_down : orientation_type::bottom_up;
-            the_image_properties.line_padding = determine_line_padding(header.bits_per_pixel, header.width);
+            return result;
         }
 
-        static operation_result load_image_properties(std::ifstream& stream, bmp_header& header, std::vector<color_table_entry>& color_table_out, image_properties& the_image_properties)
+        /**
+            \brief Save the image described by a view into a memory buffer which is resized as needed.
+            \param[out] data  The vector to store the content of the BMP file in.
+            \param[in] view  The image to save, only its pixels are read.
+            \param[in] force_bottom_up  Force bottom up when saving for best compatibility.
+            \param[in] options  Optional settings, e.g., the pixel format stored in the file.
+            \return Returns information about the result of the operation.
+        */
+        static operation_result save_to_memory(std::vector<uint8_t>& data, const image_view& view, bool force_bottom_up = true, const save_options& options = save_options())
         {
-            operation_result result;
-
-            if (!stream.is_open())
+            image_properties the_image_properties;
+            const uint8_t* p_lines = nullptr;
+            operation_result result = describe_view(view, the_image_properties, p_lines);
+            if (result)
             {
-                result = operation_result_type::file_not_found;
+                result = save_to_memory(data, p_lines, determine_stride(the_image_properties) * the_image_properties.height, the_image_properties, force_bottom_up, options);
             }
             else
             {
-                result = load_and_check_header(stream, header);
-            }
-
-            if (result && header.bits_per_pixel == 8)
-            {
-                result = load_color_table(stream, header, color_table_out);
+                data.clear();
             }
+            return result;
+        }
 
-            if (result)
+        /**
+            \brief Loads the image and its properties on a new thread, see load().
+            The buffer and the properties are borrowed until the operation has completed, the filename is copied.
+            \param[in] filename  The name of the file.
+            \param[out] buffer  The buffer to store the image data in.
+            \param[in] buffer_size  The size of buffer.
+            \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns the future result of the operation, thread_start_error if no thread can be created. Its destructor waits until the operation has completed.
+        */
+        template <typename char_type>
+        static std::future<operation_result> load_async(const char_type* filename, void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            if (filename == nullptr)
             {
-                determine_image_properties(header, color_table_out, the_image_properties);
+                return make_ready_future(operation_result_type::null_argument);
             }
-            else
+            const std::basic_string<char_type> name(filename);
+            image_properties* p_properties = &the_image_properties;
+            return run_async([name, buffer, buffer_size, p_properties, force_line_padding, force_orientation, options]()
             {
-                the_image_properties = image_properties(); // clear
-            }
-
-            return result;
+                decoder_scratch scratch;
+                return load_reusing(name.c_str(), buffer, buffer_size, *p_properties, force_line_padding, force_orientation, options, scratch);
+            });
         }
+
+        /**
+            \brief Loads the image and its properties on a new thread opening and parsing the file only once, see load().
+            The buffer and the properties are borrowed until the operation has completed, the filename is copied.
+            \param[in] filename  The name of the file.
+            \param[out] buffer  The vector to store the image data in, it is resized as needed and cleared on failure.
+            \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns the future result of the operation, thread_start_error if no thread can be created. Its destructor waits until the operation has completed.
+        */
+        template <typename char_type>
+        static std::future<operation_result> load_async(const char_type* filename, std::vector<uint8_t>& buffer, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            if (filename == nullptr)
+            {
+                return make_ready_future(operation_result_type::null_argument);
+            }
+            const std::basic_string<char_type> name(filename);
+            std::vector<uint8_t>* p_buffer = &buffer;
+            image_properties* p_properties = &the_image_properties;
+            return run_async([name, p_buffer, p_properties, force_line_padding, force_orientation, options]()
+            {
+                decoder_scratch scratch;
+                return load_reusing(name.c_str(), *p_buffer, *p_properties, force_line_padding, force_orientation, options, scratch);
+            });
+        }
+
+        /**
+            \brief Saves the image on a new thread, see save().
+            The buffer is borrowed until the operation has completed, the filename and the properties are copied.
+            The future has to be kept, destroying it waits for the disk. Use a bmp_save_queue to save images without waiting.
+            \param[in] filename  The name of the file.
+            \param[in] buffer  The buffer holding the image data.
+            \param[in] buffer_size  The size of buffer.
+            \param[in] the_image_properties  The properties of the image.
+            \param[in] force_bottom_up  Force bottom up when saving to disk for best compatibility.
+            \param[in] options  Optional settings, e.g., the pixel format stored in the file.
+            \return Returns the future result of the operation, thread_start_error if no thread can be created. Its destructor waits until the operation has completed.
+        */
+        template <typename char_type>
+        static std::future<operation_result> save_async(const char_type* filename, const void* buffer, size_t buffer_size, const image_properties& the_image_properties, bool force_bottom_up = true, const save_options& options = save_options())
+        {
+            if (filename == nullptr)
+            {
+                return make_ready_future(operation_result_type::null_argument);
+            }
+            const std::basic_string<char_type> name(filename);
+            const image_properties properties = the_image_properties;
+            return run_async([name, buffer, buffer_size, properties, force_bottom_up, options]()
+            {
+                return save(name.c_str(), buffer, buffer_size, properties, force_bottom_up, options);
+            });
+        }
+    private:
+        friend class bmp_decoder;
+        friend class bmp_mapped_file;
+        friend class bmp_probe;
+        friend class bmp_reader;
+        friend class bmp_save_queue;
+        friend class bmp_sequence_reader;
+        friend class bmp_writer;
+
+#pragma pack(push)
+#pragma pack(1)
+        static const uint32_t compression_rgb = 0; //!< BI_RGB, no compression.
+        static const uint32_t compression_rle8 = 1; //!< BI_RLE8, run length encoded 8 bit indices.
+        static const uint32_t compression_rle4 = 2; //!< BI_RLE4, run length encoded 4 bit indices.
+        static const uint32_t compression_bit_fields = 3; //!< BI_BITFIELDS, 16 or 32 bit pixels described by red, green and blue masks.
+        static const uint32_t compression_alpha_bit_fields = 6; //!< BI_ALPHABITFIELDS, like BI_BITFIELDS with an alpha mask.
+
+        struct bmp_header
+        {
+            uint16_t  type;             //!< Header magic value.
+            uint32_t  size;             //!< Image file size in bytes.
+            uint16_t  reserved1;        //!< Not used
+            uint16_t  reserved2;        //!< Not used
+            uint32_t  offset;           //!< Offset in bytes to image data in bytes from beginning of file.
+            uint32_t  bitmap_info_header_size;  //!< Bitmap info header size in bytes (40 bytes).
+            int32_t   width;           //!< Width of the image.
+            int32_t   height   ;        //!< Height of image.
+            uint16_t  num_planes;       //!< Number of color planes.
+            uint16_t  bits_per_pixel;   //!< Bits per pixel.
+            uint32_t  compression;      //!< Compression type.
+            uint32_t  image_size_bytes; //!< Image size in bytes.
+            int32_t   x_resolution;     //!< X resolution in pixels per meter.
+            int32_t   y_resolution;     //!< Y resolution in pixels per meter.
+            uint32_t  num_colors;       //!< Number of colors.
+            uint32_t  important_colors; //!< Important colors.
+        };
+
+        struct color_table_entry
+        {
+            uint8_t b;
+            uint8_t g;
+            uint8_t r;
+            uint8_t reserved;
+        };
+#pragma pack(pop)
+
+        /// Holds the color table of a file and its classification, which is determined once when loading it.
+        struct color_table_info
+        {
+            std::vector<color_table_entry> entries; //!< The entries, empty for formats without color table.
+            bool is_mono8 = false; //!< Blue, green and red are equal for all entries.
+            bool is_linear_mono8 = false; //!< Entry i is (i, i, i) for all entries.
+            uint32_t bit_masks[4] = {}; //!< The red, green, blue and alpha masks of 16 and 32 bit pixels, stored instead of a color table.
+        };
+
+#if defined(CPPBMPFILE_ENABLE_STATISTICS)
+        static const bool statistics_enabled = true;
+#else
+        static const bool statistics_enabled = false;
+#endif
+
+        typedef std::atomic<uint64_t> operation_statistics::* statistics_counter;
+
+        /// Returns the counter or nullptr if statistics are disabled or not requested.
+        static std::atomic<uint64_t>* get_counter(operation_statistics* p_statistics, statistics_counter counter)
+        {
+            return statistics_enabled && p_statistics != nullptr ? &(p_statistics->*counter) : nullptr;
+        }
+
+        static void count(operation_statistics* p_statistics, statistics_counter counter, uint64_t value = 1)
+        {
+            std::atomic<uint64_t>* p_counter = get_counter(p_statistics, counter);
+            if (p_counter != nullptr)
+            {
+                p_counter->fetch_add(value, std::memory_order_relaxed);
+            }
+        }
+
+        /// Adds the time from its construction to its destruction to a counter, does nothing without counter.
+        class scoped_timer
+        {
+        public:
+            explicit scoped_timer(std::atomic<uint64_t>* p_nanoseconds)
+                : m_p_nanoseconds(p_nanoseconds)
+            {
+                if (m_p_nanoseconds != nullptr)
+                {
+                    m_start = std::chrono::steady_clock::now();
+                }
+            }
+
+            scoped_timer(const scoped_timer&) = delete;
+            scoped_timer& operator=(const scoped_timer&) = delete;
+
+            ~scoped_timer()
+            {
+                if (m_p_nanoseconds != nullptr)
+                {
+                    const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - m_start;
+                    m_p_nanoseconds->fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()), std::memory_order_relaxed);
+                }
+            }
+
+        private:
+            std::atomic<uint64_t>* m_p_nanoseconds;
+            std::chrono::steady_clock::time_point m_start;
+        };
+
+        /// Reads the content of a BMP file from a stream.
+        class stream_input
+        {
+        public:
+            explicit stream_input(std::istream& stream)
+                : m_stream(stream)
+            {
+            }
+
+            /// Reads size bytes at position into destination, returns false if not all bytes could be read.
+            bool read_at(size_t position, void* destination, size_t size)
+            {
+                m_stream.clear();
+                m_stream.seekg(static_cast<std::streamoff>(position));
+                if (!m_stream)
+                {
+                    return false;
+                }
+                m_stream.read(reinterpret_cast<char*>(destination), static_cast<std::streamsize>(size));
+                return static_cast<bool>(m_stream);
+            }
+
+            /// Returns true if the stream holds at least size bytes.
+            bool holds(uint64_t size)
+            {
+                m_stream.clear();
+                m_stream.seekg(0, std::ios::end);
+                const std::streamoff stream_size = m_stream.tellg();
+                return m_stream && stream_size >= 0 && static_cast<uint64_t>(stream_size) >= size;
+            }
+
+            /// Returns a pointer to size bytes at position, scratch is used to hold the data. Returns nullptr on error.
+            const uint8_t* view_at(size_t position, size_t size, std::vector<uint8_t>& scratch)
+            {
+                scratch.resize(size);
+                return read_at(position, scratch.data(), size) ? scratch.data() : nullptr;
+            }
+
+        private:
+            std::istream& m_stream;
+        };
+
+        /// Reads the content of a BMP file from memory without copying it.
+        class memory_input
+        {
+        public:
+            memory_input(const void* data, size_t size)
+                : m_data(reinterpret_cast<const uint8_t*>(data))
+                , m_size(size)
+            {
+            }
+
+            /// Reads size bytes at position into destination, returns false if not all bytes could be read.
+            bool read_at(size_t position, void* destination, size_t size)
+            {
+                const uint8_t* p_source = view_at(position, size);
+                if (p_source == nullptr)
+                {
+                    return false;
+                }
+                memcpy(destination, p_source, size);
+                return true;
+            }
+
+            /// Returns a pointer to size bytes at position, scratch is not needed. Returns nullptr on error.
+            const uint8_t* view_at(size_t position, size_t size, std::vector<uint8_t>& /* scratch */)
+            {
+                return view_at(position, size);
+            }
+
+            /// Returns true if the memory holds at least size bytes.
+            bool holds(uint64_t size) const
+            {
+                return size <= m_size;
+            }
+
+        private:
+            const uint8_t* view_at(size_t position, size_t size) const
+            {
+                if (position > m_size || size > m_size - position)
+                {
+                    return nullptr;
+                }
+                return m_data + position;
+            }
+
+            const uint8_t* m_data;
+            size_t m_size;
+        };
+
+        /// Defines how a file is read, see load_options.
+        enum class file_advice
+        {
+            sequential, //!< The range is read once in order.
+            will_need, //!< The range is read soon.
+            dont_need, //!< The range is not read again.
+        };
+
+        /// Reads the content of a BMP file with positional reads, so that several threads can read from it at the same time.
+        class file_input
+        {
+        public:
+            file_input() = default;
+
+            file_input(const file_input&) = delete;
+            file_input& operator=(const file_input&) = delete;
+
+            ~file_input()
+            {
+                close();
+            }
+
+            /// Reads size bytes at position into destination, returns false if not all bytes could be read.
+            bool read_at(size_t position, void* destination, size_t size)
+            {
+                uint8_t* p_destination = reinterpret_cast<uint8_t*>(destination);
+                while (size > 0)
+                {
+                    const size_t bytes_read = read_some_at(position, p_destination, size);
+                    if (bytes_read == 0)
+                    {
+                        return false;
+                    }
+                    position += bytes_read;
+                    p_destination += bytes_read;
+                    size -= bytes_read;
+                }
+                return true;
+            }
+
+            /// Returns a pointer to size bytes at position, scratch is used to hold the data. Returns nullptr on error.
+            const uint8_t* view_at(size_t position, size_t size, std::vector<uint8_t>& scratch)
+            {
+                scratch.resize(size);
+                return read_at(position, scratch.data(), size) ? scratch.data() : nullptr;
+            }
+
+            /// Returns true if the file holds at least size bytes.
+            bool holds(uint64_t size) const
+            {
+#if defined(_WIN32)
+                LARGE_INTEGER file_size = {};
+                return GetFileSizeEx(m_file, &file_size) && static_cast<uint64_t>(file_size.QuadPart) >= size;
+#else
+                struct stat file_status = {};
+                return fstat(m_file, &file_status) == 0 && static_cast<uint64_t>(file_status.st_size) >= size;
+#endif
+            }
+
+            /// Advises the operating system how the given range of the file is read, a size of zero covers the rest of the file.
+            void advise(file_advice advice, size_t offset, size_t size) const
+            {
+#if defined(POSIX_FADV_SEQUENTIAL)
+                const int values[] = { POSIX_FADV_SEQUENTIAL, POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED };
+                // failures are ignored on purpose, the advice is a hint and the file is read the same way without it
+                (void)posix_fadvise(m_file, static_cast<off_t>(offset), static_cast<off_t>(size), values[static_cast<int>(advice)]);
+#else
+                (void)advice;
+                (void)offset;
+                (void)size;
+#endif
+            }
+
+            /// Reads from a file opened by the caller, it is not closed.
+            void attach(native_file_handle file)
+            {
+                close();
+                m_file = file;
+                m_owns_file = false;
+            }
+
+#if defined(_WIN32)
+            bool open(const char* filename)
+            {
+                m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                return m_file != INVALID_HANDLE_VALUE;
+            }
+
+            bool open(const wchar_t* filename)
+            {
+                m_file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                return m_file != INVALID_HANDLE_VALUE;
+            }
+
+            void close()
+            {
+                if (m_file != INVALID_HANDLE_VALUE && m_owns_file)
+                {
+                    CloseHandle(m_file);
+                }
+                m_file = INVALID_HANDLE_VALUE;
+                m_owns_file = true;
+            }
+
+        private:
+            size_t read_some_at(size_t position, uint8_t* p_destination, size_t size)
+            {
+                // the offset of the overlapped structure makes the read independent of the file pointer
+                OVERLAPPED overlapped = {};
+                overlapped.Offset = static_cast<DWORD>(position);
+                overlapped.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(position) >> 32);
+                DWORD bytes_read = 0;
+                if (!ReadFile(m_file, p_destination, static_cast<DWORD>(std::min(size, static_cast<size_t>(1) << 30)), &bytes_read, &overlapped))
+                {
+                    bytes_read = 0;
+                }
+                return bytes_read;
+            }
+
+            HANDLE m_file = INVALID_HANDLE_VALUE;
+#else
+            bool open(const char* filename)
+            {
+                m_file = ::open(filename, O_RDONLY | O_CLOEXEC);
+                return m_file >= 0;
+            }
+
+            void close()
+            {
+                if (m_file >= 0 && m_owns_file)
+                {
+                    ::close(m_file);
+                }
+                m_file = -1;
+                m_owns_file = true;
+            }
+
+        private:
+            size_t read_some_at(size_t position, uint8_t* p_destination, size_t size)
+            {
+                ssize_t bytes_read = 0;
+                do
+                {
+                    bytes_read = ::pread(m_file, p_destination, size, static_cast<off_t>(position));
+                } while (bytes_read < 0 && errno == EINTR);
+                return bytes_read > 0 ? static_cast<size_t>(bytes_read) : 0;
+            }
+
+            int m_file = -1;
+#endif
+            bool m_owns_file = true;
+        };
+
+        /**
+            \brief Serves reads of the beginning of a file from memory holding it, e.g., the prefix read by a bmp_probe, the remaining reads are passed to another input.
+        */
+        template <typename input_type>
+        class prefixed_input
+        {
+        public:
+            prefixed_input(const uint8_t* p_prefix, size_t prefix_size, input_type& input)
+                : m_p_prefix(p_prefix)
+                , m_prefix_size(prefix_size)
+                , m_input(input)
+            {
+            }
+
+            /// Reads size bytes at position into destination, returns false if not all bytes could be read.
+            bool read_at(size_t position, void* destination, size_t size)
+            {
+                if (position <= m_prefix_size && size <= m_prefix_size - position)
+                {
+                    memcpy(destination, m_p_prefix + position, size);
+                    return true;
+                }
+                return m_input.read_at(position, destination, size);
+            }
+
+            /// Returns a pointer to size bytes at position, scratch is used to hold the data. Returns nullptr on error.
+            const uint8_t* view_at(size_t position, size_t size, std::vector<uint8_t>& scratch)
+            {
+                if (position <= m_prefix_size && size <= m_prefix_size - position)
+                {
+                    return m_p_prefix + position;
+                }
+                return m_input.view_at(position, size, scratch);
+            }
+
+            /// Returns true if the prefix or the input holds at least size bytes.
+            bool holds(uint64_t size)
+            {
+                return size <= m_prefix_size || m_input.holds(size);
+            }
+
+            /// Returns the input the remaining reads are passed to.
+            const input_type& wrapped() const
+            {
+                return m_input;
+            }
+
+        private:
+            const uint8_t* m_p_prefix;
+            size_t m_prefix_size;
+            input_type& m_input;
+        };
+
+        /// Streams cannot be read by several threads at the same time.
+        static bool supports_concurrent_reads(const stream_input&)
+        {
+            return false;
+        }
+
+        template <typename input_type>
+        static bool supports_concurrent_reads(const input_type&)
+        {
+            return true;
+        }
+
+        /// Counts and times the reads from another input.
+        template <typename input_type>
+        class counting_input
+        {
+        public:
+            counting_input(input_type& input, operation_statistics& statistics)
+                : m_input(input)
+                , m_statistics(statistics)
+            {
+            }
+
+            /// Reads size bytes at position into destination, returns false if not all bytes could be read.
+            bool read_at(size_t position, void* destination, size_t size)
+            {
+                scoped_timer timer(&m_statistics.read_nanoseconds);
+                count_read(size);
+                return m_input.read_at(position, destination, size);
+            }
+
+            /// Returns a pointer to size bytes at position, scratch may be used to hold the data. Returns nullptr on error.
+            const uint8_t* view_at(size_t position, size_t size, std::vector<uint8_t>& scratch)
+            {
+                scoped_timer timer(&m_statistics.read_nanoseconds);
+                count_read(size);
+                return m_input.view_at(position, size, scratch);
+            }
+
+            /// Returns true if the input holds at least size bytes, it is not counted as a read.
+            bool holds(uint64_t size)
+            {
+                return m_input.holds(size);
+            }
+
+            /// Returns the input read from.
+            const input_type& wrapped() const
+            {
+                return m_input;
+            }
+
+        private:
+            void count_read(size_t size)
+            {
+                m_statistics.read_calls.fetch_add(1, std::memory_order_relaxed);
+                m_statistics.bytes_read.fetch_add(size, std::memory_order_relaxed);
+            }
+
+            input_type& m_input;
+            operation_statistics& m_statistics;
+        };
+
+        template <typename input_type>
+        static bool supports_concurrent_reads(const counting_input<input_type>& input)
+        {
+            return supports_concurrent_reads(input.wrapped());
+        }
+
+        template <typename input_type>
+        static bool supports_concurrent_reads(const prefixed_input<input_type>& input)
+        {
+            return supports_concurrent_reads(input.wrapped());
+        }
+
+        /// Only files take advice about how they are read.
+        template <typename input_type>
+        static void advise(const input_type&, file_advice, size_t, size_t)
+        {
+        }
+
+        static void advise(const file_input& input, file_advice advice, size_t offset, size_t size)
+        {
+            input.advise(advice, offset, size);
+        }
+
+        template <typename input_type>
+        static void advise(const counting_input<input_type>& input, file_advice advice, size_t offset, size_t size)
+        {
+            advise(input.wrapped(), advice, offset, size);
+        }
+
+        template <typename input_type>
+        static void advise(const prefixed_input<input_type>& input, file_advice advice, size_t offset, size_t size)
+        {
+            advise(input.wrapped(), advice, offset, size);
+        }
+
+        static size_t determine_thread_count(size_t thread_count)
+        {
+            return thread_count != 0 ? thread_count : std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        /// Returns the number of bands process_bands() splits the lines into.
+        static size_t determine_band_count(size_t line_count, size_t thread_count)
+        {
+            return std::max(std::min(determine_thread_count(thread_count), line_count), static_cast<size_t>(1));
+        }
+
+        /// Keeps the first exception thrown by work run on several threads, so that it can be rethrown once they have been joined.
+        class first_exception
+        {
+        public:
+            /// Runs work, an exception thrown by it is kept instead of being propagated.
+            template <typename work_type>
+            void run(const work_type& work)
+            {
+                try
+                {
+                    work();
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (!m_exception)
+                    {
+                        m_exception = std::current_exception();
+                        m_caught = true;
+                    }
+                }
+            }
+
+            /// Returns true if an exception has been kept.
+            bool caught() const
+            {
+                return m_caught;
+            }
+
+            /// Rethrows the exception kept, if any.
+            void rethrow() const
+            {
+                if (m_exception)
+                {
+                    std::rethrow_exception(m_exception);
+                }
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::exception_ptr m_exception;
+            std::atomic<bool> m_caught{false};
+        };
+
+        /// Starts worker threads and joins them at the latest when destroyed, so that unwinding never destroys a joinable thread.
+        class worker_threads
+        {
+        public:
+            worker_threads() = default;
+
+            worker_threads(const worker_threads&) = delete;
+            worker_threads& operator=(const worker_threads&) = delete;
+
+            ~worker_threads()
+            {
+                join();
+            }
+
+            /**
+                \brief Starts up to count threads, the thread with the given index calls work(index).
+                Stops at the first thread that cannot be started, e.g., if its state cannot be allocated. An exception thrown by work terminates the process, see first_exception.
+                \return Returns the number of threads started.
+            */
+            template <typename work_type>
+            size_t start(size_t count, const work_type& work)
+            {
+                // reserved up front, so that adding a thread never reallocates the running ones
+                m_threads.reserve(m_threads.size() + count);
+                for (size_t index = 0; index < count; ++index)
+                {
+                    try
+                    {
+                        m_threads.emplace_back(work, index);
+                    }
+                    catch (const std::system_error&)
+                    {
+                        return index;
+                    }
+                    catch (const std::bad_alloc&)
+                    {
+                        return index;
+                    }
+                }
+                return count;
+            }
+
+            /// Returns the number of threads started and not joined yet.
+            size_t size() const
+            {
+                return m_threads.size();
+            }
+
+            /// Waits for all threads to finish.
+            void join()
+            {
+                for (std::thread& thread : m_threads)
+                {
+                    thread.join();
+                }
+                m_threads.clear();
+            }
+
+        private:
+            std::vector<std::thread> m_threads;
+        };
+
+        /**
+            \brief Splits the lines into a band per thread and calls process(first_line, line_count) for each band.
+            The first band is processed by the calling thread, bands are processed by it as well if no thread can be started for them. Empty bands are skipped.
+            An exception thrown by process, e.g., std::bad_alloc, is rethrown after all bands have been processed.
+            \return Returns ok if all bands have been processed, otherwise the result of the first band that failed.
+        */
+        template <typename band_function>
+        static operation_result process_bands(size_t line_count, size_t thread_count, const band_function& process)
+        {
+            const size_t max_band_count = determine_band_count(line_count, thread_count);
+            const size_t lines_per_band = (line_count + max_band_count - 1) / max_band_count;
+            // rounding up the lines per band may leave the last bands empty, they are skipped
+            const size_t band_count = lines_per_band != 0 ? (line_count + lines_per_band - 1) / lines_per_band : 1;
+            std::vector<operation_result> results(band_count, operation_result(operation_result_type::ok));
+            first_exception failure;
+            auto process_band = [&process, &results, &failure, line_count, lines_per_band](size_t band)
+            {
+                failure.run([&process, &results, line_count, lines_per_band, band]()
+                {
+                    const size_t first_line = band * lines_per_band;
+                    results[band] = process(first_line, std::min(lines_per_band, line_count - first_line));
+                });
+            };
+
+            worker_threads workers;
+            const size_t started = workers.start(band_count - 1, [&process_band](size_t index) { process_band(index + 1); });
+            for (size_t band = started + 1; band < band_count; ++band)
+            {
+                process_band(band);
+            }
+            process_band(0);
+            workers.join();
+            failure.rethrow();
+
+            operation_result result(operation_result_type::ok);
+            for (const operation_result& band_result : results)
+            {
+                if (!band_result)
+                {
+                    result = band_result;
+                    break;
+                }
+            }
+            return result;
+        }
+
+        /// Writes the content of a BMP file into memory.
+        class memory_output
+        {
+        public:
+            memory_output(void* data, size_t size)
+                : m_data(reinterpret_cast<uint8_t*>(data))
+                , m_size(size)
+            {
+            }
+
+            /// Appends size bytes from source, returns false if the output is full.
+            bool write(const void* source, size_t size)
+            {
+                if (size > m_size - m_position)
+                {
+                    return false;
+                }
+                memcpy(m_data + m_position, source, size);
+                m_position += size;
+                return true;
+            }
+
+            /// Overwrites size bytes at position with source, the bytes need to be written before.
+            bool write_at(size_t position, const void* source, size_t size)
+            {
+                if (position > m_position || size > m_position - position)
+                {
+                    return false;
+                }
+                memcpy(m_data + position, source, size);
+                return true;
+            }
+
+            /// Returns the number of bytes written.
+            size_t position() const
+            {
+                return m_position;
+            }
+
+            /// Appends size bytes to be filled by the caller, returns nullptr if the output is full.
+            uint8_t* append(size_t size)
+            {
+                if (size > m_size - m_position)
+                {
+                    return nullptr;
+                }
+                uint8_t* p_appended = m_data + m_position;
+                m_position += size;
+                return p_appended;
+            }
+
+        private:
+            uint8_t* m_data;
+            size_t m_size;
+            size_t m_position = 0;
+        };
+
+        static bool is_run_length_encoded(const bmp_header& header)
+        {
+            return header.compression == compression_rle8 || header.compression == compression_rle4;
+        }
+
+        /// Writes the content of a BMP file to a stream, small writes are collected in a chunk.
+        class stream_output
+        {
+        public:
+            stream_output(std::ostream& stream, uint8_t* p_chunk, size_t chunk_size, operation_statistics* p_statistics)
+                : m_stream(stream)
+                , m_chunk(p_chunk)
+                , m_chunk_size(chunk_size)
+                , m_p_statistics(p_statistics)
+            {
+            }
+
+            /// Appends size bytes from source, returns false on error.
+            bool write(const void* source, size_t size)
+            {
+                if (size > m_chunk_size - m_used && !flush())
+                {
+                    return false;
+                }
+                m_position += size;
+                if (size >= m_chunk_size)
+                {
+                    // large writes bypass the chunk
+                    return write_stream(source, size);
+                }
+                memcpy(m_chunk + m_used, source, size);
+                m_used += size;
+                return true;
+            }
+
+            /// Overwrites size bytes at position with source, the bytes need to be written before.
+            bool write_at(size_t position, const void* source, size_t size)
+            {
+                if (position > m_position || size > m_position - position || !flush())
+                {
+                    return false;
+                }
+                m_stream.seekp(static_cast<std::streamoff>(position));
+                const bool written = write_stream(source, size);
+                m_stream.seekp(static_cast<std::streamoff>(m_position));
+                return written && static_cast<bool>(m_stream);
+            }
+
+            /// Writes the collected bytes to the stream.
+            bool flush()
+            {
+                const bool written = m_used == 0 || write_stream(m_chunk, m_used);
+                m_used = 0;
+                return written;
+            }
+
+            /// Returns the number of bytes written.
+            size_t position() const
+            {
+                return m_position;
+            }
+
+        private:
+            bool write_stream(const void* source, size_t size)
+            {
+                scoped_timer timer(get_counter(m_p_statistics, &operation_statistics::write_nanoseconds));
+                count(m_p_statistics, &operation_statistics::write_calls);
+                count(m_p_statistics, &operation_statistics::bytes_written, size);
+                m_stream.write(reinterpret_cast<const char*>(source), static_cast<std::streamsize>(size));
+                return static_cast<bool>(m_stream);
+            }
+
+            std::ostream& m_stream;
+            uint8_t* m_chunk;
+            size_t m_chunk_size;
+            operation_statistics* m_p_statistics;
+            size_t m_used = 0;
+            size_t m_position = 0;
+        };
+
+        /// Writes the content of a BMP file with positional writes, so that several threads can write bands of lines at the same time.
+        class file_output
+        {
+        public:
+            explicit file_output(operation_statistics* p_statistics)
+                : m_p_statistics(p_statistics)
+            {
+            }
+
+            file_output(const file_output&) = delete;
+            file_output& operator=(const file_output&) = delete;
+
+            ~file_output()
+            {
+                close();
+            }
+
+            /// Appends size bytes from source, returns false on error.
+            bool write(const void* source, size_t size)
+            {
+                const bool written = write_at(m_position, source, size);
+                m_position += size;
+                return written;
+            }
+
+            /// Writes size bytes from source at position, returns false on error.
+            bool write_at(size_t position, const void* source, size_t size)
+            {
+                scoped_timer timer(get_counter(m_p_statistics, &operation_statistics::write_nanoseconds));
+                count(m_p_statistics, &operation_statistics::write_calls);
+                count(m_p_statistics, &operation_statistics::bytes_written, size);
+                const uint8_t* p_source = reinterpret_cast<const uint8_t*>(source);
+                while (size > 0)
+                {
+                    const size_t bytes_written = write_some_at(position, p_source, size);
+                    if (bytes_written == 0)
+                    {
+                        return false;
+                    }
+                    position += bytes_written;
+                    p_source += bytes_written;
+                    size -= bytes_written;
+                }
+                return true;
+            }
+
+            /// Returns the number of bytes appended.
+            size_t position() const
+            {
+                return m_position;
+            }
+
+#if defined(_WIN32)
+            bool open(const char* filename)
+            {
+                m_file = CreateFileA(filename, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+                return m_file != INVALID_HANDLE_VALUE;
+            }
+
+            bool open(const wchar_t* filename)
+            {
+                m_file = CreateFileW(filename, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+                return m_file != INVALID_HANDLE_VALUE;
+            }
+
+            /// Closes the file, returns false if it could not be closed.
+            bool close()
+            {
+                const bool closed = m_file == INVALID_HANDLE_VALUE || CloseHandle(m_file) != 0;
+                m_file = INVALID_HANDLE_VALUE;
+                return closed;
+            }
+
+        private:
+            size_t write_some_at(size_t position, const uint8_t* p_source, size_t size)
+            {
+                // the offset of the overlapped structure makes the write independent of the file pointer
+                OVERLAPPED overlapped = {};
+                overlapped.Offset = static_cast<DWORD>(position);
+                overlapped.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(position) >> 32);
+                DWORD bytes_written = 0;
+                if (!WriteFile(m_file, p_source, static_cast<DWORD>(std::min(size, static_cast<size_t>(1) << 30)), &bytes_written, &overlapped))
+                {
+                    bytes_written = 0;
+                }
+                return bytes_written;
+            }
+
+            HANDLE m_file = INVALID_HANDLE_VALUE;
+#else
+            bool open(const char* filename)
+            {
+                m_file = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+                return m_file >= 0;
+            }
+
+            /// Closes the file, returns false if it could not be closed.
+            bool close()
+            {
+                const bool closed = m_file < 0 || ::close(m_file) == 0;
+                m_file = -1;
+                return closed;
+            }
+
+        private:
+            size_t write_some_at(size_t position, const uint8_t* p_source, size_t size)
+            {
+                ssize_t bytes_written = 0;
+                do
+                {
+                    bytes_written = ::pwrite(m_file, p_source, size, static_cast<off_t>(position));
+                } while (bytes_written < 0 && errno == EINTR);
+                return bytes_written > 0 ? static_cast<size_t>(bytes_written) : 0;
+            }
+
+            int m_file = -1;
+#endif
+            operation_statistics* m_p_statistics;
+            size_t m_position = 0;
+        };
+
+        static std::future<operation_result> make_ready_future(const operation_result& result)
+        {
+            std::promise<operation_result> promise;
+            promise.set_value(result);
+            return promise.get_future();
+        }
+
+        /// Runs the operation on a new thread owned by the returned future, which joins it when destroyed. Reports thread_start_error if no thread can be created.
+        template <typename operation_type>
+        static std::future<operation_result> run_async(const operation_type& operation)
+        {
+            try
+            {
+                return std::async(std::launch::async, operation);
+            }
+            catch (const std::system_error&)
+            {
+                return make_ready_future(operation_result_type::thread_start_error);
+            }
+        }
+
+        static size_t determine_stride(uint16_t bits_per_pixel, int32_t width)
+        {
+            // lines are aligned to 4 bytes
+            return (static_cast<size_t>(bits_per_pixel) * abs(width) + 31) / 32 * 4;
+        }
+
+        static size_t determine_line_padding(uint16_t bits_per_pixel, int32_t width)
+        {
+            const size_t line_size = (static_cast<size_t>(bits_per_pixel) * abs(width) + 7) / 8;
+            return determine_stride(bits_per_pixel, width) - line_size;
+        }
+
+        static size_t determine_line_padding(pixel_format_type pixel_format, uint32_t width)
+        {
+            // the line padding a BMP file would use for these pixels
+            const size_t line_size = width * byte_per_pixel(pixel_format);
+            return line_size % 4 == 0 ? 0 : 4 - line_size % 4;
+        }
+
+        static size_t byte_per_pixel(pixel_format_type pixel_format)
+        {
+            size_t byte_per_pixel = 0;
+            if (pixel_format == pixel_format_type::Mono8)
+            {
+                byte_per_pixel = 1;
+            }
+            else if (pixel_format == pixel_format_type::BGR8 || pixel_format == pixel_format_type::RGB8)
+            {
+                byte_per_pixel = 3;
+            }
+            else if (pixel_format == pixel_format_type::BGRA8 || pixel_format == pixel_format_type::RGBA8)
+            {
+                byte_per_pixel = 4;
+            }
+            else
+            {
+                assert(false); // invalid path
+            }
+            return byte_per_pixel;
+        }
+
+        static size_t determine_stride(const image_properties& the_image_properties)
+        {
+            size_t stride = the_image_properties.width * byte_per_pixel(the_image_properties.pixel_format) + the_image_properties.line_padding;
+            return stride;
+        }
+
+        template <typename input_type>
+        static operation_result load_and_check_header(input_type& input, bmp_header& header_out)
+        {
+            operation_result result(operation_result_type::ok);
+            const bmp_header& header = header_out;
+
+            if (!input.read_at(0, &header_out, sizeof(header_out)))
+            {
+                result = operation_result_type::not_a_bmp_file;
+            }
+            else
+            {
+                // header.type; -> expected to be BM
+                // header.size; -> ignored, because it is unreliable
+                // header.reserved1; -> ignored
+                // header.reserved2; -> ignored
+                // header.offset; -> checked
+                // header.dib_header_size; -> checked
+                // header.width; -> checked
+                // header.height; -> checked
+                // header.num_planes; -> ignored, not used for bmp
+                // header.bits_per_pixel; -> checked
+                // header.compression; -> checked
+                // header.image_size_bytes; -> checked
+                // header.x_resolution; -> ignored, not used
+                // header.y_resolution; -> ignored, not used
+                // header.num_colors; -> checked
+                // header.important_colors; -> checked
+            
+                //check the header
+                if (header.type != 0x4D42)
+                {
+                    result = operation_result_type::not_a_bmp_file;
+                }
+                else if (header.bitmap_info_header_size < 40)
+                {
+                    result = operation_result_type::corrupt;
+                }
+                else if (header.offset < sizeof(header))
+                {
+                    result = operation_result_type::corrupt;
+                }
+                else if (header.height == 0 || header.height == INT32_MIN || header.width <= 0)
+                {
+                    // the magnitude of INT32_MIN cannot be represented, abs(header.height) would overflow
+                    result = operation_result_type::corrupt;
+                }
+                else if (!(header.bits_per_pixel == 1 || header.bits_per_pixel == 4 || header.bits_per_pixel == 8 || header.bits_per_pixel == 16 || header.bits_per_pixel == 24 || header.bits_per_pixel == 32))
+                {
+                    result = operation_result_type::corrupt;
+                }
+                else if (!(header.compression == compression_rgb
+                    || (header.compression == compression_rle8 && header.bits_per_pixel == 8)
+                    || (header.compression == compression_rle4 && header.bits_per_pixel == 4)
+                    || ((header.compression == compression_bit_fields || header.compression == compression_alpha_bit_fields) && (header.bits_per_pixel == 16 || header.bits_per_pixel == 32))))
+                {
+                    result = operation_result_type::unsupported_compression;
+                }
+                else if (header.bits_per_pixel > 8 && (header.num_colors != 0 || header.important_colors != 0))
+                {
+                    result = operation_result_type::unsupported_use_of_color_table;
+                }
+                else if (header.bits_per_pixel <= 8 && (header.num_colors > 256 || header.important_colors > 256))
+                {
+                    result = operation_result_type::too_large_color_table;
+                }
+                else if (is_run_length_encoded(header))
+                {
+                    // the size of the compressed pixel data is needed to decode it
+                    if (header.image_size_bytes == 0)
+                    {
+                        result = operation_result_type::corrupt;
+                    }
+                }
+                else
+                {
+                    size_t image_data_size = determine_stride(header.bits_per_pixel, header.width) * abs(header.height);
+
+                    if (!(header.image_size_bytes == 0 || header.image_size_bytes == image_data_size))
+                    {
+                        result = operation_result_type::corrupt;
+                    }
+                }
+            }
+
+            return result;
+        }
+
+        template <typename input_type>
+        static operation_result load_color_table(input_type& input, const bmp_header& header, color_table_info& color_table_out)
+        {
+            operation_result result(operation_result_type::ok);
+            if (header.num_colors)
+            {
+                color_table_out.entries.resize(header.num_colors);
+            }
+            else if (header.num_colors == 0 && header.bits_per_pixel == 1)
+            {
+                color_table_out.entries.resize(2);
+            }
+            else if (header.num_colors == 0 && header.bits_per_pixel == 4)
+            {
+                color_table_out.entries.resize(16);
+            }
+            else if (header.num_colors == 0 && header.bits_per_pixel == 8)
+            {
+                color_table_out.entries.resize(256);
+            }
+
+            if (!color_table_out.entries.empty())
+            {
+                const size_t size_of_color_table_bytes = color_table_out.entries.size() * sizeof(color_table_entry);
+                if (!input.read_at(header.bitmap_info_header_size + 14 /* file header size */, color_table_out.entries.data(), size_of_color_table_bytes))
+                {
+                    result = operation_result_type::file_read_error;
+                }
+                else
+                {
+                    color_table_out.is_mono8 = check_is_mono8(color_table_out.entries);
+                    color_table_out.is_linear_mono8 = check_is_linear_mono8(color_table_out.entries);
+                }
+            }
+            else
+            {
+                result = operation_result_type::unsupported_use_of_color_table;
+            }
+            return result;
+        }
+
+        template <typename input_type>
+        static operation_result load_bit_masks(input_type& input, const bmp_header& header, color_table_info& color_table_out)
+        {
+            operation_result result(operation_result_type::ok);
+            uint32_t* p_masks = color_table_out.bit_masks;
+            if (header.compression == compression_rgb)
+            {
+                // X1R5G5B5 or X8R8G8B8
+                const uint32_t default_masks_16[4] = { 0x7C00, 0x03E0, 0x001F, 0 };
+                const uint32_t default_masks_32[4] = { 0x00FF0000, 0x0000FF00, 0x000000FF, 0 };
+                const uint32_t* p_default_masks = header.bits_per_pixel == 16 ? default_masks_16 : default_masks_32;
+                std::copy(p_default_masks, p_default_masks + 4, p_masks);
+            }
+            else
+            {
+                // the masks follow a 40 byte header or are part of the larger headers, which also hold the alpha mask
+                const size_t mask_count = header.compression == compression_alpha_bit_fields || header.bitmap_info_header_size >= 56 ? 4 : 3;
+                if (!input.read_at(sizeof(bmp_header), p_masks, mask_count * sizeof(uint32_t)))
+                {
+                    result = operation_result_type::file_read_error;
+                }
+                for (size_t i = 0; result && i < 4; ++i)
+                {
+                    uint32_t mask = p_masks[i];
+                    while (mask != 0 && (mask & 1) == 0)
+                    {
+                        mask >>= 1;
+                    }
+                    if ((mask & (mask + 1)) != 0)
+                    {
+                        // the bits of a channel are expected to be contiguous
+                        result = operation_result_type::corrupt;
+                    }
+                }
+            }
+            return result;
+        }
+
+        static bool check_is_linear_mono8(const std::vector<color_table_entry>& color_table)
+        {
+            // written without early exit so that compilers can vectorize the loop
+            uint32_t mismatch = 0;
+            for (size_t i = 0; i < color_table.size(); ++i)
+            {
+                const color_table_entry& entry = color_table[i];
+                const uint8_t expected = static_cast<uint8_t>(i);
+                mismatch |= static_cast<uint32_t>((entry.b ^ expected) | (entry.g ^ expected) | (entry.r ^ expected));
+            }
+            return mismatch == 0;
+        }
+
+        static bool check_is_mono8(const std::vector<color_table_entry>& color_table)
+        {
+            // written without early exit so that compilers can vectorize the loop
+            uint32_t mismatch = 0;
+            for (const color_table_entry& entry : color_table)
+            {
+                mismatch |= static_cast<uint32_t>((entry.r ^ entry.g) | (entry.r ^ entry.b));
+            }
+            return mismatch == 0;
+        }
+
+        static void determine_image_properties(const bmp_header& header, const color_table_info& color_table, image_properties& the_image_properties)
+        {
+            
+            the_image_properties.height = abs(header.height);
+            the_image_properties.width = abs(header.width);
+            if (header.bits_per_pixel <= 8)
+            {
+                if (color_table.is_mono8)
+                {
+                    the_image_properties.pixel_format = pixel_format_type::Mono8;
+                }
+                else
+                {
+                    the_image_properties.pixel_format = pixel_format_type::BGR8;
+                }
+            }
+            else if (header.bits_per_pixel == 16)
+            {
+                the_image_properties.pixel_format = color_table.bit_masks[3] != 0 ? pixel_format_type::BGRA8 : pixel_format_type::BGR8;
+            }
+            else if (header.bits_per_pixel == 24)
+            {
+                the_image_properties.pixel_format = pixel_format_type::BGR8;
+            }
+            else if (header.bits_per_pixel == 32)
+            {
+                the_image_properties.pixel_format = pixel_format_type::BGRA8;
+            }
+            else
+            {
+                assert(false); // not supported yet
+            }
+            
+            the_image_properties.orientation = header.height < 0 ? orientation_type::top_down : orientation_type::bottom_up;
+            if (header.bits_per_pixel < 8 || header.bits_per_pixel == 16)
+            {
+                the_image_properties.line_padding = determine_line_padding(the_image_properties.pixel_format, the_image_properties.width);
+            }
+            else
+            {
+                the_image_properties.line_padding = determine_line_padding(header.bits_per_pixel, header.width);
+            }
+        }
+
+        static bool check_save_properties(const image_properties& the_image_properties)
+        {
+            return !(
+                the_image_properties.height == 0
+                || the_image_properties.width == 0
+                || the_image_properties.pixel_format == pixel_format_type::invalid
+                || the_image_properties.orientation == orientation_type::invalid
+                || determine_stride(the_image_properties) == 0
+                );
+        }
+
+        static bool check_save_options(const image_properties& the_image_properties, const save_options& options)
+        {
+            // only pixel formats of BMP files can be stored, run length encoding is limited to indices
+            const bool valid_pixel_format = options.pixel_format == pixel_format_type::invalid
+                || options.pixel_format == pixel_format_type::Mono8
+                || options.pixel_format == pixel_format_type::BGR8
+                || options.pixel_format == pixel_format_type::BGRA8;
+            // the size in the worst case is stored in the header, it has to fit in 32 bits
+            return valid_pixel_format
+                && (!options.run_length_encoding
+                    || (determine_file_properties(the_image_properties, options).pixel_format == pixel_format_type::Mono8
+                        && sizeof(bmp_header) + 256 * sizeof(color_table_entry) + determine_run_length_encoded_size(the_image_properties) <= UINT32_MAX));
+        }
+
+        /// Returns the size of the run length encoded pixels of a Mono8 image in the worst case.
+        static uint64_t determine_run_length_encoded_size(const image_properties& the_image_properties)
+        {
+            // each line takes at most two bytes per pixel and the end of line, the end of bitmap follows the last line
+            return (2 * static_cast<uint64_t>(the_image_properties.width) + 2) * the_image_properties.height + 2;
+        }
+
+        static image_properties determine_file_properties(const image_properties& the_image_properties, const save_options& options)
+        {
+            image_properties file_properties = the_image_properties;
+            if (options.pixel_format != pixel_format_type::invalid)
+            {
+                file_properties.pixel_format = options.pixel_format;
+            }
+            else if (the_image_properties.pixel_format == pixel_format_type::RGB8)
+            {
+                file_properties.pixel_format = pixel_format_type::BGR8;
+            }
+            else if (the_image_properties.pixel_format == pixel_format_type::RGBA8)
+            {
+                file_properties.pixel_format = pixel_format_type::BGRA8;
+            }
+            return file_properties;
+        }
+
+        static operation_result check_save_arguments(size_t buffer_size, const image_properties& the_image_properties, const save_options& options)
+        {
+            operation_result result(operation_result_type::ok);
+            if (!check_save_properties(the_image_properties) || !check_save_options(the_image_properties, options) || buffer_size == 0)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else if (determine_stride(the_image_properties) * the_image_properties.height > buffer_size)
+            {
+                result = operation_result_type::buffer_too_small;
+            }
+            return result;
+        }
+
+        static void create_header(const image_properties& the_image_properties, bool force_bottom_up, bool run_length_encoding, bmp_header& header)
+        {
+            // fill in initial values
+            header.type = 0x4D42;
+            header.size = sizeof(bmp_header);
+            header.reserved1 = 0;
+            header.reserved2 = 0;
+            header.offset = sizeof(bmp_header);
+            header.bitmap_info_header_size = sizeof(bmp_header) - 14;
+            header.width = static_cast<int32_t>(the_image_properties.width);
+            header.height = static_cast<int32_t>(the_image_properties.height);
+            if (!force_bottom_up && !run_length_encoding && the_image_properties.orientation == orientation_type::top_down)
+            {
+                header.height = -header.height;
+            }
+            header.num_planes = 1;
+            if (the_image_properties.pixel_format == pixel_format_type::Mono8)
+            {
+                header.bits_per_pixel = 8;
+            }
+            else if (the_image_properties.pixel_format == pixel_format_type::BGR8 || the_image_properties.pixel_format == pixel_format_type::RGB8)
+            {
+                header.bits_per_pixel = 24;
+            }
+            else if (the_image_properties.pixel_format == pixel_format_type::BGRA8 || the_image_properties.pixel_format == pixel_format_type::RGBA8)
+            {
+                header.bits_per_pixel = 32;
+            }
+            else
+            {
+                assert(false); //invalid path
+            }
+            header.compression = 0; // BI_RGB, no compression
+            header.image_size_bytes = 0; //keeping it 0
+            header.x_resolution = 0;
+            header.y_resolution = 0;
+            header.num_colors = 0;
+            header.important_colors = 0;
+
+            if (the_image_properties.pixel_format == pixel_format_type::Mono8)
+            {
+                header.size += 256 * sizeof(color_table_entry);
+                header.offset += 256 * sizeof(color_table_entry);
+                header.num_colors = 256;
+                header.important_colors = 256;
+            }
+
+            if (run_length_encoding)
+            {
+                // the size in the worst case, it is updated after encoding, check_save_options() ensures that it fits
+                header.compression = compression_rle8;
+                header.image_size_bytes = static_cast<uint32_t>(determine_run_length_encoded_size(the_image_properties));
+                header.size += header.image_size_bytes;
+            }
+            else
+            {
+                const size_t stride_in_file = determine_stride(header.bits_per_pixel, header.width);
+                const size_t image_size_in_file = stride_in_file * abs(header.height);
+                header.size += static_cast<uint32_t>(image_size_in_file);
+            }
+        }
+
+        template <typename input_type>
+        static operation_result load_image_properties(input_type& input, bmp_header& header, color_table_info& color_table_out, image_properties& the_image_properties, operation_statistics* p_statistics = nullptr)
+        {
+            // the color table may be reused, clearing it keeps its memory
+            color_table_out.entries.clear();
+            color_table_out.is_mono8 = false;
+            color_table_out.is_linear_mono8 = false;
+            std::fill(color_table_out.bit_masks, color_table_out.bit_masks + 4, 0);
+            operation_result result;
+            {
+                scoped_timer timer(get_counter(p_statistics, &operation_statistics::header_nanoseconds));
+                result = load_and_check_header(input, header);
+            }
+
+            scoped_timer timer(result && header.bits_per_pixel != 24 ? get_counter(p_statistics, &operation_statistics::color_table_nanoseconds) : nullptr);
+            if (result && header.bits_per_pixel <= 8)
+            {
+                result = load_color_table(input, header, color_table_out);
+            }
+            else if (result && (header.bits_per_pixel == 16 || header.bits_per_pixel == 32))
+            {
+                result = load_bit_masks(input, header, color_table_out);
+            }
+
+            if (result)
+            {
+                determine_image_properties(header, color_table_out, the_image_properties);
+            }
+            else
+            {
+                the_image_properties = image_properties(); // clear
+            }
+
+            return result;
+        }
+
+        static bool is_empty(const image_region& region)
+        {
+            return region.width == 0 || region.height == 0;
+        }
+
+        static operation_result apply_load_options(const load_options& options, image_properties& the_image_properties)
+        {
+            operation_result result(operation_result_type::ok);
+            const image_region& region = options.region;
+            bool padding_changed = false;
+            if (options.downscale_factor == 0 || (options.downscale_filter == downscale_filter_type::box && options.downscale_factor > 4096))
+            {
+                // the sums of a box filter need to fit 32 bit
+                result = operation_result_type::invalid_argument;
+            }
+            else if (!is_empty(region))
+            {
+                if (region.x > the_image_properties.width || region.width > the_image_properties.width - region.x
+                    || region.y > the_image_properties.height || region.height > the_image_properties.height - region.y)
+                {
+                    result = operation_result_type::invalid_argument;
+                }
+                else
+                {
+                    the_image_properties.width = region.width;
+                    the_image_properties.height = region.height;
+                    padding_changed = true;
+                }
+            }
+            if (result && options.downscale_factor > 1)
+            {
+                the_image_properties.width /= options.downscale_factor;
+                the_image_properties.height /= options.downscale_factor;
+                padding_changed = true;
+                if (the_image_properties.width == 0 || the_image_properties.height == 0)
+                {
+                    // the image is smaller than a block
+                    result = operation_result_type::invalid_argument;
+                }
+            }
+            if (options.pixel_format != pixel_format_type::invalid && options.pixel_format != the_image_properties.pixel_format)
+            {
+                the_image_properties.pixel_format = options.pixel_format;
+                padding_changed = true;
+            }
+            if (padding_changed)
+            {
+                the_image_properties.line_padding = determine_line_padding(the_image_properties.pixel_format, the_image_properties.width);
+            }
+            if (!result)
+            {
+                the_image_properties = image_properties(); // clear
+            }
+            return result;
+        }
+
+        /// Holds memory aligned to a power of two, which is not initialized and only grows.
+        class aligned_buffer
+        {
+        public:
+            /// Returns memory of at least size bytes at an address that is a multiple of alignment, throws std::bad_alloc if it cannot be allocated.
+            uint8_t* reserve(size_t size, size_t alignment)
+            {
+                const size_t needed = size + alignment - 1;
+                if (needed > m_capacity)
+                {
+                    m_storage.reset(); // release the old memory first to lower the peak
+                    m_capacity = 0;
+                    m_storage.reset(new uint8_t[needed]);
+                    m_capacity = needed;
+                }
+                return m_storage.get() + (alignment - reinterpret_cast<uintptr_t>(m_storage.get()) % alignment) % alignment;
+            }
+
+        private:
+            std::unique_ptr<uint8_t[]> m_storage;
+            size_t m_capacity = 0;
+        };
+
+        /// Holds memory reused between loads to avoid allocations.
+        struct decoder_scratch
+        {
+            color_table_info color_table; //!< The color table of the file.
+            std::vector<uint8_t> block_buffer; //!< Holds blocks of lines read from the file.
+            std::vector<uint8_t> index_line; //!< Holds a line of run length decoded indices.
+            std::vector<uint8_t> source_lines; //!< Holds the lines of a block before downscaling.
+            std::vector<uint32_t> sums; //!< Holds the channel sums of the box filter.
+            std::vector<char> stream_buffer; //!< Used as buffer of the file stream instead of allocating one for each file.
+            aligned_buffer direct_buffer; //!< Holds a file read bypassing the cache of the operating system.
+            std::vector<std::unique_ptr<decoder_scratch>> bands; //!< Holds the scratch memory of the bands loaded by other threads, the first band uses this one.
+        };
+
+        /// Provides a buffer of fixed size to load_image().
+        class fixed_buffer
+        {
+        public:
+            fixed_buffer(void* buffer, size_t buffer_size)
+                : m_buffer(buffer)
+                , m_buffer_size(buffer_size)
+            {
+            }
+
+            void* operator()(size_t size) const
+            {
+                return size <= m_buffer_size ? m_buffer : nullptr;
+            }
+
+        private:
+            void* m_buffer;
+            size_t m_buffer_size;
+        };
+
+        /// Provides a buffer to load_image() by resizing a vector.
+        class vector_buffer
+        {
+        public:
+            explicit vector_buffer(std::vector<uint8_t>& buffer)
+                : m_buffer(buffer)
+            {
+            }
+
+            void* operator()(size_t size) const
+            {
+                // an image too large for the memory is reported like a buffer provided by the caller that is too small
+                try
+                {
+                    m_buffer.resize(size);
+                }
+                catch (const std::bad_alloc&)
+                {
+                    return nullptr;
+                }
+                catch (const std::length_error&)
+                {
+                    return nullptr;
+                }
+                return m_buffer.data();
+            }
+
+        private:
+            std::vector<uint8_t>& m_buffer;
+        };
+
+        /// Provides the memory of a view to load_image() if the size of the image matches the view.
+        class view_buffer
+        {
+        public:
+            view_buffer(const image_view& view, uint8_t* p_lines, const image_properties& the_image_properties)
+                : m_view(view)
+                , m_p_lines(p_lines)
+                , m_image_properties(the_image_properties)
+            {
+            }
+
+            void* operator()(size_t /* size */) const
+            {
+                return m_image_properties.width == m_view.width && m_image_properties.height == m_view.height ? m_p_lines : nullptr;
+            }
+
+        private:
+            const image_view& m_view;
+            uint8_t* m_p_lines;
+            const image_properties& m_image_properties;
+        };
+
+        /// The bytes between the lines of buffers are not used by the caller and may be overwritten.
+        template <typename allocator_type>
+        static bool keeps_padding(const allocator_type&)
+        {
+            return false;
+        }
+
+        /// The bytes between the lines of a view may belong to other pixels of the caller.
+        static bool keeps_padding(const view_buffer&)
+        {
+            return true;
+        }
+
+        /**
+            \brief Describes the lines of a view as a buffer with padding, the lines of a view with negative row pitch are stored bottom up.
+            \param[in] view  The view to describe.
+            \param[out] the_image_properties  The properties of the buffer.
+            \param[out] p_lines  Points to the line with the lowest address.
+            \return Returns information about the result of the operation.
+        */
+        template <typename byte_type>
+        static operation_result describe_view(const image_view& view, image_properties& the_image_properties, byte_type*& p_lines)
+        {
+            operation_result result(operation_result_type::ok);
+            const size_t line_size = view.pixel_format == pixel_format_type::invalid ? 0 : view.width * byte_per_pixel(view.pixel_format);
+            const size_t pitch = static_cast<size_t>(view.row_pitch < 0 ? -view.row_pitch : view.row_pitch);
+            if (view.data == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (view.height == 0 || line_size == 0 || pitch < line_size)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                the_image_properties.width = view.width;
+                the_image_properties.height = view.height;
+                the_image_properties.line_padding = pitch - line_size;
+                the_image_properties.pixel_format = view.pixel_format;
+                the_image_properties.orientation = view.row_pitch < 0 ? orientation_type::bottom_up : orientation_type::top_down;
+                p_lines = reinterpret_cast<byte_type*>(view.data) + (view.row_pitch < 0 ? static_cast<std::ptrdiff_t>(view.height - 1) * view.row_pitch : 0);
+            }
+            return result;
+        }
+
+        template <typename char_type>
+        static operation_result load_reusing(const char_type* filename, const image_view& view, image_properties& the_image_properties, const load_options& options, decoder_scratch& scratch)
+        {
+            uint8_t* p_lines = nullptr;
+            operation_result result = describe_view(view, the_image_properties, p_lines);
+
+            if (result && filename == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (result)
+            {
+                // the pixel format, the padding and the orientation are given by the view
+                load_options view_options = options;
+                view_options.pixel_format = view.pixel_format;
+                view_buffer allocate(view, p_lines, the_image_properties);
+                result = load_file(filename, allocate, the_image_properties, true, true, view_options, scratch);
+            }
+            return result;
+        }
+
+        static operation_result load_reusing(const void* data, size_t data_size, const image_view& view, image_properties& the_image_properties, const load_options& options, decoder_scratch& scratch)
+        {
+            uint8_t* p_lines = nullptr;
+            operation_result result = describe_view(view, the_image_properties, p_lines);
+
+            if (result && data == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (result)
+            {
+                // the pixel format, the padding and the orientation are given by the view
+                load_options view_options = options;
+                view_options.pixel_format = view.pixel_format;
+                memory_input input(data, data_size);
+                view_buffer allocate(view, p_lines, the_image_properties);
+                result = load_image(input, allocate, the_image_properties, true, true, view_options, scratch);
+            }
+            return result;
+        }
+
+        template <typename char_type>
+        static operation_result load_reusing(const char_type* filename, void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, decoder_scratch& scratch)
+        {
+            operation_result result;
+
+            if (buffer == nullptr || filename == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                fixed_buffer allocate(buffer, buffer_size);
+                result = load_file(filename, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            return result;
+        }
+
+        template <typename char_type>
+        static operation_result load_reusing(const char_type* filename, std::vector<uint8_t>& buffer, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, decoder_scratch& scratch)
+        {
+            operation_result result;
+
+            if (filename == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                vector_buffer allocate(buffer);
+                result = load_file(filename, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            if (!result)
+            {
+                buffer.clear();
+            }
+            return result;
+        }
+
+        template <typename char_type>
+        static operation_result load_reusing(const char_type* filename, const std::function<void*(size_t)>& allocate, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, decoder_scratch& scratch)
+        {
+            operation_result result;
+
+            if (!allocate || filename == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                result = load_file(filename, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            return result;
+        }
+
+        static operation_result load_reusing(const void* data, size_t data_size, void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, decoder_scratch& scratch)
+        {
+            operation_result result;
+
+            if (buffer == nullptr || data == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                memory_input input(data, data_size);
+                fixed_buffer allocate(buffer, buffer_size);
+                result = load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            return result;
+        }
+
+        static operation_result load_reusing(const void* data, size_t data_size, std::vector<uint8_t>& buffer, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, decoder_scratch& scratch)
+        {
+            operation_result result;
+
+            if (data == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                memory_input input(data, data_size);
+                vector_buffer allocate(buffer);
+                result = load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            if (!result)
+            {
+                buffer.clear();
+            }
+            return result;
+        }
+
+        static operation_result load_reusing(const void* data, size_t data_size, const std::function<void*(size_t)>& allocate, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, decoder_scratch& scratch)
+        {
+            operation_result result;
+
+            if (!allocate || data == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                memory_input input(data, data_size);
+                result = load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            return result;
+        }
+
+        template <typename char_type, typename allocator_type>
+        static operation_result load_file(const char_type* filename, const allocator_type& allocate, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, decoder_scratch& scratch)
+        {
+            operation_result result;
+            if (options.direct_io && load_direct(filename, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch, result))
+            {
+                return result;
+            }
+            if (options.thread_count != 1 || options.sequential_access || options.drop_cache)
+            {
+                // several threads read bands of lines with positional reads, hints need the file descriptor
+                file_input input;
+                bool opened = false;
+                {
+                    scoped_timer timer(get_counter(options.statistics, &operation_statistics::open_nanoseconds));
+                    opened = input.open(filename);
+                }
+                if (!opened)
+                {
+                    result = operation_result_type::file_not_found;
+                    the_image_properties = image_properties(); // clear
+                }
+                else
+                {
+                    result = load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+                }
+                return result;
+            }
+            // the buffer of the stream is set before opening, so that the stream does not allocate one
+            const size_t stream_buffer_size = 4096;
+            scratch.stream_buffer.resize(stream_buffer_size);
+            std::ifstream file;
+            file.rdbuf()->pubsetbuf(scratch.stream_buffer.data(), static_cast<std::streamsize>(stream_buffer_size));
+            {
+                scoped_timer timer(get_counter(options.statistics, &operation_statistics::open_nanoseconds));
+                file.open(filename, std::ios::binary);
+            }
+            if (!file.is_open())
+            {
+                result = operation_result_type::file_not_found;
+                the_image_properties = image_properties(); // clear
+            }
+            else
+            {
+                stream_input input(file);
+                result = load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            file.close();
+            return result;
+        }
+
+#if defined(O_DIRECT)
+        /**
+            \brief Reads the whole file bypassing the cache of the operating system and decodes it from memory.
+            \return Returns false if the file cannot be read directly, e.g., on file systems without support for it, result is set otherwise.
+        */
+        template <typename allocator_type>
+        static bool load_direct(const char* filename, const allocator_type& allocate, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, decoder_scratch& scratch, operation_result& result)
+        {
+            // direct reads need positions, sizes and memory aligned to the logical block size, a page covers common devices
+            const size_t alignment = 4096;
+            int file = -1;
+            {
+                scoped_timer timer(get_counter(options.statistics, &operation_statistics::open_nanoseconds));
+                file = ::open(filename, O_RDONLY | O_DIRECT | O_CLOEXEC);
+            }
+            if (file < 0)
+            {
+                if (errno == ENOENT)
+                {
+                    result = operation_result_type::file_not_found;
+                    the_image_properties = image_properties(); // clear
+                    return true;
+                }
+                return false;
+            }
+            struct stat file_status = {};
+            if (fstat(file, &file_status) != 0 || file_status.st_size <= 0)
+            {
+                ::close(file);
+                return false;
+            }
+            const size_t file_size = static_cast<size_t>(file_status.st_size);
+            const size_t aligned_size = (file_size + alignment - 1) / alignment * alignment;
+            uint8_t* p_data = nullptr;
+            try
+            {
+                p_data = scratch.direct_buffer.reserve(aligned_size, alignment);
+            }
+            catch (const std::bad_alloc&)
+            {
+                ::close(file);
+                return false; // the file is read buffered, which needs no memory for the whole file
+            }
+            size_t position = 0;
+            int error = 0;
+            while (position < file_size)
+            {
+                ssize_t bytes_read = 0;
+                {
+                    scoped_timer timer(get_counter(options.statistics, &operation_statistics::read_nanoseconds));
+                    bytes_read = ::pread(file, p_data + position, aligned_size - position, static_cast<off_t>(position));
+                }
+                if (bytes_read > 0)
+                {
+                    position += static_cast<size_t>(bytes_read);
+                    if (position % alignment != 0)
+                    {
+                        break; // the end of the file or a short read, which leaves the next read unaligned
+                    }
+                }
+                else if (bytes_read == 0 || errno != EINTR)
+                {
+                    error = bytes_read == 0 ? 0 : errno;
+                    break;
+                }
+            }
+            ::close(file);
+            if (error == EINVAL || (error == 0 && position < file_size))
+            {
+                return false; // the file system does not support direct reads or a read ended before the end of the file
+            }
+            if (error != 0)
+            {
+                result = operation_result_type::file_read_error;
+                return true;
+            }
+            memory_input input(p_data, std::min(position, file_size));
+            result = load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            return true;
+        }
+#endif
+
+        /// Direct reads are not supported, the file is read buffered.
+        template <typename char_type, typename allocator_type>
+        static bool load_direct(const char_type*, const allocator_type&, image_properties&, bool, bool, const load_options&, decoder_scratch&, operation_result&)
+        {
+            return false;
+        }
+
+        template <typename input_type>
+        static operation_result load_image_layout(input_type& input, bmp_header& header, color_table_info& color_table, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, orientation_type& orientation_in_file)
+        {
+            orientation_type suggested_orientation = the_image_properties.orientation;
+            size_t suggested_line_padding = the_image_properties.line_padding;
+            operation_result result = load_image_properties(input, header, color_table, the_image_properties, options.statistics);
+            orientation_in_file = the_image_properties.orientation;
+
+            if (result)
+            {
+                result = apply_load_options(options, the_image_properties);
+            }
+            if (result)
+            {
+                if (force_line_padding)
+                {
+                    the_image_properties.line_padding = suggested_line_padding;
+                }
+                if (force_orientation)
+                {
+                    the_image_properties.orientation = suggested_orientation;
+                }
+            }
+            return result;
+        }
+
+        static void load_job(batch_load_job& job, decoder_scratch& scratch)
+        {
+            if (job.force_orientation && job.properties.orientation == orientation_type::invalid)
+            {
+                job.result = operation_result_type::invalid_argument;
+            }
+            else if (job.buffer != nullptr)
+            {
+                fixed_buffer allocate(job.buffer, job.buffer_size);
+                job.result = load_file(job.filename.c_str(), allocate, job.properties, job.force_line_padding, job.force_orientation, job.options, scratch);
+            }
+            else
+            {
+                vector_buffer allocate(job.pixels);
+                job.result = load_file(job.filename.c_str(), allocate, job.properties, job.force_line_padding, job.force_orientation, job.options, scratch);
+                if (!job.result)
+                {
+                    job.pixels.clear();
+                }
+            }
+        }
+
+        template <typename input_type, typename allocator_type>
+        static operation_result load_image(input_type& input, const allocator_type& allocate, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, decoder_scratch& scratch)
+        {
+#if defined(CPPBMPFILE_ENABLE_STATISTICS)
+            if (options.statistics != nullptr)
+            {
+                counting_input<input_type> counted_input(input, *options.statistics);
+                return decode_image(counted_input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+#endif
+            return decode_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+        }
+
+        template <typename input_type, typename allocator_type>
+        static operation_result decode_image(input_type& input, const allocator_type& allocate, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options, decoder_scratch& scratch)
+        {
+            bmp_header header = {};
+            color_table_info& color_table = scratch.color_table;
+            orientation_type orientation_in_file = orientation_type::invalid;
+            decoding_plan plan;
+            operation_result result = load_image_layout(input, header, color_table, the_image_properties, force_line_padding, force_orientation, options, orientation_in_file);
+
+            if (result)
+            {
+                result = prepare_decoding_plan(header, color_table, orientation_in_file, the_image_properties, options, plan);
+                plan.keep_padding = keeps_padding(allocate);
+            }
+            // the pixel data follows the header and the color table, which have been read already
+            const uint64_t pixel_data_size = result ? (plan.run_length_bits ? plan.compressed_size : static_cast<uint64_t>(plan.stride_in_file) * static_cast<uint64_t>(abs(header.height))) : 0;
+            if (result && !input.holds(header.offset + pixel_data_size))
+            {
+                // the header of a truncated or corrupt file must not make the buffer be allocated
+                result = operation_result_type::file_read_error;
+            }
+            if (result && options.sequential_access)
+            {
+                advise(input, file_advice::sequential, header.offset, static_cast<size_t>(pixel_data_size));
+                advise(input, file_advice::will_need, header.offset, static_cast<size_t>(pixel_data_size));
+            }
+
+            if (result)
+            {
+                const size_t image_size_in_buffer = plan.stride_in_buffer * plan.height;
+                void* buffer = allocate(image_size_in_buffer);
+                const bool banded = options.thread_count != 1 && plan.run_length_bits == 0 && supports_concurrent_reads(input);
+                scoped_timer timer(get_counter(options.statistics, &operation_statistics::pixel_nanoseconds));
+                count_paths(plan, banded, buffer != nullptr ? options.statistics : nullptr);
+                if (buffer == nullptr)
+                {
+                    result = operation_result_type::buffer_too_small;
+                }
+                else if (banded)
+                {
+                    // each thread reads and converts a band of lines, run length encoded lines can only be decoded in order
+                    uint8_t* p_buffer = reinterpret_cast<uint8_t*>(buffer);
+                    const size_t band_count = determine_band_count(plan.height, options.thread_count);
+                    const size_t lines_per_band = (plan.height + band_count - 1) / band_count;
+                    while (scratch.bands.size() < band_count - 1)
+                    {
+                        std::unique_ptr<decoder_scratch> band_scratch(new decoder_scratch());
+                        scratch.bands.push_back(std::move(band_scratch));
+                    }
+                    result = process_bands(plan.height, options.thread_count, [&input, &plan, &scratch, p_buffer, lines_per_band](size_t first_line, size_t line_count)
+                    {
+                        decoder_scratch& band_scratch = first_line == 0 ? scratch : *scratch.bands[first_line / lines_per_band - 1];
+                        return load_lines(input, plan, first_line, line_count, p_buffer + first_line * plan.stride_in_buffer, band_scratch);
+                    });
+                }
+                else
+                {
+                    result = load_lines(input, plan, 0, plan.height, reinterpret_cast<uint8_t*>(buffer), scratch);
+                }
+            }
+            if (options.drop_cache)
+            {
+                advise(input, file_advice::dont_need, 0, 0);
+            }
+            return result;
+        }
+
+        /// Defines how a line read from a file is converted into a line in the buffer.
+        enum class line_conversion_type
+        {
+            copy, //!< The line is copied as it is.
+            mono8_lut, //!< The indices are mapped to the luminance of the color table entries.
+            color_table, //!< The indices are expanded to the color table entries in the channel order of the buffer.
+            shuffle, //!< The channels of 24 or 32 bit pixels are rearranged, e.g., BGR8 to RGBA8.
+            luminance, //!< The luminance of 24 or 32 bit pixels is computed.
+        };
+
+        /// Holds lookup tables derived from a color table, unused entries are zero.
+        struct color_lut
+        {
+            uint8_t luminance[256]; //!< The luminance of the color table entries.
+            uint32_t bgr[256]; //!< The color table entries as four bytes in the channel order of the buffer, the fourth byte is alpha.
+#if defined(CPPBMPFILE_NEON_SIMD)
+            uint8_t planes[4][256]; //!< The bytes of bgr as one table per channel for the table lookups of NEON.
+#endif
+        };
+
+        /// Computes the luminance using the BT.601 weights in 8 bit fixed point, gray values are kept.
+        static uint8_t luminance(uint8_t blue, uint8_t green, uint8_t red)
+        {
+            return static_cast<uint8_t>((29 * blue + 150 * green + 77 * red + 128) >> 8);
+        }
+
+        static void prepare_color_lut(const color_table_info& color_table, bool swap_red_blue, color_lut& lut)
+        {
+            lut = {};
+            const size_t size = std::min(color_table.entries.size(), static_cast<size_t>(256));
+            for (size_t i = 0; i < size; ++i)
+            {
+                const color_table_entry& entry = color_table.entries[i];
+                const uint8_t channels[4] = { swap_red_blue ? entry.r : entry.b, entry.g, swap_red_blue ? entry.b : entry.r, 255 };
+                lut.luminance[i] = luminance(entry.b, entry.g, entry.r);
+                memcpy(&lut.bgr[i], channels, sizeof(uint32_t));
+#if defined(CPPBMPFILE_NEON_SIMD)
+                for (size_t channel = 0; channel < 4; ++channel)
+                {
+                    lut.planes[channel][i] = channels[channel];
+                }
+#endif
+            }
+        }
+
+        /// Describes the pixel sizes of a conversion and how the channels of 24 or 32 bit pixels are rearranged.
+        struct pixel_shuffle
+        {
+            size_t source_byte_per_pixel = 3; //!< The size of a source pixel.
+            size_t target_byte_per_pixel = 3; //!< The size of a target pixel.
+            bool swap_red_blue = false; //!< Exchanges the first and the third channel.
+            uint8_t mask[16] = {}; //!< The source byte of each target byte of four 24 or 32 bit pixels, 0x80 clears the byte. Bytes beyond the four pixels are kept.
+            uint8_t alpha[16] = {}; //!< Combined with the target bytes of four pixels, sets the alpha channel if the file has none.
+        };
+
+        static void prepare_pixel_shuffle(size_t source_byte_per_pixel, size_t target_byte_per_pixel, bool swap_red_blue, pixel_shuffle& shuffle)
+        {
+            shuffle.source_byte_per_pixel = source_byte_per_pixel;
+            shuffle.target_byte_per_pixel = target_byte_per_pixel;
+            shuffle.swap_red_blue = swap_red_blue;
+            for (size_t i = 0; i < 16; ++i)
+            {
+                // keeping the bytes beyond four 24 bit pixels allows converting in place
+                shuffle.mask[i] = static_cast<uint8_t>(i);
+                shuffle.alpha[i] = 0;
+            }
+            for (size_t pixel = 0; pixel < 4 && source_byte_per_pixel >= 3 && target_byte_per_pixel >= 3; ++pixel)
+            {
+                for (size_t channel = 0; channel < target_byte_per_pixel; ++channel)
+                {
+                    const size_t target = pixel * target_byte_per_pixel + channel;
+                    if (channel == 3 && source_byte_per_pixel == 3)
+                    {
+                        shuffle.mask[target] = 0x80;
+                        shuffle.alpha[target] = 255;
+                    }
+                    else
+                    {
+                        const size_t source_channel = swap_red_blue && channel != 1 && channel != 3 ? 2 - channel : channel;
+                        shuffle.mask[target] = static_cast<uint8_t>(pixel * source_byte_per_pixel + source_channel);
+                    }
+                }
+            }
+        }
+
+        /// Detected instruction set extensions.
+        struct cpu_features
+        {
+            bool ssse3 = false;
+            bool avx2 = false;
+            bool avx512vbmi = false; //!< Includes AVX-512 F and BW.
+        };
+
+        static cpu_features detect_cpu_features()
+        {
+            cpu_features features;
+#if defined(CPPBMPFILE_X86_SIMD) && defined(_MSC_VER)
+            int info[4] = {};
+            __cpuid(info, 0);
+            const int max_leaf = info[0];
+            __cpuid(info, 1);
+            features.ssse3 = (info[2] & (1 << 9)) != 0;
+            const bool os_saves_avx_state = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+            const bool os_saves_avx512_state = os_saves_avx_state && (_xgetbv(0) & 0xE6) == 0xE6;
+            if (os_saves_avx_state && max_leaf >= 7)
+            {
+                __cpuidex(info, 7, 0);
+                features.avx2 = (info[1] & (1 << 5)) != 0;
+                features.avx512vbmi = os_saves_avx512_state && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 && (info[2] & (1 << 1)) != 0;
+            }
+#elif defined(CPPBMPFILE_X86_SIMD)
+            __builtin_cpu_init();
+            features.ssse3 = __builtin_cpu_supports("ssse3") != 0;
+            features.avx2 = __builtin_cpu_supports("avx2") != 0;
+            features.avx512vbmi = __builtin_cpu_supports("avx512f") != 0 && __builtin_cpu_supports("avx512bw") != 0 && __builtin_cpu_supports("avx512vbmi") != 0;
+#endif
+            return features;
+        }
+
+        static const cpu_features& get_cpu_features()
+        {
+            static const cpu_features features = detect_cpu_features();
+            return features;
+        }
+
+        static void expand_color_table_scalar(const color_lut& lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count, size_t byte_per_pixel)
+        {
+            const uint32_t* p_table = lut.bgr;
+            if (pixel_count)
+            {
+                // write four bytes per pixel, for 24 bit pixels the fourth byte is overwritten by the next pixel
+                for (size_t column = 0; column + 1 < pixel_count; ++column, p_target += byte_per_pixel)
+                {
+                    memcpy(p_target, &p_table[p_source[column]], 4);
+                }
+                memcpy(p_target, &p_table[p_source[pixel_count - 1]], byte_per_pixel);
+            }
+        }
+
+#if defined(CPPBMPFILE_X86_SIMD)
+        CPPBMPFILE_TARGET_AVX2 static void expand_color_table_avx2(const color_lut& lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count, size_t byte_per_pixel)
+        {
+            const uint32_t* p_table = lut.bgr;
+            size_t column = 0;
+            if (byte_per_pixel == 4)
+            {
+                for (; column + 8 <= pixel_count; column += 8)
+                {
+                    const __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p_source + column)));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p_target + column * 4), _mm256_i32gather_epi32(reinterpret_cast<const int*>(p_table), indices, 4));
+                }
+            }
+            else
+            {
+                // drops the fourth byte of four pixels per 128 bit lane
+                const __m256i pack = _mm256_setr_epi8(
+                    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+                // the second 16 byte store writes 4 bytes beyond the 8 pixels, keep 2 pixels for the scalar tail
+                for (; column + 10 <= pixel_count; column += 8)
+                {
+                    const __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p_source + column)));
+                    const __m256i pixels = _mm256_shuffle_epi8(_mm256_i32gather_epi32(reinterpret_cast<const int*>(p_table), indices, 4), pack);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(p_target + column * 3), _mm256_castsi256_si128(pixels));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(p_target + column * 3 + 12), _mm256_extracti128_si256(pixels, 1));
+                }
+            }
+            expand_color_table_scalar(lut, p_source + column, p_target + column * byte_per_pixel, pixel_count - column, byte_per_pixel);
+        }
+#endif
+
+#if defined(CPPBMPFILE_NEON_SIMD)
+        /// Holds a lookup table of 256 entries as four parts of 64 entries in registers.
+        struct neon_table
+        {
+            uint8x16x4_t parts[4];
+        };
+
+        static neon_table load_neon_table(const uint8_t* p_table)
+        {
+            neon_table table;
+            for (size_t part = 0; part < 4; ++part, p_table += 64)
+            {
+                table.parts[part].val[0] = vld1q_u8(p_table);
+                table.parts[part].val[1] = vld1q_u8(p_table + 16);
+                table.parts[part].val[2] = vld1q_u8(p_table + 32);
+                table.parts[part].val[3] = vld1q_u8(p_table + 48);
+            }
+            return table;
+        }
+
+        static uint8x16_t lookup_neon(const neon_table& table, uint8x16_t indices)
+        {
+            // four table lookups of 64 entries each, out of range indices leave the value unchanged
+            const uint8x16_t range = vdupq_n_u8(64);
+            uint8x16_t result = vqtbl4q_u8(table.parts[0], indices);
+            for (size_t part = 1; part < 4; ++part)
+            {
+                indices = vsubq_u8(indices, range);
+                result = vqtbx4q_u8(result, table.parts[part], indices);
+            }
+            return result;
+        }
+
+        static void expand_color_table_neon(const color_lut& lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count, size_t byte_per_pixel)
+        {
+            // the planes are prepared once per image, the tables are loaded once per line
+            const neon_table planes[4] = { load_neon_table(lut.planes[0]), load_neon_table(lut.planes[1]), load_neon_table(lut.planes[2]), load_neon_table(lut.planes[3]) };
+            size_t column = 0;
+            for (; column + 16 <= pixel_count; column += 16)
+            {
+                const uint8x16_t indices = vld1q_u8(p_source + column);
+                if (byte_per_pixel == 4)
+                {
+                    uint8x16x4_t pixels;
+                    pixels.val[0] = lookup_neon(planes[0], indices);
+                    pixels.val[1] = lookup_neon(planes[1], indices);
+                    pixels.val[2] = lookup_neon(planes[2], indices);
+                    pixels.val[3] = lookup_neon(planes[3], indices);
+                    vst4q_u8(p_target + column * 4, pixels);
+                }
+                else
+                {
+                    uint8x16x3_t pixels;
+                    pixels.val[0] = lookup_neon(planes[0], indices);
+                    pixels.val[1] = lookup_neon(planes[1], indices);
+                    pixels.val[2] = lookup_neon(planes[2], indices);
+                    vst3q_u8(p_target + column * 3, pixels);
+                }
+            }
+            expand_color_table_scalar(lut, p_source + column, p_target + column * byte_per_pixel, pixel_count - column, byte_per_pixel);
+        }
+#endif
+
+        typedef void (*expand_color_table_function)(const color_lut& lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count, size_t byte_per_pixel);
+
+        static expand_color_table_function select_expand_color_table()
+        {
+#if defined(CPPBMPFILE_X86_SIMD)
+            if (get_cpu_features().avx2)
+            {
+                return &expand_color_table_avx2;
+            }
+#elif defined(CPPBMPFILE_NEON_SIMD)
+            return &expand_color_table_neon;
+#endif
+            return &expand_color_table_scalar;
+        }
+
+        /// Expands 8 bit indices to 24 or 32 bit pixels using the best kernel supported by the CPU.
+        static void expand_color_table(const color_lut& lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count, size_t byte_per_pixel)
+        {
+            static const expand_color_table_function expand = select_expand_color_table();
+            expand(lut, p_source, p_target, pixel_count, byte_per_pixel);
+        }
+
+        static void apply_lut_scalar(const uint8_t* p_lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            for (size_t column = 0; column < pixel_count; ++column)
+            {
+                p_target[column] = p_lut[p_source[column]];
+            }
+        }
+
+#if defined(CPPBMPFILE_X86_SIMD)
+        CPPBMPFILE_TARGET_SSSE3 static void apply_lut_ssse3(const uint8_t* p_lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            // the lookup table is split into 16 tables of 16 entries, the high nibble selects the table
+            __m128i tables[16];
+            for (int table = 0; table < 16; ++table)
+            {
+                tables[table] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_lut + table * 16));
+            }
+            const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+            size_t column = 0;
+            for (; column + 16 <= pixel_count; column += 16)
+            {
+                const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_source + column));
+                const __m128i low_nibbles = _mm_and_si128(values, nibble_mask);
+                const __m128i high_nibbles = _mm_and_si128(_mm_srli_epi16(values, 4), nibble_mask);
+                __m128i result = _mm_setzero_si128();
+                for (int table = 0; table < 16; ++table)
+                {
+                    const __m128i selected = _mm_cmpeq_epi8(high_nibbles, _mm_set1_epi8(static_cast<char>(table)));
+                    result = _mm_or_si128(result, _mm_and_si128(selected, _mm_shuffle_epi8(tables[table], low_nibbles)));
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p_target + column), result);
+            }
+            apply_lut_scalar(p_lut, p_source + column, p_target + column, pixel_count - column);
+        }
+
+        CPPBMPFILE_TARGET_AVX2 static void apply_lut_avx2(const uint8_t* p_lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            // same as apply_lut_ssse3(), the shuffle works per 128 bit lane so each table is held in both lanes
+            __m256i tables[16];
+            for (int table = 0; table < 16; ++table)
+            {
+                tables[table] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p_lut + table * 16)));
+            }
+            const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+            size_t column = 0;
+            for (; column + 32 <= pixel_count; column += 32)
+            {
+                const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_source + column));
+                const __m256i low_nibbles = _mm256_and_si256(values, nibble_mask);
+                const __m256i high_nibbles = _mm256_and_si256(_mm256_srli_epi16(values, 4), nibble_mask);
+                __m256i result = _mm256_setzero_si256();
+                for (int table = 0; table < 16; ++table)
+                {
+                    const __m256i selected = _mm256_cmpeq_epi8(high_nibbles, _mm256_set1_epi8(static_cast<char>(table)));
+                    result = _mm256_or_si256(result, _mm256_and_si256(selected, _mm256_shuffle_epi8(tables[table], low_nibbles)));
+                }
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(p_target + column), result);
+            }
+            apply_lut_scalar(p_lut, p_source + column, p_target + column, pixel_count - column);
+        }
+
+        CPPBMPFILE_TARGET_AVX512VBMI static void apply_lut_avx512vbmi(const uint8_t* p_lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            // two permutes of 128 entries each, the most significant bit of the value selects the result
+            const __m512i table0 = _mm512_loadu_si512(p_lut);
+            const __m512i table1 = _mm512_loadu_si512(p_lut + 64);
+            const __m512i table2 = _mm512_loadu_si512(p_lut + 128);
+            const __m512i table3 = _mm512_loadu_si512(p_lut + 192);
+            size_t column = 0;
+            for (; column + 64 <= pixel_count; column += 64)
+            {
+                const __m512i values = _mm512_loadu_si512(p_source + column);
+                const __m512i lower_half = _mm512_permutex2var_epi8(table0, values, table1);
+                const __m512i upper_half = _mm512_permutex2var_epi8(table2, values, table3);
+                _mm512_storeu_si512(p_target + column, _mm512_mask_blend_epi8(_mm512_movepi8_mask(values), lower_half, upper_half));
+            }
+            apply_lut_scalar(p_lut, p_source + column, p_target + column, pixel_count - column);
+        }
+#endif
+
+#if defined(CPPBMPFILE_NEON_SIMD)
+        static void apply_lut_neon(const uint8_t* p_lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            const neon_table table = load_neon_table(p_lut);
+            size_t column = 0;
+            for (; column + 16 <= pixel_count; column += 16)
+            {
+                vst1q_u8(p_target + column, lookup_neon(table, vld1q_u8(p_source + column)));
+            }
+            apply_lut_scalar(p_lut, p_source + column, p_target + column, pixel_count - column);
+        }
+#endif
+
+        typedef void (*apply_lut_function)(const uint8_t* p_lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count);
+
+        static apply_lut_function select_apply_lut()
+        {
+#if defined(CPPBMPFILE_X86_SIMD)
+            if (get_cpu_features().avx512vbmi)
+            {
+                return &apply_lut_avx512vbmi;
+            }
+            if (get_cpu_features().avx2)
+            {
+                return &apply_lut_avx2;
+            }
+            if (get_cpu_features().ssse3)
+            {
+                return &apply_lut_ssse3;
+            }
+#elif defined(CPPBMPFILE_NEON_SIMD)
+            return &apply_lut_neon;
+#endif
+            return &apply_lut_scalar;
+        }
+
+        /// Maps each byte through a lookup table of 256 entries using the best kernel supported by the CPU, source and target may be equal.
+        static void apply_lut(const uint8_t* p_lut, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            static const apply_lut_function apply = select_apply_lut();
+            apply(p_lut, p_source, p_target, pixel_count);
+        }
+
+        static void shuffle_pixels_scalar(const pixel_shuffle& shuffle, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            const size_t blue = shuffle.swap_red_blue ? 2 : 0;
+            for (size_t column = 0; column < pixel_count; ++column, p_source += shuffle.source_byte_per_pixel, p_target += shuffle.target_byte_per_pixel)
+            {
+                // read the whole pixel first, source and target may be equal
+                const uint8_t b = p_source[0];
+                const uint8_t g = p_source[1];
+                const uint8_t r = p_source[2];
+                const uint8_t a = shuffle.source_byte_per_pixel == 4 ? p_source[3] : 255;
+                p_target[blue] = b;
+                p_target[1] = g;
+                p_target[2 - blue] = r;
+                if (shuffle.target_byte_per_pixel == 4)
+                {
+                    p_target[3] = a;
+                }
+            }
+        }
+
+#if defined(CPPBMPFILE_X86_SIMD)
+        CPPBMPFILE_TARGET_SSSE3 static void shuffle_pixels_ssse3(const pixel_shuffle& shuffle, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shuffle.mask));
+            const __m128i alpha = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shuffle.alpha));
+            size_t column = 0;
+            // four pixels per step, the 16 byte loads and stores of 24 bit pixels reach into the next two pixels
+            for (; column + 6 <= pixel_count; column += 4)
+            {
+                const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_source + column * shuffle.source_byte_per_pixel));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p_target + column * shuffle.target_byte_per_pixel), _mm_or_si128(_mm_shuffle_epi8(pixels, mask), alpha));
+            }
+            shuffle_pixels_scalar(shuffle, p_source + column * shuffle.source_byte_per_pixel, p_target + column * shuffle.target_byte_per_pixel, pixel_count - column);
+        }
+#endif
+
+#if defined(CPPBMPFILE_NEON_SIMD)
+        static void shuffle_pixels_neon(const pixel_shuffle& shuffle, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            size_t column = 0;
+            for (; column + 16 <= pixel_count; column += 16)
+            {
+                // the interleaved loads and stores separate the channels
+                uint8x16x4_t pixels;
+                if (shuffle.source_byte_per_pixel == 4)
+                {
+                    pixels = vld4q_u8(p_source + column * 4);
+                }
+                else
+                {
+                    const uint8x16x3_t bgr = vld3q_u8(p_source + column * 3);
+                    pixels.val[0] = bgr.val[0];
+                    pixels.val[1] = bgr.val[1];
+                    pixels.val[2] = bgr.val[2];
+                    pixels.val[3] = vdupq_n_u8(255);
+                }
+                if (shuffle.swap_red_blue)
+                {
+                    const uint8x16_t blue = pixels.val[0];
+                    pixels.val[0] = pixels.val[2];
+                    pixels.val[2] = blue;
+                }
+                if (shuffle.target_byte_per_pixel == 4)
+                {
+                    vst4q_u8(p_target + column * 4, pixels);
+                }
+                else
+                {
+                    const uint8x16x3_t bgr = { { pixels.val[0], pixels.val[1], pixels.val[2] } };
+                    vst3q_u8(p_target + column * 3, bgr);
+                }
+            }
+            shuffle_pixels_scalar(shuffle, p_source + column * shuffle.source_byte_per_pixel, p_target + column * shuffle.target_byte_per_pixel, pixel_count - column);
+        }
+#endif
+
+        typedef void (*shuffle_pixels_function)(const pixel_shuffle& shuffle, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count);
+
+        static shuffle_pixels_function select_shuffle_pixels()
+        {
+#if defined(CPPBMPFILE_X86_SIMD)
+            if (get_cpu_features().ssse3)
+            {
+                return &shuffle_pixels_ssse3;
+            }
+#elif defined(CPPBMPFILE_NEON_SIMD)
+            return &shuffle_pixels_neon;
+#endif
+            return &shuffle_pixels_scalar;
+        }
+
+        /// Rearranges the channels of 24 or 32 bit pixels using the best kernel supported by the CPU, source and target may be equal if the pixel sizes are equal.
+        static void shuffle_pixels(const pixel_shuffle& shuffle, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            static const shuffle_pixels_function shuffle_function = select_shuffle_pixels();
+            shuffle_function(shuffle, p_source, p_target, pixel_count);
+        }
+
+        /// Computes the luminance of 24 or 32 bit pixels.
+        static void compute_luminance(const pixel_shuffle& shuffle, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            const size_t blue = shuffle.swap_red_blue ? 2 : 0;
+            for (size_t column = 0; column < pixel_count; ++column, p_source += shuffle.source_byte_per_pixel)
+            {
+                p_target[column] = luminance(p_source[blue], p_source[1], p_source[2 - blue]);
+            }
+        }
+
+        /// Defines how packed pixels are unpacked before they are converted.
+        enum class unpack_type
+        {
+            none, //!< The pixels are converted as they are.
+            indices_1, //!< 1 bit indices are unpacked to 8 bit indices.
+            indices_4, //!< 4 bit indices are unpacked to 8 bit indices.
+            bit_fields_16, //!< 16 bit pixels are unpacked to BGRA8 using bit masks.
+            bit_fields_32, //!< 32 bit pixels are unpacked to BGRA8 using bit masks.
+        };
+
+        /// Holds the tables unpacking all pixels of a byte of 1 or 4 bit indices at once.
+        struct index_unpack_tables
+        {
+            uint8_t indices_1[256][8]; //!< The 8 indices of a byte, the most significant bit is the first pixel.
+            uint8_t indices_4[256][2]; //!< The 2 indices of a byte, the high nibble is the first pixel.
+        };
+
+        static index_unpack_tables create_index_unpack_tables()
+        {
+            index_unpack_tables tables;
+            for (size_t value = 0; value < 256; ++value)
+            {
+                for (size_t pixel = 0; pixel < 8; ++pixel)
+                {
+                    tables.indices_1[value][pixel] = static_cast<uint8_t>((value >> (7 - pixel)) & 1);
+                }
+                tables.indices_4[value][0] = static_cast<uint8_t>(value >> 4);
+                tables.indices_4[value][1] = static_cast<uint8_t>(value & 0x0F);
+            }
+            return tables;
+        }
+
+        static const index_unpack_tables& get_index_unpack_tables()
+        {
+            static const index_unpack_tables tables = create_index_unpack_tables();
+            return tables;
+        }
+
+        /// Unpacks 1 or 4 bit indices, writes up to 7 indices beyond pixel_count to complete the last byte.
+        static void unpack_indices(unpack_type unpack, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            const index_unpack_tables& tables = get_index_unpack_tables();
+            if (unpack == unpack_type::indices_1)
+            {
+                for (size_t i = 0; i < (pixel_count + 7) / 8; ++i)
+                {
+                    memcpy(p_target + i * 8, tables.indices_1[p_source[i]], 8);
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i < (pixel_count + 1) / 2; ++i)
+                {
+                    memcpy(p_target + i * 2, tables.indices_4[p_source[i]], 2);
+                }
+            }
+        }
+
+        /// Describes how 16 or 32 bit pixels are unpacked to BGRA8 using bit masks.
+        struct bit_field_unpacking
+        {
+            uint32_t shift[4] = {}; //!< The shift of the blue, green, red and alpha bits, the least significant bits of channels wider than 8 bit are dropped.
+            uint32_t mask[4] = {}; //!< The mask of a channel after shifting, at most 8 bit.
+            uint8_t scale[4][256]; //!< Scales the values of a channel to 8 bit, a missing alpha channel is 255.
+        };
+
+        static void prepare_bit_field_unpacking(const uint32_t* p_bit_masks, bit_field_unpacking& unpacking)
+        {
+            // the bit masks are given as red, green, blue, alpha
+            const size_t mask_index[4] = { 2, 1, 0, 3 };
+            for (size_t channel = 0; channel < 4; ++channel)
+            {
+                uint32_t mask = p_bit_masks[mask_index[channel]];
+                uint32_t shift = 0;
+                uint32_t bits = 0;
+                while (mask != 0 && (mask & 1) == 0)
+                {
+                    mask >>= 1;
+                    ++shift;
+                }
+                while (mask != 0)
+                {
+                    mask >>= 1;
+                    ++bits;
+                }
+                if (bits > 8)
+                {
+                    shift += bits - 8;
+                    bits = 8;
+                }
+                const uint32_t max_value = (1u << bits) - 1;
+                unpacking.shift[channel] = shift;
+                unpacking.mask[channel] = max_value;
+                for (uint32_t value = 0; value < 256; ++value)
+                {
+                    unpacking.scale[channel][value] = max_value == 0 ? (channel == 3 ? 255 : 0)
+                        : static_cast<uint8_t>((std::min(value, max_value) * 255 + max_value / 2) / max_value);
+                }
+            }
+        }
+
+        /// Unpacks 16 or 32 bit pixels to BGRA8.
+        template <typename pixel_type>
+        static void unpack_bit_fields(const bit_field_unpacking& unpacking, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            for (size_t column = 0; column < pixel_count; ++column, p_source += sizeof(pixel_type), p_target += 4)
+            {
+                pixel_type pixel;
+                memcpy(&pixel, p_source, sizeof(pixel));
+                const uint32_t value = pixel;
+                p_target[0] = unpacking.scale[0][(value >> unpacking.shift[0]) & unpacking.mask[0]];
+                p_target[1] = unpacking.scale[1][(value >> unpacking.shift[1]) & unpacking.mask[1]];
+                p_target[2] = unpacking.scale[2][(value >> unpacking.shift[2]) & unpacking.mask[2]];
+                p_target[3] = unpacking.scale[3][(value >> unpacking.shift[3]) & unpacking.mask[3]];
+            }
+        }
+
+        /// Describes the conversion of a line, it is prepared once per image.
+        struct line_conversion
+        {
+            line_conversion_type type = line_conversion_type::copy; //!< The conversion applied to each line.
+            unpack_type unpack = unpack_type::none; //!< Unpacks the pixels before the conversion.
+            color_lut lut; //!< The lookup tables used by the conversion of 8 bit pixels.
+            pixel_shuffle shuffle; //!< The pixel sizes and the rearrangement used by the conversion of 24 and 32 bit pixels.
+            bit_field_unpacking bit_fields; //!< Used to unpack 16 and 32 bit pixels described by bit masks.
+            size_t width = 0; //!< The number of pixels per line.
+            size_t first_column = 0; //!< The column of the first pixel in the source line, used if the pixels of a region do not start at a byte.
+            typedef void (*kernel)(const line_conversion& conversion, const uint8_t* p_source, uint8_t* p_target);
+            kernel p_kernel = nullptr; //!< Converts a line for the type and the unpacking, selected once per image.
+        };
+
+        /// Converts pixels, the type is a constant so that only its branch is compiled.
+        template <line_conversion_type type>
+        static void convert_pixels(const line_conversion& conversion, const uint8_t* p_source, uint8_t* p_target, size_t pixel_count)
+        {
+            if (type == line_conversion_type::copy)
+            {
+                memcpy(p_target, p_source, pixel_count * conversion.shuffle.source_byte_per_pixel);
+            }
+            else if (type == line_conversion_type::mono8_lut)
+            {
+                apply_lut(conversion.lut.luminance, p_source, p_target, pixel_count);
+            }
+            else if (type == line_conversion_type::color_table)
+            {
+                expand_color_table(conversion.lut, p_source, p_target, pixel_count, conversion.shuffle.target_byte_per_pixel);
+            }
+            else if (type == line_conversion_type::shuffle)
+            {
+                shuffle_pixels(conversion.shuffle, p_source, p_target, pixel_count);
+            }
+            else
+            {
+                compute_luminance(conversion.shuffle, p_source, p_target, pixel_count);
+            }
+        }
+
+        /// Converts a line, one instance per conversion and unpacking is selected by prepare_line_conversion().
+        template <line_conversion_type type, unpack_type unpack>
+        static void convert_line_kernel(const line_conversion& conversion, const uint8_t* p_source, uint8_t* p_target)
+        {
+            if (unpack == unpack_type::none)
+            {
+                convert_pixels<type>(conversion, p_source + conversion.first_column * conversion.shuffle.source_byte_per_pixel, p_target, conversion.width);
+            }
+            else
+            {
+                // unpack chunks of pixels into a buffer which stays in the cache and convert them from there
+                const size_t chunk_size = 256;
+                uint8_t unpacked[chunk_size * 4];
+                for (size_t column = 0; column < conversion.width; column += chunk_size)
+                {
+                    const size_t pixel_count = std::min(chunk_size, conversion.width - column);
+                    const size_t source_column = conversion.first_column + column;
+                    // indices are unpacked from the start of a byte, the pixels before source_column are skipped
+                    size_t skipped = 0;
+                    if (unpack == unpack_type::indices_1)
+                    {
+                        skipped = source_column % 8;
+                        unpack_indices(unpack, p_source + source_column / 8, unpacked, skipped + pixel_count);
+                    }
+                    else if (unpack == unpack_type::indices_4)
+                    {
+                        skipped = source_column % 2;
+                        unpack_indices(unpack, p_source + source_column / 2, unpacked, skipped + pixel_count);
+                    }
+                    else if (unpack == unpack_type::bit_fields_16)
+                    {
+                        unpack_bit_fields<uint16_t>(conversion.bit_fields, p_source + source_column * 2, unpacked, pixel_count);
+                    }
+                    else
+                    {
+                        unpack_bit_fields<uint32_t>(conversion.bit_fields, p_source + source_column * 4, unpacked, pixel_count);
+                    }
+                    convert_pixels<type>(conversion, unpacked + skipped, p_target + column * conversion.shuffle.target_byte_per_pixel, pixel_count);
+                }
+            }
+        }
+
+        template <line_conversion_type type>
+        static line_conversion::kernel select_line_kernel(unpack_type unpack)
+        {
+            switch (unpack)
+            {
+            case unpack_type::indices_1:
+                return &convert_line_kernel<type, unpack_type::indices_1>;
+            case unpack_type::indices_4:
+                return &convert_line_kernel<type, unpack_type::indices_4>;
+            case unpack_type::bit_fields_16:
+                return &convert_line_kernel<type, unpack_type::bit_fields_16>;
+            case unpack_type::bit_fields_32:
+                return &convert_line_kernel<type, unpack_type::bit_fields_32>;
+            default:
+                return &convert_line_kernel<type, unpack_type::none>;
+            }
+        }
+
+        static line_conversion::kernel select_line_kernel(line_conversion_type type, unpack_type unpack)
+        {
+            switch (type)
+            {
+            case line_conversion_type::mono8_lut:
+                return select_line_kernel<line_conversion_type::mono8_lut>(unpack);
+            case line_conversion_type::color_table:
+                return select_line_kernel<line_conversion_type::color_table>(unpack);
+            case line_conversion_type::shuffle:
+                return select_line_kernel<line_conversion_type::shuffle>(unpack);
+            case line_conversion_type::luminance:
+                return select_line_kernel<line_conversion_type::luminance>(unpack);
+            default:
+                return select_line_kernel<line_conversion_type::copy>(unpack);
+            }
+        }
+
+        static void convert_line(const line_conversion& conversion, const uint8_t* p_source, uint8_t* p_target)
+        {
+            assert(conversion.p_kernel == select_line_kernel(conversion.type, conversion.unpack));
+            conversion.p_kernel(conversion, p_source, p_target);
+        }
+
+        /**
+            \brief Prepares the conversion of 24 or 32 bit pixels or of Mono8 pixels given by a color table.
+            \param[in] source_byte_per_pixel  The size of a source pixel, 1 for indices into the color table.
+            \param[in] source_is_rgb  The source channels are ordered red, green, blue.
+            \param[in] color_table  The color table of 8 bit sources.
+            \param[in] pixel_format  The pixel format of the target.
+            \param[in] width  The number of pixels per line.
+            \param[out] conversion  Receives the conversion.
+        */
+        static void prepare_line_conversion(size_t source_byte_per_pixel, bool source_is_rgb, const color_table_info& color_table, pixel_format_type pixel_format, size_t width, line_conversion& conversion)
+        {
+            const size_t target_byte_per_pixel = byte_per_pixel(pixel_format);
+            const bool target_is_rgb = pixel_format == pixel_format_type::RGB8 || pixel_format == pixel_format_type::RGBA8;
+            const bool swap_red_blue = source_is_rgb != target_is_rgb;
+            conversion.width = width;
+            prepare_pixel_shuffle(source_byte_per_pixel, target_byte_per_pixel, swap_red_blue, conversion.shuffle);
+            if (source_byte_per_pixel == 1)
+            {
+                prepare_color_lut(color_table, target_is_rgb, conversion.lut);
+                if (pixel_format == pixel_format_type::Mono8)
+                {
+                    // b == g == r in color table
+                    conversion.type = color_table.is_linear_mono8 ? line_conversion_type::copy : line_conversion_type::mono8_lut;
+                }
+                else
+                {
+                    conversion.type = line_conversion_type::color_table;
+                }
+            }
+            else if (pixel_format == pixel_format_type::Mono8)
+            {
+                conversion.type = line_conversion_type::luminance;
+            }
+            else if (source_byte_per_pixel == target_byte_per_pixel && !swap_red_blue)
+            {
+                conversion.type = line_conversion_type::copy;
+            }
+            else
+            {
+                conversion.type = line_conversion_type::shuffle;
+            }
+            // the unpacking is set before
+            conversion.p_kernel = select_line_kernel(conversion.type, conversion.unpack);
+        }
+
+        /// Holds everything needed to convert the lines of a file into the lines of a buffer, it is prepared once per image.
+        struct decoding_plan
+        {
+            line_conversion conversion; //!< The conversion applied to each line.
+            bool in_place = false; //!< The conversion can be applied to a line read into the buffer.
+            size_t offset = 0; //!< The offset of the first byte of the first line to load in the file.
+            size_t stride_in_file = 0; //!< The stride of a line in the file.
+            size_t line_size_in_file = 0; //!< The number of bytes read from a line in the file, the size of a line of decoded indices if run length encoded.
+            size_t stride_in_buffer = 0; //!< The stride of a line in the buffer.
+            bool keep_padding = false; //!< The padding of the lines in the buffer must not be written, e.g., in a view of a larger image.
+            size_t height = 0; //!< The number of lines.
+            size_t first_line_in_file = 0; //!< The first line to load counted in file order, only used if run length encoded.
+            bool flip = false; //!< The orientation in the buffer differs from the orientation in the file.
+            uint16_t run_length_bits = 0; //!< 8 or 4 if the indices are run length encoded, 0 otherwise.
+            size_t compressed_size = 0; //!< The size of the run length encoded pixel data.
+            size_t downscale_factor = 1; //!< Each pixel in the buffer covers a block of factor x factor pixels of the file.
+            downscale_filter_type downscale_filter = downscale_filter_type::decimate; //!< Defines how the pixels of a block are reduced.
+            size_t source_height = 0; //!< The number of lines in the file, or in its region, before downscaling.
+            size_t source_stride = 0; //!< The stride of a line before downscaling, such lines are held without padding.
+            size_t first_source_line = 0; //!< The line in buffer order of the first block, blocks start at the top of the image.
+            size_t sampled_line = 0; //!< The top line of a block, which is taken by decimation.
+        };
+
+        static operation_result prepare_decoding_plan(const bmp_header& header, const color_table_info& color_table, orientation_type orientation_in_file, const image_properties& the_image_properties, const load_options& options, decoding_plan& plan)
+        {
+            operation_result result(operation_result_type::ok);
+            // the region is given from the top of the image, only the bytes of its columns are read from its lines
+            const image_region& region = options.region;
+            const size_t first_column = is_empty(region) ? 0 : region.x;
+            const size_t first_line = is_empty(region) ? 0 : region.y;
+            const size_t width = is_empty(region) ? static_cast<size_t>(header.width) : region.width;
+            const size_t height = is_empty(region) ? static_cast<size_t>(abs(header.height)) : region.height;
+            const size_t bits_per_pixel = header.bits_per_pixel;
+            const size_t first_byte = first_column * bits_per_pixel / 8;
+            plan.first_line_in_file = orientation_in_file == orientation_type::bottom_up ? static_cast<size_t>(abs(header.height)) - first_line - height : first_line;
+            plan.stride_in_file = determine_stride(header.bits_per_pixel, header.width);
+            plan.offset = header.offset + plan.first_line_in_file * plan.stride_in_file + first_byte;
+            plan.line_size_in_file = ((first_column + width) * bits_per_pixel + 7) / 8 - first_byte;
+            plan.stride_in_buffer = determine_stride(the_image_properties);
+            plan.height = the_image_properties.height;
+            plan.flip = the_image_properties.orientation != orientation_in_file;
+
+            // the lines are decoded at full size and reduced afterwards, the lines beyond the last block are at the beginning of a bottom up buffer
+            plan.downscale_factor = options.downscale_factor;
+            plan.downscale_filter = options.downscale_filter;
+            plan.source_height = height;
+            plan.source_stride = plan.downscale_factor > 1 ? width * byte_per_pixel(the_image_properties.pixel_format) : plan.stride_in_buffer;
+            plan.first_source_line = the_image_properties.orientation == orientation_type::bottom_up ? height % plan.downscale_factor : 0;
+            plan.sampled_line = the_image_properties.orientation == orientation_type::bottom_up ? plan.downscale_factor - 1 : 0;
+
+            const uint32_t* p_bit_masks = color_table.bit_masks;
+            // without an alpha mask the fourth byte is undefined, it may only be copied if the buffer has no alpha channel, otherwise alpha is unpacked as 255
+            const bool has_alpha_in_buffer = the_image_properties.pixel_format == pixel_format_type::BGRA8 || the_image_properties.pixel_format == pixel_format_type::RGBA8;
+            const bool is_bgra = header.bits_per_pixel == 32 && p_bit_masks[0] == 0x00FF0000 && p_bit_masks[1] == 0x0000FF00 && p_bit_masks[2] == 0x000000FF
+                && (p_bit_masks[3] == 0xFF000000 || (p_bit_masks[3] == 0 && !has_alpha_in_buffer));
+            if (is_run_length_encoded(header))
+            {
+                // the decoder expands the runs into a line of 8 bit indices
+                plan.run_length_bits = header.bits_per_pixel;
+                plan.compressed_size = header.image_size_bytes;
+                plan.offset = header.offset;
+                plan.line_size_in_file = header.width;
+                plan.conversion.unpack = unpack_type::none;
+                prepare_line_conversion(1, false, color_table, the_image_properties.pixel_format, width, plan.conversion);
+                plan.conversion.first_column = first_column;
+            }
+            else if (header.bits_per_pixel == 1 || header.bits_per_pixel == 4 || header.bits_per_pixel == 8)
+            {
+                plan.conversion.unpack = header.bits_per_pixel == 1 ? unpack_type::indices_1 : header.bits_per_pixel == 4 ? unpack_type::indices_4 : unpack_type::none;
+                prepare_line_conversion(1, false, color_table, the_image_properties.pixel_format, width, plan.conversion);
+                plan.conversion.first_column = first_column * bits_per_pixel % 8 / bits_per_pixel;
+            }
+            else if (header.bits_per_pixel == 24 || (header.bits_per_pixel == 32 && (header.compression == compression_rgb || is_bgra)))
+            {
+                // the fourth byte of 32 bit pixels is kept as it is
+                plan.conversion.unpack = unpack_type::none;
+                prepare_line_conversion(header.bits_per_pixel / 8, false, color_table, the_image_properties.pixel_format, width, plan.conversion);
+            }
+            else if (header.bits_per_pixel == 16 || header.bits_per_pixel == 32)
+            {
+                plan.conversion.unpack = header.bits_per_pixel == 16 ? unpack_type::bit_fields_16 : unpack_type::bit_fields_32;
+                prepare_bit_field_unpacking(p_bit_masks, plan.conversion.bit_fields);
+                prepare_line_conversion(4, false, color_table, the_image_properties.pixel_format, width, plan.conversion);
+            }
+            else
+            {
+                result = operation_result_type::unsupported_bit_per_pixel;
+            }
+            const line_conversion_type type = plan.conversion.type;
+            plan.in_place = plan.conversion.unpack == unpack_type::none && plan.run_length_bits == 0 && (type == line_conversion_type::copy
+                || type == line_conversion_type::mono8_lut
+                || (type == line_conversion_type::shuffle && plan.conversion.shuffle.source_byte_per_pixel == plan.conversion.shuffle.target_byte_per_pixel));
+            return result;
+        }
+
+        /// The layout of the lines in the buffer matches the file, so that they can be read with a single call.
+        static bool is_bulk_read(const decoding_plan& plan)
+        {
+            return plan.in_place && plan.stride_in_buffer == plan.stride_in_file && !plan.keep_padding;
+        }
+
+        /// Counts the paths taken to load an image.
+        static void count_paths(const decoding_plan& plan, bool banded, operation_statistics* p_statistics)
+        {
+            if (!statistics_enabled || p_statistics == nullptr)
+            {
+                return;
+            }
+            count(p_statistics, &operation_statistics::bulk_reads, is_bulk_read(plan) && plan.downscale_factor == 1 ? 1 : 0);
+            count(p_statistics, &operation_statistics::flips, plan.flip ? 1 : 0);
+            count(p_statistics, &operation_statistics::run_length_images, plan.run_length_bits != 0 ? 1 : 0);
+            count(p_statistics, &operation_statistics::downscaled_images, plan.downscale_factor > 1 ? 1 : 0);
+            count(p_statistics, &operation_statistics::banded_images, banded ? 1 : 0);
+            count_conversion(plan.conversion.type, p_statistics);
+        }
+
+        static void count_conversion(line_conversion_type type, operation_statistics* p_statistics)
+        {
+            switch (type)
+            {
+            case line_conversion_type::copy:
+                count(p_statistics, &operation_statistics::copies);
+                break;
+            case line_conversion_type::mono8_lut:
+                count(p_statistics, &operation_statistics::lookups);
+                break;
+            case line_conversion_type::color_table:
+                count(p_statistics, &operation_statistics::expansions);
+                break;
+            case line_conversion_type::shuffle:
+                count(p_statistics, &operation_statistics::shuffles);
+                break;
+            case line_conversion_type::luminance:
+                count(p_statistics, &operation_statistics::luminance_conversions);
+                break;
+            }
+        }
+
+        /**
+            \brief Loads the lines [first_line, first_line + line_count) of the image in the orientation of the buffer.
+            \param[in] input  The input to read from.
+            \param[in] plan  Describes the conversion of the lines.
+            \param[in] first_line  The first line in buffer order.
+            \param[in] line_count  The number of lines to load.
+            \param[out] p_buffer  Receives the lines, the first line is stored at the beginning of the buffer.
+            \param[inout] scratch  Scratch memory reused between calls.
+            \return Returns information about the result of the operation.
+        */
+        template <typename input_type>
+        static operation_result load_lines(input_type& input, const decoding_plan& plan, size_t first_line, size_t line_count, uint8_t* p_buffer, decoder_scratch& scratch)
+        {
+            operation_result result(operation_result_type::ok);
+            if (line_count == 0)
+            {
+                return result;
+            }
+            if (plan.downscale_factor > 1)
+            {
+                return load_downscaled_lines(input, plan, first_line, line_count, p_buffer, scratch);
+            }
+            if (plan.run_length_bits)
+            {
+                return load_run_length_encoded_lines(input, plan, first_line, line_count, p_buffer, scratch);
+            }
+
+            // the requested lines are stored as a contiguous range in the file, reversed if flipped
+            const size_t first_line_in_file = plan.flip ? plan.height - first_line - line_count : first_line;
+            const size_t position_in_file = plan.offset + first_line_in_file * plan.stride_in_file;
+
+            if (is_bulk_read(plan))
+            {
+                // the layout in the buffer matches the file, read all lines with a single call
+                // (the padding of the last line may be missing in the file)
+                if (!input.read_at(position_in_file, p_buffer, plan.stride_in_file * (line_count - 1) + plan.line_size_in_file))
+                {
+                    result = operation_result_type::file_read_error;
+                }
+                else
+                {
+                    if (plan.flip)
+                    {
+                        for (size_t line = 0; line < line_count / 2; ++line)
+                        {
+                            uint8_t* p_line = p_buffer + line * plan.stride_in_buffer;
+                            std::swap_ranges(p_line, p_line + plan.line_size_in_file, p_buffer + (line_count - line - 1) * plan.stride_in_buffer);
+                        }
+                    }
+                    if (plan.conversion.type != line_conversion_type::copy)
+                    {
+                        const line_conversion::kernel p_kernel = plan.conversion.p_kernel;
+                        uint8_t* p_line = p_buffer;
+                        for (size_t line = 0; line < line_count; ++line, p_line += plan.stride_in_buffer)
+                        {
+                            p_kernel(plan.conversion, p_line, p_line);
+                        }
+                    }
+                }
+            }
+            else
+            {
+                // read blocks of lines and convert them line by line, the kernel and the direction are fixed before the loop
+                const size_t block_size = 1024 * 1024;
+                const size_t lines_per_block = plan.stride_in_file < block_size ? block_size / plan.stride_in_file : 1;
+                const line_conversion::kernel p_kernel = plan.conversion.p_kernel;
+                const std::ptrdiff_t target_step = plan.flip ? -static_cast<std::ptrdiff_t>(plan.stride_in_buffer) : static_cast<std::ptrdiff_t>(plan.stride_in_buffer);
+                uint8_t* const p_first_target = p_buffer + (plan.flip ? line_count - 1 : 0) * plan.stride_in_buffer;
+                for (size_t first_block_line = 0; first_block_line < line_count; first_block_line += lines_per_block)
+                {
+                    const size_t block_line_count = std::min(lines_per_block, line_count - first_block_line);
+                    const uint8_t* p_source = input.view_at(position_in_file + first_block_line * plan.stride_in_file, plan.stride_in_file * (block_line_count - 1) + plan.line_size_in_file, scratch.block_buffer);
+                    if (p_source == nullptr)
+                    {
+                        result = operation_result_type::file_read_error;
+                        break;
+                    }
+                    for (size_t line = first_block_line; line < first_block_line + block_line_count; ++line, p_source += plan.stride_in_file)
+                    {
+                        p_kernel(plan.conversion, p_source, p_first_target + static_cast<std::ptrdiff_t>(line) * target_step);
+                    }
+                }
+            }
+            return result;
+        }
+
+        static void store_decoded_line(const decoding_plan& plan, size_t line_in_file, size_t first_line, size_t line_count, std::vector<uint8_t>& indices, uint8_t* p_buffer)
+        {
+            const size_t line_in_region = line_in_file - plan.first_line_in_file;
+            const size_t line = plan.flip ? plan.height - line_in_region - 1 : line_in_region;
+            if (line_in_file >= plan.first_line_in_file && line >= first_line && line < first_line + line_count)
+            {
+                convert_line(plan.conversion, indices.data(), p_buffer + (line - first_line) * plan.stride_in_buffer);
+            }
+            // pixels not set by the next line keep index 0
+            std::fill(indices.begin(), indices.end(), static_cast<uint8_t>(0));
+        }
+
+        /**
+            \brief Decodes BI_RLE8 or BI_RLE4 pixel data, the lines [first_line, first_line + line_count) in buffer order are stored.
+            \param[in] input  The input to read from.
+            \param[in] plan  Describes the conversion of the lines.
+            \param[in] first_line  The first line in buffer order.
+            \param[in] line_count  The number of lines to load.
+            \param[out] p_buffer  Receives the lines, the first line is stored at the beginning of the buffer.
+            \param[inout] scratch  Scratch memory reused between calls.
+            \return Returns information about the result of the operation.
+        */
+        template <typename input_type>
+        static operation_result load_run_length_encoded_lines(input_type& input, const decoding_plan& plan, size_t first_line, size_t line_count, uint8_t* p_buffer, decoder_scratch& scratch)
+        {
+            operation_result result(operation_result_type::ok);
+            const uint8_t* p_data = input.view_at(plan.offset, plan.compressed_size, scratch.block_buffer);
+            if (p_data == nullptr)
+            {
+                return operation_result_type::file_read_error;
+            }
+
+            // the lines can only be decoded in file order, decoding stops after the last requested line
+            const size_t width = plan.line_size_in_file;
+            const size_t end_line_in_file = plan.first_line_in_file + (plan.flip ? plan.height - first_line : first_line + line_count);
+            const size_t size = plan.compressed_size;
+            std::vector<uint8_t>& indices = scratch.index_line;
+            indices.assign(width, 0);
+            size_t position = 0;
+            size_t x = 0;
+            size_t line_in_file = 0;
+            bool end_of_bitmap = false;
+            while (line_in_file < end_line_in_file && !end_of_bitmap)
+            {
+                if (size - position < 2)
+                {
+                    result = operation_result_type::corrupt;
+                    break;
+                }
+                const uint8_t count = p_data[position];
+                const uint8_t value = p_data[position + 1];
+                position += 2;
+                if (count != 0)
+                {
+                    // encoded mode, a run of count pixels, RLE4 alternates between the two indices of value
+                    const size_t run = std::min(static_cast<size_t>(count), width - x);
+                    if (plan.run_length_bits == 8)
+                    {
+                        memset(indices.data() + x, value, run);
+                    }
+                    else
+                    {
+                        const uint8_t pair[2] = { static_cast<uint8_t>(value >> 4), static_cast<uint8_t>(value & 0x0F) };
+                        for (size_t i = 0; i < run; ++i)
+                        {
+                            indices[x + i] = pair[i & 1];
+                        }
+                    }
+                    x += run;
+                }
+                else if (value == 0)
+                {
+                    // end of line
+                    store_decoded_line(plan, line_in_file++, first_line, line_count, indices, p_buffer);
+                    x = 0;
+                }
+                else if (value == 1)
+                {
+                    // end of bitmap, the remaining pixels keep index 0
+                    end_of_bitmap = true;
+                }
+                else if (value == 2)
+                {
+                    // delta, moves the position to the right and up, skipped pixels keep index 0
+                    if (size - position < 2)
+                    {
+                        result = operation_result_type::corrupt;
+                        break;
+                    }
+                    const size_t dx = p_data[position];
+                    size_t dy = p_data[position + 1];
+                    position += 2;
+                    for (; dy != 0 && line_in_file < end_line_in_file; --dy)
+                    {
+                        store_decoded_line(plan, line_in_file++, first_line, line_count, indices, p_buffer);
+                    }
+                    x = std::min(x + dx, width);
+                }
+                else
+                {
+                    // absolute mode, value literal indices padded to 16 bit
+                    const size_t byte_count = plan.run_length_bits == 8 ? value : (value + 1u) / 2;
+                    if (size - position < byte_count)
+                    {
+                        result = operation_result_type::corrupt;
+                        break;
+                    }
+                    const uint8_t* p_literals = p_data + position;
+                    const size_t literal_count = std::min(static_cast<size_t>(value), width - x);
+                    if (plan.run_length_bits == 8)
+                    {
+                        memcpy(indices.data() + x, p_literals, literal_count);
+                    }
+                    else
+                    {
+                        for (size_t i = 0; i < literal_count; ++i)
+                        {
+                            indices[x + i] = static_cast<uint8_t>(i & 1 ? p_literals[i / 2] & 0x0F : p_literals[i / 2] >> 4);
+                        }
+                    }
+                    x += literal_count;
+                    position += std::min(byte_count + (byte_count & 1), size - position);
+                }
+            }
+            if (result && end_of_bitmap)
+            {
+                while (line_in_file < end_line_in_file)
+                {
+                    store_decoded_line(plan, line_in_file++, first_line, line_count, indices, p_buffer);
+                }
+            }
+            return result;
+        }
+
+        /// Takes the first pixel of each block of factor pixels.
+        static void decimate_pixels(const uint8_t* p_source, uint8_t* p_target, size_t pixel_count, size_t factor, size_t byte_per_pixel)
+        {
+            for (size_t pixel = 0; pixel < pixel_count; ++pixel, p_source += factor * byte_per_pixel, p_target += byte_per_pixel)
+            {
+                memcpy(p_target, p_source, byte_per_pixel);
+            }
+        }
+
+        /// Averages blocks of factor x factor pixels, sums holds the channel sums of a line.
+        static void average_blocks(const uint8_t* p_source, size_t source_stride, uint8_t* p_target, size_t pixel_count, size_t factor, size_t byte_per_pixel, std::vector<uint32_t>& sums)
+        {
+            const size_t channel_count = pixel_count * byte_per_pixel;
+            sums.assign(channel_count, 0);
+            for (size_t line = 0; line < factor; ++line, p_source += source_stride)
+            {
+                const uint8_t* p_pixel = p_source;
+                uint32_t* p_sums = sums.data();
+                for (size_t pixel = 0; pixel < pixel_count; ++pixel, p_sums += byte_per_pixel)
+                {
+                    for (size_t i = 0; i < factor; ++i, p_pixel += byte_per_pixel)
+                    {
+                        for (size_t channel = 0; channel < byte_per_pixel; ++channel)
+                        {
+                            p_sums[channel] += p_pixel[channel];
+                        }
+                    }
+                }
+            }
+            const uint32_t count = static_cast<uint32_t>(factor * factor);
+            for (size_t i = 0; i < channel_count; ++i)
+            {
+                p_target[i] = static_cast<uint8_t>((sums[i] + count / 2) / count);
+            }
+        }
+
+        /**
+            \brief Loads the lines [first_line, first_line + line_count) of a downscaled image in the orientation of the buffer.
+            \param[in] input  The input to read from.
+            \param[in] plan  Describes the conversion and the downscaling of the lines.
+            \param[in] first_line  The first line in buffer order.
+            \param[in] line_count  The number of lines to load.
+            \param[out] p_buffer  Receives the lines, the first line is stored at the beginning of the buffer.
+            \param[inout] scratch  Scratch memory reused between calls.
+            \return Returns information about the result of the operation.
+        */
+        template <typename input_type>
+        static operation_result load_downscaled_lines(input_type& input, const decoding_plan& plan, size_t first_line, size_t line_count, uint8_t* p_buffer, decoder_scratch& scratch)
+        {
+            operation_result result(operation_result_type::ok);
+            // the lines of a block are loaded at full size without padding
+            decoding_plan source_plan = plan;
+            source_plan.downscale_factor = 1;
+            source_plan.height = plan.source_height;
+            source_plan.stride_in_buffer = plan.source_stride;
+            source_plan.keep_padding = false;
+
+            const size_t factor = plan.downscale_factor;
+            const size_t byte_per_pixel = plan.conversion.shuffle.target_byte_per_pixel;
+            const size_t pixel_count = plan.conversion.width / factor;
+            const bool decimate = plan.downscale_filter == downscale_filter_type::decimate;
+            std::vector<uint8_t>& source_lines = scratch.source_lines;
+            if (plan.run_length_bits)
+            {
+                // run length encoded lines can only be decoded in sequence, all lines of the blocks are decoded at once
+                source_lines.resize(line_count * factor * plan.source_stride);
+                result = load_lines(input, source_plan, plan.first_source_line + first_line * factor, line_count * factor, source_lines.data(), scratch);
+            }
+            else
+            {
+                // decimation reads a single line per block
+                source_lines.resize((decimate ? 1 : factor) * plan.source_stride);
+            }
+            for (size_t line = 0; result && line < line_count; ++line)
+            {
+                const size_t first_block_line = plan.first_source_line + (first_line + line) * factor;
+                uint8_t* p_target = p_buffer + line * plan.stride_in_buffer;
+                const uint8_t* p_source = source_lines.data();
+                if (decimate)
+                {
+                    if (plan.run_length_bits)
+                    {
+                        p_source += (line * factor + plan.sampled_line) * plan.source_stride;
+                    }
+                    else
+                    {
+                        result = load_lines(input, source_plan, first_block_line + plan.sampled_line, 1, source_lines.data(), scratch);
+                    }
+                    if (result)
+                    {
+                        decimate_pixels(p_source, p_target, pixel_count, factor, byte_per_pixel);
+                    }
+                }
+                else
+                {
+                    if (plan.run_length_bits)
+                    {
+                        p_source += line * factor * plan.source_stride;
+                    }
+                    else
+                    {
+                        result = load_lines(input, source_plan, first_block_line, factor, source_lines.data(), scratch);
+                    }
+                    if (result)
+                    {
+                        average_blocks(p_source, plan.source_stride, p_target, pixel_count, factor, byte_per_pixel, scratch.sums);
+                    }
+                }
+            }
+            return result;
+        }
+
+        /// Holds everything needed to convert the lines of a buffer into the lines of a file, it is prepared once per image.
+        struct encoding_plan
+        {
+            line_conversion conversion; //!< The conversion applied to each line.
+            size_t offset = 0; //!< The offset of the pixel data in the file.
+            size_t stride_in_file = 0; //!< The stride of a line in the file.
+            size_t line_size = 0; //!< The size of a line without padding.
+            size_t stride_in_buffer = 0; //!< The stride of a line in the buffer.
+            size_t height = 0; //!< The number of lines.
+            bool flip = false; //!< The orientation in the buffer differs from the orientation in the file.
+            bool run_length_encoding = false; //!< The lines are stored as BI_RLE8.
+        };
+
+        static void prepare_encoding_plan(const bmp_header& header, const image_properties& the_image_properties, encoding_plan& plan)
+        {
+            const orientation_type orientation_in_file = header.height < 0 ? orientation_type::top_down : orientation_type::bottom_up;
+            plan.offset = header.offset;
+            plan.stride_in_file = determine_stride(header.bits_per_pixel, header.width);
+            plan.line_size = plan.stride_in_file - determine_line_padding(header.bits_per_pixel, header.width);
+            plan.stride_in_buffer = determine_stride(the_image_properties);
+            plan.height = the_image_properties.height;
+            plan.flip = the_image_properties.orientation != orientation_in_file;
+            plan.run_length_encoding = header.compression == compression_rle8;
+
+            const pixel_format_type pixel_format = the_image_properties.pixel_format;
+            const pixel_format_type pixel_format_in_file = header.bits_per_pixel == 8 ? pixel_format_type::Mono8
+                : header.bits_per_pixel == 24 ? pixel_format_type::BGR8 : pixel_format_type::BGRA8;
+            color_table_info gray_color_table;
+            if (pixel_format == pixel_format_type::Mono8)
+            {
+                // Mono8 pixels are expanded to BGR8 or BGRA8 as indices into a gray color table
+                gray_color_table.entries.resize(256);
+                for (size_t i = 0; i < 256; ++i)
+                {
+                    gray_color_table.entries[i].b = gray_color_table.entries[i].g = gray_color_table.entries[i].r = static_cast<uint8_t>(i);
+                }
+                gray_color_table.is_mono8 = true;
+                gray_color_table.is_linear_mono8 = true;
+            }
+            prepare_line_conversion(byte_per_pixel(pixel_format), pixel_format == pixel_format_type::RGB8 || pixel_format == pixel_format_type::RGBA8,
+                gray_color_table, pixel_format_in_file, the_image_properties.width, plan.conversion);
+        }
+
+        /// Holds the color table of Mono8 files.
+        struct gray_palette
+        {
+            color_table_entry entries[256]; //!< The gray values, the reserved bytes are 255.
+        };
+
+        static gray_palette create_gray_palette()
+        {
+            gray_palette palette;
+            for (size_t i = 0; i < 256; ++i)
+            {
+                palette.entries[i].b = palette.entries[i].g = palette.entries[i].r = static_cast<uint8_t>(i);
+                palette.entries[i].reserved = 255;
+            }
+            return palette;
+        }
+
+        static const gray_palette& get_gray_palette()
+        {
+            static const gray_palette palette = create_gray_palette();
+            return palette;
+        }
+
+        template <typename output_type>
+        static operation_result write_header(output_type& output, const bmp_header& header, const image_properties& the_image_properties)
+        {
+            operation_result result(operation_result_type::ok);
+            // write header
+            if (!output.write(&header, sizeof(header)))
+            {
+                result = operation_result_type::file_write_error;
+            }
+            // write color table if needed
+            if (result && the_image_properties.pixel_format == pixel_format_type::Mono8 && !output.write(get_gray_palette().entries, sizeof(gray_palette::entries)))
+            {
+                result = operation_result_type::file_write_error;
+            }
+            return result;
+        }
+
+        /**
+            \brief Encodes a line of indices as BI_RLE8 including the end of line.
+            \param[in] p_source  The indices.
+            \param[in] count  The number of indices.
+            \param[out] p_target  Receives the encoded line, it needs to hold 2 * count + 2 bytes.
+            \return Returns the size of the encoded line.
+        */
+        static size_t encode_run_length(const uint8_t* p_source, size_t count, uint8_t* p_target)
+        {
+            // runs of at least two pixels are encoded, the pixels between them are stored in absolute mode,
+            // which needs at least three pixels, so shorter gaps are stored as runs of one pixel
+            uint8_t* p = p_target;
+            size_t x = 0;
+            while (x < count)
+            {
+                const size_t max_count = std::min(count - x, static_cast<size_t>(255));
+                size_t run = 1;
+                while (run < max_count && p_source[x + run] == p_source[x])
+                {
+                    ++run;
+                }
+                if (run >= 2)
+                {
+                    *p++ = static_cast<uint8_t>(run);
+                    *p++ = p_source[x];
+                    x += run;
+                    continue;
+                }
+
+                size_t literal_count = 1;
+                while (literal_count < max_count && !(x + literal_count + 1 < count && p_source[x + literal_count] == p_source[x + literal_count + 1]))
+                {
+                    ++literal_count;
+                }
+                if (literal_count < 3)
+                {
+                    for (size_t i = 0; i < literal_count; ++i)
+                    {
+                        *p++ = 1;
+                        *p++ = p_source[x + i];
+                    }
+                }
+                else
+                {
+                    *p++ = 0;
+                    *p++ = static_cast<uint8_t>(literal_count);
+                    memcpy(p, p_source + x, literal_count);
+                    p += literal_count;
+                    if (literal_count & 1)
+                    {
+                        *p++ = 0; // padded to 16 bit
+                    }
+                }
+                x += literal_count;
+            }
+            // end of line
+            *p++ = 0;
+            *p++ = 0;
+            return static_cast<size_t>(p - p_target);
+        }
+
+        /**
+            \brief Writes consecutive lines of the buffer in file order.
+            \param[in] output  The output to write to.
+            \param[in] plan  Describes the conversion of the lines.
+            \param[in] p_lines  Points to the first line to write in the buffer.
+            \param[in] line_count  The number of lines to write, they are stored as a contiguous range in the file.
+            \param[inout] line_buffer  Scratch memory holding a converted line.
+            \return Returns information about the result of the operation.
+        */
+        template <typename output_type>
+        static operation_result write_lines(output_type& output, const encoding_plan& plan, const uint8_t* p_lines, size_t line_count, std::vector<uint8_t>& line_buffer)
+        {
+            operation_result result(operation_result_type::ok);
+            const size_t line_padding_in_file = plan.stride_in_file - plan.line_size;
+            assert(line_padding_in_file < 4);
+            if (!plan.run_length_encoding && !plan.flip && line_padding_in_file == 0 && plan.stride_in_buffer == plan.stride_in_file && plan.conversion.type == line_conversion_type::copy)
+            {
+                // the lines are stored like in the file, write them with a single call
+                if (!output.write(p_lines, line_count * plan.stride_in_file))
+                {
+                    result = operation_result_type::file_write_error;
+                }
+                return result;
+            }
+
+            // the kernel and the direction are fixed before the loops, the padding of the line buffer stays zero and the encoded line follows it
+            line_buffer.assign(plan.stride_in_file + (plan.run_length_encoding ? 2 * plan.line_size + 2 : 0), 0);
+            uint8_t* p_line = line_buffer.data();
+            const line_conversion::kernel p_kernel = plan.conversion.p_kernel;
+            const std::ptrdiff_t source_step = plan.flip ? -static_cast<std::ptrdiff_t>(plan.stride_in_buffer) : static_cast<std::ptrdiff_t>(plan.stride_in_buffer);
+            const uint8_t* const p_first_source = p_lines + (plan.flip && line_count > 0 ? line_count - 1 : 0) * plan.stride_in_buffer;
+            if (plan.run_length_encoding)
+            {
+                const bool convert = plan.conversion.type != line_conversion_type::copy;
+                uint8_t* p_encoded = p_line + plan.stride_in_file;
+                for (size_t line = 0; line < line_count; ++line)
+                {
+                    const uint8_t* p_source = p_first_source + static_cast<std::ptrdiff_t>(line) * source_step;
+                    if (convert)
+                    {
+                        p_kernel(plan.conversion, p_source, p_line);
+                        p_source = p_line;
+                    }
+                    if (!output.write(p_encoded, encode_run_length(p_source, plan.line_size, p_encoded)))
+                    {
+                        result = operation_result_type::file_write_error;
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                // copied lines are converted by the copy kernel as well, so that each line including its padding is written with a single call
+                for (size_t line = 0; line < line_count; ++line)
+                {
+                    p_kernel(plan.conversion, p_first_source + static_cast<std::ptrdiff_t>(line) * source_step, p_line);
+                    if (!output.write(p_line, plan.stride_in_file))
+                    {
+                        result = operation_result_type::file_write_error;
+                        break;
+                    }
+                }
+            }
+            return result;
+        }
+
+        template <typename output_type>
+        static operation_result write_bands(output_type& output, const encoding_plan& plan, const uint8_t* p_lines, const save_options& /* options */)
+        {
+            std::vector<uint8_t> line_buffer;
+            return write_lines(output, plan, p_lines, plan.height, line_buffer);
+        }
+
+        /// Encodes bands of lines in memory by several threads, the bands are stored at fixed positions unless run length encoded.
+        static operation_result write_bands(memory_output& output, const encoding_plan& plan, const uint8_t* p_lines, const save_options& options)
+        {
+            std::vector<uint8_t> line_buffer;
+            if (options.thread_count == 1 || plan.run_length_encoding)
+            {
+                return write_lines(output, plan, p_lines, plan.height, line_buffer);
+            }
+            count(options.statistics, &operation_statistics::banded_images);
+            uint8_t* p_data = output.append(plan.stride_in_file * plan.height);
+            if (p_data == nullptr)
+            {
+                return operation_result_type::file_write_error;
+            }
+            return process_bands(plan.height, options.thread_count, [&plan, p_lines, p_data](size_t first_line, size_t line_count)
+            {
+                // the bands are counted in file order, a flipped band comes from the opposite end of the buffer
+                const size_t first_line_in_buffer = plan.flip ? plan.height - first_line - line_count : first_line;
+                memory_output band_output(p_data + first_line * plan.stride_in_file, line_count * plan.stride_in_file);
+                std::vector<uint8_t> band_line_buffer;
+                return write_lines(band_output, plan, p_lines + first_line_in_buffer * plan.stride_in_buffer, line_count, band_line_buffer);
+            });
+        }
+
+        /// Encodes bands of lines by several threads, each band is encoded in pieces of about the chunk size and written at its position in the file.
+        static operation_result write_bands(file_output& output, const encoding_plan& plan, const uint8_t* p_lines, const save_options& options)
+        {
+            std::vector<uint8_t> line_buffer;
+            if (options.thread_count == 1 || plan.run_length_encoding)
+            {
+                return write_lines(output, plan, p_lines, plan.height, line_buffer);
+            }
+            count(options.statistics, &operation_statistics::banded_images);
+            const size_t first_position = output.position();
+            const size_t lines_per_piece = options.chunk_size != 0 ? std::max(options.chunk_size / plan.stride_in_file, static_cast<size_t>(1)) : plan.height;
+            return process_bands(plan.height, options.thread_count, [&output, &plan, p_lines, first_position, lines_per_piece](size_t first_line, size_t line_count)
+            {
+                const size_t piece_line_count = std::min(lines_per_piece, line_count);
+                std::vector<uint8_t> piece(piece_line_count * plan.stride_in_file);
+                std::vector<uint8_t> band_line_buffer;
+                operation_result result(operation_result_type::ok);
+                for (size_t line = first_line; result && line < first_line + line_count; line += piece_line_count)
+                {
+                    // the pieces are counted in file order, a flipped piece comes from the opposite end of the buffer
+                    const size_t count_in_piece = std::min(piece_line_count, first_line + line_count - line);
+                    const size_t first_line_in_buffer = plan.flip ? plan.height - line - count_in_piece : line;
+                    memory_output piece_output(piece.data(), piece.size());
+                    result = write_lines(piece_output, plan, p_lines + first_line_in_buffer * plan.stride_in_buffer, count_in_piece, band_line_buffer);
+                    if (result && !output.write_at(first_position + line * plan.stride_in_file, piece.data(), piece_output.position()))
+                    {
+                        result = operation_result_type::file_write_error;
+                    }
+                }
+                return result;
+            });
+        }
+
+        template <typename output_type>
+        static operation_result save_image(output_type& output, const void* buffer, const image_properties& the_image_properties, bool force_bottom_up, const save_options& options)
+        {
+            bmp_header header = {};
+            encoding_plan plan;
+            const image_properties file_properties = determine_file_properties(the_image_properties, options);
+            create_header(file_properties, force_bottom_up, options.run_length_encoding, header);
+            prepare_encoding_plan(header, the_image_properties, plan);
+
+            operation_result result;
+            {
+                scoped_timer timer(get_counter(options.statistics, &operation_statistics::header_nanoseconds));
+                result = write_header(output, header, file_properties);
+            }
+            scoped_timer timer(get_counter(options.statistics, &operation_statistics::pixel_nanoseconds));
+            if (result)
+            {
+                count(options.statistics, &operation_statistics::flips, plan.flip ? 1 : 0);
+                count(options.statistics, &operation_statistics::run_length_images, plan.run_length_encoding ? 1 : 0);
+                count_conversion(plan.conversion.type, options.statistics);
+                result = write_bands(output, plan, reinterpret_cast<const uint8_t*>(buffer), options);
+            }
+            if (result && plan.run_length_encoding)
+            {
+                // terminate the pixel data and store the actual sizes
+                const uint8_t end_of_bitmap[2] = { 0, 1 };
+                if (!output.write(end_of_bitmap, sizeof(end_of_bitmap)))
+                {
+                    result = operation_result_type::file_write_error;
+                }
+                else
+                {
+                    header.size = static_cast<uint32_t>(output.position());
+                    header.image_size_bytes = static_cast<uint32_t>(output.position() - header.offset);
+                    if (!output.write_at(0, &header, sizeof(header)))
+                    {
+                        result = operation_result_type::file_write_error;
+                    }
+                }
+            }
+            return result;
+        }
+    };
+
+    /**
+        \brief Loads images like bmp_file::load() keeping its scratch memory between calls.
+        Once the scratch memory has grown to the largest image, loading into a given buffer or into a reused
+        vector does not allocate memory. A decoder must not be used by several threads at the same time.
+    */
+    class bmp_decoder
+    {
+    public:
+        /// Creates a decoder without scratch memory.
+        bmp_decoder() = default;
+
+        bmp_decoder(const bmp_decoder&) = delete;
+        bmp_decoder& operator=(const bmp_decoder&) = delete;
+
+        /// Same as the corresponding bmp_file::load().
+        template <typename char_type>
+        operation_result load(const char_type* filename, void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            return bmp_file::load_reusing(filename, buffer, buffer_size, the_image_properties, force_line_padding, force_orientation, options, m_scratch);
+        }
+
+        /// Same as the corresponding bmp_file::load().
+        template <typename char_type>
+        operation_result load(const char_type* filename, std::vector<uint8_t>& buffer, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            return bmp_file::load_reusing(filename, buffer, the_image_properties, force_line_padding, force_orientation, options, m_scratch);
+        }
+
+        /// Same as the corresponding bmp_file::load(), allocate may return memory of a pool or an arena.
+        template <typename char_type>
+        operation_result load(const char_type* filename, const std::function<void*(size_t)>& allocate, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            return bmp_file::load_reusing(filename, allocate, the_image_properties, force_line_padding, force_orientation, options, m_scratch);
+        }
+
+        /// Same as the corresponding bmp_file::load().
+        operation_result load(const void* data, size_t data_size, void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            return bmp_file::load_reusing(data, data_size, buffer, buffer_size, the_image_properties, force_line_padding, force_orientation, options, m_scratch);
+        }
+
+        /// Same as the corresponding bmp_file::load().
+        operation_result load(const void* data, size_t data_size, std::vector<uint8_t>& buffer, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            return bmp_file::load_reusing(data, data_size, buffer, the_image_properties, force_line_padding, force_orientation, options, m_scratch);
+        }
+
+        /// Same as the corresponding bmp_file::load(), allocate may return memory of a pool or an arena.
+        operation_result load(const void* data, size_t data_size, const std::function<void*(size_t)>& allocate, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            return bmp_file::load_reusing(data, data_size, allocate, the_image_properties, force_line_padding, force_orientation, options, m_scratch);
+        }
+
+        /// Same as the corresponding bmp_file::load() into a view.
+        template <typename char_type>
+        operation_result load(const char_type* filename, const image_view& view, image_properties& the_image_properties, const load_options& options = load_options())
+        {
+            return bmp_file::load_reusing(filename, view, the_image_properties, options, m_scratch);
+        }
+
+        /// Same as the corresponding bmp_file::load() into a view.
+        operation_result load(const void* data, size_t data_size, const image_view& view, image_properties& the_image_properties, const load_options& options = load_options())
+        {
+            return bmp_file::load_reusing(data, data_size, view, the_image_properties, options, m_scratch);
+        }
+
+        /// Releases the scratch memory.
+        void release_memory()
+        {
+            m_scratch = bmp_file::decoder_scratch();
+        }
+
+    private:
+        bmp_file::decoder_scratch m_scratch;
+    };
+
+    /// Provides read access to a BMP file mapped into memory, so that the pixels can be accessed without copying them.
+    class bmp_mapped_file
+    {
+    public:
+        /// Creates a closed mapped file.
+        bmp_mapped_file() = default;
+
+        bmp_mapped_file(const bmp_mapped_file&) = delete;
+        bmp_mapped_file& operator=(const bmp_mapped_file&) = delete;
+
+        /// Unmaps the file.
+        ~bmp_mapped_file()
+        {
+            close();
+        }
+
+        /**
+            \brief Maps the file into memory and loads the image properties.
+            \param[in] filename  The name of the file.
+            \return Returns information about the result of the operation.
+        */
+        template <typename char_type>
+        operation_result open(const char_type* filename)
+        {
+            operation_result result;
+            close();
+            if (filename == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else
+            {
+                result = map(filename);
+            }
+
+            if (result)
+            {
+                bmp_file::memory_input input(m_data, m_size);
+                result = bmp_file::load_image_properties(input, m_header, m_color_table, m_image_properties);
+                if (!result)
+                {
+                    close();
+                }
+            }
+            return result;
+        }
+
+        /// Returns true if a file is mapped.
+        bool is_open() const
+        {
+            return m_data != nullptr;
+        }
+
+        /// Returns the properties of the image stored in the mapped file.
+        const image_properties& properties() const
+        {
+            return m_image_properties;
+        }
+
+        /**
+            \brief Returns the pixel data inside the mapping.
+            \return Returns the pixel data laid out as described by properties() or nullptr if the pixels
+            of the file need to be converted, e.g., for color tables. Use load() in this case.
+        */
+        const void* pixels() const
+        {
+            const void* p_pixels = nullptr;
+            if (is_open() && m_header.compression == bmp_file::compression_rgb)
+            {
+                bool raw = m_header.bits_per_pixel == 24 || m_header.bits_per_pixel == 32
+                    || (m_header.bits_per_pixel == 8 && m_image_properties.pixel_format == pixel_format_type::Mono8 && m_color_table.is_linear_mono8);
+                const size_t image_size = bmp_file::determine_stride(m_image_properties) * m_image_properties.height;
+                if (raw && m_header.offset <= m_size && image_size <= m_size - m_header.offset)
+                {
+                    p_pixels = m_data + m_header.offset;
+                }
+            }
+            return p_pixels;
+        }
+
+        /**
+            \brief Copies the image from the mapping into a buffer.
+            \param[out] buffer  The buffer to store the image data in.
+            \param[in] buffer_size  The size of buffer.
+            \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation.
+        */
+        operation_result load(void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options()) const
+        {
+            operation_result result;
+            if (!is_open())
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                result = bmp_file::load(m_data, m_size, buffer, buffer_size, the_image_properties, force_line_padding, force_orientation, options);
+            }
+            return result;
+        }
+
+        /// Unmaps the file.
+        void close()
+        {
+            if (m_data != nullptr)
+            {
+#if defined(_WIN32)
+                UnmapViewOfFile(m_data);
+                CloseHandle(m_mapping);
+                m_mapping = nullptr;
+#else
+                munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+            }
+            m_data = nullptr;
+            m_size = 0;
+            m_header = {};
+            m_color_table = bmp_file::color_table_info();
+            m_image_properties = image_properties();
+        }
+
+    private:
+#if defined(_WIN32)
+        operation_result map(const char* filename)
+        {
+            return map(CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+        }
+
+        operation_result map(const wchar_t* filename)
+        {
+            return map(CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+        }
+
+        operation_result map(HANDLE file)
+        {
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                return operation_result_type::file_not_found;
+            }
+            operation_result result(operation_result_type::file_read_error);
+            LARGE_INTEGER file_size = {};
+            if (!GetFileSizeEx(file, &file_size))
+            {
+                // keep the read error
+            }
+            else if (file_size.QuadPart < static_cast<LONGLONG>(sizeof(bmp_file::bmp_header)))
+            {
+                result = operation_result_type::not_a_bmp_file;
+            }
+            else
+            {
+                m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (m_mapping != nullptr)
+                {
+                    m_data = reinterpret_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+                    if (m_data == nullptr)
+                    {
+                        CloseHandle(m_mapping);
+                        m_mapping = nullptr;
+                    }
+                    else
+                    {
+                        m_size = static_cast<size_t>(file_size.QuadPart);
+                        result = operation_result_type::ok;
+                    }
+                }
+            }
+            CloseHandle(file); // the mapping keeps the file open
+            return result;
+        }
+
+        HANDLE m_mapping = nullptr;
+#else
+        operation_result map(const char* filename)
+        {
+            int file = ::open(filename, O_RDONLY | O_CLOEXEC);
+            if (file < 0)
+            {
+                return operation_result_type::file_not_found;
+            }
+            operation_result result(operation_result_type::file_read_error);
+            struct stat file_status = {};
+            if (fstat(file, &file_status) != 0)
+            {
+                // keep the read error
+            }
+            else if (file_status.st_size < static_cast<off_t>(sizeof(bmp_file::bmp_header)))
+            {
+                result = operation_result_type::not_a_bmp_file;
+            }
+            else
+            {
+                void* p_mapping = mmap(nullptr, static_cast<size_t>(file_status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+                if (p_mapping != MAP_FAILED)
+                {
+                    m_data = reinterpret_cast<const uint8_t*>(p_mapping);
+                    m_size = static_cast<size_t>(file_status.st_size);
+                    result = operation_result_type::ok;
+                }
+            }
+            ::close(file); // the mapping keeps the file open
+            return result;
+        }
+#endif
+
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+        bmp_file::bmp_header m_header = {};
+        bmp_file::color_table_info m_color_table;
+        image_properties m_image_properties;
+    };
+
+    /**
+        \brief Reads the header of a BMP file with a single read of a fixed size prefix, e.g., to index large catalogs.
+        The color table is only classified when properties() is called. A probe can be reused for many files without allocating memory.
+    */
+    class bmp_probe
+    {
+    public:
+        static const size_t prefix_size = 4096; //!< The number of bytes read from the start of the file.
+
+        /// Creates a probe without a file.
+        bmp_probe() = default;
+
+        bmp_probe(const bmp_probe&) = delete;
+        bmp_probe& operator=(const bmp_probe&) = delete;
+
+        /// Closes a file kept open.
+        ~bmp_probe()
+        {
+            clear();
+        }
+
+        /**
+            \brief Reads the prefix of the file and checks the header.
+            \param[in] filename  The name of the file.
+            \return Returns information about the result of the operation.
+        */
+        template <typename char_type>
+        operation_result open(const char_type* filename)
+        {
+            return open_file_prefix(filename, false);
+        }
+
+        /**
+            \brief Reads the prefix of the file like open() and keeps the file open until the probe is cleared, so that load() reads the pixels without opening the file again.
+            \param[in] filename  The name of the file.
+            \return Returns information about the result of the operation.
+        */
+        template <typename char_type>
+        operation_result open_for_load(const char_type* filename)
+        {
+            return open_file_prefix(filename, true);
+        }
+
+#if defined(CPPBMPFILE_HAS_FILESYSTEM)
+        /// Same as open() with the native name of the path, which is not converted.
+        operation_result open(const std::filesystem::path& filename)
+        {
+            return open(filename.c_str());
+        }
+
+        /// Same as open_for_load() with the native name of the path, which is not converted.
+        operation_result open_for_load(const std::filesystem::path& filename)
+        {
+            return open_for_load(filename.c_str());
+        }
+#endif
+
+        /**
+            \brief Copies the prefix of a BMP file held in memory and checks the header.
+            \param[in] data  The content of the BMP file, it must stay valid until the probe is cleared if load() is called.
+            \param[in] data_size  The size of data in bytes.
+            \return Returns information about the result of the operation.
+        */
+        operation_result open(const void* data, size_t data_size)
+        {
+            operation_result result;
+            clear();
+            if (data == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else
+            {
+                m_prefix_size = std::min(data_size, static_cast<size_t>(prefix_size));
+                memcpy(m_prefix, data, m_prefix_size);
+                result = check_header();
+            }
+            if (result)
+            {
+                m_data = reinterpret_cast<const uint8_t*>(data);
+                m_data_size = data_size;
+            }
+            return result;
+        }
+
+        /// Returns true if the header of a file has been read and checked.
+        bool is_open() const
+        {
+            return m_header.type != 0;
+        }
+
+        /// Returns the width in pixels.
+        uint32_t width() const
+        {
+            return static_cast<uint32_t>(m_header.width);
+        }
+
+        /// Returns the height in pixels.
+        uint32_t height() const
+        {
+            return static_cast<uint32_t>(abs(m_header.height));
+        }
+
+        /// Returns the bits per pixel stored in the file.
+        uint16_t bits_per_pixel() const
+        {
+            return m_header.bits_per_pixel;
+        }
+
+        /// Returns the orientation of the lines in the file.
+        orientation_type orientation() const
+        {
+            return m_header.height < 0 ? orientation_type::top_down : orientation_type::bottom_up;
+        }
+
+        /// Returns the offset of the pixel data in the file.
+        uint32_t data_offset() const
+        {
+            return m_header.offset;
+        }
+
+        /// Returns the compression stored in the file, e.g., 0 for BI_RGB or 1 for BI_RLE8.
+        uint32_t compression() const
+        {
+            return m_header.compression;
+        }
+
+        /**
+            \brief Determines the image properties like bmp_file::load(), classifying the color table on the first call.
+            Color tables and bit masks are taken from the prefix, if they are stored beyond it file_read_error is returned.
+            \param[out] the_image_properties  The properties of the image stored in the file.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation.
+        */
+        operation_result properties(image_properties& the_image_properties, const load_options& options = load_options())
+        {
+            operation_result result(operation_result_type::ok);
+            if (!is_open())
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else if (m_image_properties.pixel_format == pixel_format_type::invalid)
+            {
+                bmp_file::memory_input input(m_prefix, m_prefix_size);
+                result = bmp_file::load_image_properties(input, m_header, m_color_table, m_image_properties);
+            }
+            if (result)
+            {
+                the_image_properties = m_image_properties;
+                result = bmp_file::apply_load_options(options, the_image_properties);
+            }
+            else
+            {
+                the_image_properties = image_properties(); // clear
+            }
+            return result;
+        }
+
+        /**
+            \brief Loads the image of the probed file like bmp_file::load(), the header and the color table are taken from the prefix.
+            The pixels are read from the file kept open by open_for_load(), from the data given to open() or from the prefix holding the whole file.
+            \param[out] buffer  The buffer to store the image data in.
+            \param[in] buffer_size  The size of buffer.
+            \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation, invalid_argument if the file has been closed and is larger than the prefix.
+        */
+        operation_result load(void* buffer, size_t buffer_size, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            if (buffer == nullptr)
+            {
+                return operation_result_type::null_argument;
+            }
+            bmp_file::fixed_buffer allocate(buffer, buffer_size);
+            return load_pixels(allocate, the_image_properties, force_line_padding, force_orientation, options);
+        }
+
+        /**
+            \brief Loads the image of the probed file into a vector, see the other load().
+            \param[out] buffer  The vector to store the image data in, it is resized as needed and cleared on failure.
+            \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation.
+        */
+        operation_result load(std::vector<uint8_t>& buffer, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            bmp_file::vector_buffer allocate(buffer);
+            operation_result result = load_pixels(allocate, the_image_properties, force_line_padding, force_orientation, options);
+            if (!result)
+            {
+                buffer.clear();
+            }
+            return result;
+        }
+
+        /// Returns true if a file is kept open for load().
+        bool is_file_open() const
+        {
+            return m_file.is_valid();
+        }
+
+        /// Forgets the file read and closes it if kept open.
+        void clear()
+        {
+            if (m_file.is_valid())
+            {
+#if defined(_WIN32)
+                CloseHandle(m_file.handle);
+                m_file.handle = INVALID_HANDLE_VALUE;
+#else
+                ::close(m_file.handle);
+                m_file.handle = -1;
+#endif
+            }
+            m_prefix_size = 0;
+            m_data = nullptr;
+            m_data_size = 0;
+            m_header = {};
+            m_image_properties = image_properties();
+        }
+
+    private:
+        template <typename char_type>
+        operation_result open_file_prefix(const char_type* filename, bool keep_open)
+        {
+            operation_result result;
+            clear();
+            if (filename == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else
+            {
+                result = read_prefix(filename, keep_open);
+            }
+            if (result)
+            {
+                result = check_header();
+            }
+            if (!result)
+            {
+                clear();
+            }
+            return result;
+        }
+
+        template <typename allocator_type>
+        operation_result load_pixels(const allocator_type& allocate, image_properties& the_image_properties, bool force_line_padding, bool force_orientation, const load_options& options)
+        {
+            operation_result result;
+            bmp_file::decoder_scratch scratch;
+            if (!is_open() || (force_orientation && the_image_properties.orientation == orientation_type::invalid))
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else if (m_data != nullptr)
+            {
+                bmp_file::memory_input input(m_data, m_data_size);
+                result = bmp_file::load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            else if (m_file.is_valid())
+            {
+                // the header and the color table are read from the prefix, the pixels with positional reads
+                bmp_file::file_input file;
+                file.attach(m_file.handle);
+                bmp_file::prefixed_input<bmp_file::file_input> input(m_prefix, m_prefix_size, file);
+                result = bmp_file::load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            else if (m_prefix_size < prefix_size)
+            {
+                // the prefix holds the whole file
+                bmp_file::memory_input input(m_prefix, m_prefix_size);
+                result = bmp_file::load_image(input, allocate, the_image_properties, force_line_padding, force_orientation, options, scratch);
+            }
+            else
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            return result;
+        }
+
+        operation_result check_header()
+        {
+            bmp_file::memory_input input(m_prefix, m_prefix_size);
+            operation_result result = bmp_file::load_and_check_header(input, m_header);
+            if (!result)
+            {
+                m_header = {};
+            }
+            return result;
+        }
+
+#if defined(_WIN32)
+        operation_result read_prefix(const char* filename, bool keep_open)
+        {
+            return read_prefix(CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr), keep_open);
+        }
+
+        operation_result read_prefix(const wchar_t* filename, bool keep_open)
+        {
+            return read_prefix(CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr), keep_open);
+        }
+
+        operation_result read_prefix(HANDLE file, bool keep_open)
+        {
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                return operation_result_type::file_not_found;
+            }
+            operation_result result(operation_result_type::file_read_error);
+            DWORD bytes_read = 0;
+            if (ReadFile(file, m_prefix, static_cast<DWORD>(prefix_size), &bytes_read, nullptr))
+            {
+                m_prefix_size = bytes_read;
+                result = operation_result_type::ok;
+            }
+            if (keep_open)
+            {
+                m_file.handle = file;
+            }
+            else
+            {
+                CloseHandle(file);
+            }
+            return result;
+        }
+#else
+        operation_result read_prefix(const char* filename, bool keep_open)
+        {
+            int file = ::open(filename, O_RDONLY | O_CLOEXEC);
+            if (file < 0)
+            {
+                return operation_result_type::file_not_found;
+            }
+            operation_result result(operation_result_type::ok);
+            while (m_prefix_size < prefix_size)
+            {
+                // a single call reads the whole prefix of a regular file
+                const ssize_t bytes_read = ::read(file, m_prefix + m_prefix_size, prefix_size - m_prefix_size);
+                if (bytes_read > 0)
+                {
+                    m_prefix_size += static_cast<size_t>(bytes_read);
+                }
+                else if (bytes_read == 0)
+                {
+                    break; // end of file
+                }
+                else if (errno != EINTR)
+                {
+                    result = operation_result_type::file_read_error;
+                    break;
+                }
+            }
+            if (keep_open)
+            {
+                m_file.handle = file;
+            }
+            else
+            {
+                ::close(file);
+            }
+            return result;
+        }
+#endif
+
+        uint8_t m_prefix[prefix_size];
+        size_t m_prefix_size = 0;
+        const uint8_t* m_data = nullptr;
+        size_t m_data_size = 0;
+#if defined(_WIN32)
+        open_file m_file{INVALID_HANDLE_VALUE};
+#else
+        open_file m_file{-1};
+#endif
+        bmp_file::bmp_header m_header = {};
+        bmp_file::color_table_info m_color_table;
+        image_properties m_image_properties;
+    };
+
+    /// Reads an image in strips of lines, so that only a strip needs to be held in memory.
+    class bmp_reader
+    {
+    public:
+        /// Creates a closed reader.
+        bmp_reader() = default;
+
+        bmp_reader(const bmp_reader&) = delete;
+        bmp_reader& operator=(const bmp_reader&) = delete;
+
+        /**
+            \brief Opens the file and loads the image properties, reading starts at the first line.
+            \param[in] filename  The name of the file.
+            \param[inout] the_image_properties  The properties of the image stored in the file. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead. The lines are returned in the order of a buffer with this orientation.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation, run length encoded files are not supported.
+        */
+        template <typename char_type>
+        operation_result open(const char_type* filename, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            operation_result result;
+            close();
+            if (filename == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                m_file.open(filename, std::ios::binary);
+                if (!m_file.is_open())
+                {
+                    result = operation_result_type::file_not_found;
+                    the_image_properties = image_properties(); // clear
+                }
+                else
+                {
+                    bmp_file::stream_input input(m_file);
+                    bmp_file::bmp_header header = {};
+                    bmp_file::color_table_info color_table;
+                    orientation_type orientation_in_file = orientation_type::invalid;
+                    result = bmp_file::load_image_layout(input, header, color_table, the_image_properties, force_line_padding, force_orientation, options, orientation_in_file);
+                    if (result && bmp_file::is_run_length_encoded(header))
+                    {
+                        // run length encoded lines can not be read in strips without decoding all previous lines
+                        result = operation_result_type::unsupported_compression;
+                    }
+                    else if (result)
+                    {
+                        result = bmp_file::prepare_decoding_plan(header, color_table, orientation_in_file, the_image_properties, options, m_plan);
+                    }
+                }
+            }
+
+            if (result)
+            {
+                m_image_properties = the_image_properties;
+            }
+            else
+            {
+                close();
+            }
+            return result;
+        }
+
+        /// Returns true if a file is open.
+        bool is_open() const
+        {
+            return m_file.is_open();
+        }
+
+        /// Returns the properties of the image as returned by open().
+        const image_properties& properties() const
+        {
+            return m_image_properties;
+        }
+
+        /// Returns the next line read in buffer order.
+        size_t current_line() const
+        {
+            return m_current_line;
+        }
+
+        /// Returns the number of lines not read yet.
+        size_t remaining_lines() const
+        {
+            return m_image_properties.height - m_current_line;
+        }
+
+        /**
+            \brief Sets the next line to read.
+            \param[in] line  The line in buffer order.
+            \return Returns information about the result of the operation.
+        */
+        operation_result seek_line(size_t line)
+        {
+            operation_result result(operation_result_type::ok);
+            if (!is_open() || line > m_image_properties.height)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                m_current_line = line;
+            }
+            return result;
+        }
+
+        /**
+            \brief Reads the next strip of lines.
+            \param[out] buffer  The buffer to store the lines in, it needs to hold line_count lines of the stride of properties().
+            \param[in] buffer_size  The size of buffer.
+            \param[in] line_count  The maximum number of lines to read.
+            \param[out] lines_read  The number of lines read, less than line_count at the end of the image.
+            \return Returns information about the result of the operation.
+        */
+        operation_result read_lines(void* buffer, size_t buffer_size, size_t line_count, size_t& lines_read)
+        {
+            operation_result result(operation_result_type::ok);
+            lines_read = 0;
+            if (buffer == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (!is_open())
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                const size_t strip_line_count = std::min(line_count, remaining_lines());
+                if (strip_line_count * m_plan.stride_in_buffer > buffer_size)
+                {
+                    result = operation_result_type::buffer_too_small;
+                }
+                else
+                {
+                    bmp_file::stream_input input(m_file);
+                    result = bmp_file::load_lines(input, m_plan, m_current_line, strip_line_count, reinterpret_cast<uint8_t*>(buffer), m_scratch);
+                    if (result)
+                    {
+                        m_current_line += strip_line_count;
+                        lines_read = strip_line_count;
+                    }
+                }
+            }
+            return result;
+        }
+
+        /// Closes the file.
+        void close()
+        {
+            if (m_file.is_open())
+            {
+                m_file.close();
+            }
+            m_file.clear();
+            m_plan = bmp_file::decoding_plan();
+            m_image_properties = image_properties();
+            m_current_line = 0;
+        }
+
+    private:
+        std::ifstream m_file;
+        bmp_file::decoding_plan m_plan;
+        image_properties m_image_properties;
+        size_t m_current_line = 0;
+        bmp_file::decoder_scratch m_scratch;
+    };
+
+    /// Writes an image in strips of lines, so that only a strip needs to be held in memory.
+    class bmp_writer
+    {
+    public:
+        /// Creates a closed writer.
+        bmp_writer() = default;
+
+        bmp_writer(const bmp_writer&) = delete;
+        bmp_writer& operator=(const bmp_writer&) = delete;
+
+        /**
+            \brief Creates the file and writes the header.
+            \param[in] filename  The name of the file.
+            \param[in] the_image_properties  The properties of the image. The lines are expected in the order of a buffer with this orientation.
+            \param[in] force_bottom_up  Force bottom up when saving to disk for best compatibility.
+            \param[in] options  Optional settings, e.g., the pixel format stored in the file. Run length encoding is not supported.
+            \return Returns information about the result of the operation.
+        */
+        template <typename char_type>
+        operation_result open(const char_type* filename, const image_properties& the_image_properties, bool force_bottom_up = true, const save_options& options = save_options())
+        {
+            operation_result result(operation_result_type::ok);
+            close();
+            if (filename == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (!bmp_file::check_save_properties(the_image_properties) || !bmp_file::check_save_options(the_image_properties, options) || options.run_length_encoding)
+            {
+                // the lines are written at fixed positions, which rules out run length encoding
+                result = operation_result_type::invalid_argument;
+            }
+            else
+            {
+                m_file.open(filename, std::ios::binary);
+                if (!m_file.is_open())
+                {
+                    result = operation_result_type::file_open_for_writing_error;
+                }
+                else
+                {
+                    bmp_file::bmp_header header = {};
+                    const image_properties file_properties = bmp_file::determine_file_properties(the_image_properties, options);
+                    bmp_file::create_header(file_properties, force_bottom_up, false, header);
+                    bmp_file::prepare_encoding_plan(header, the_image_properties, m_plan);
+                    std::vector<uint8_t> header_data(m_plan.offset);
+                    bmp_file::memory_output output(header_data.data(), header_data.size());
+                    result = bmp_file::write_header(output, header, file_properties);
+                    if (result)
+                    {
+                        result = write_at(0, header_data);
+                    }
+                }
+            }
+
+            if (!result)
+            {
+                close();
+            }
+            return result;
+        }
+
+        /// Returns true if a file is open.
+        bool is_open() const
+        {
+            return m_file.is_open();
+        }
+
+        /// Returns the next line to write in buffer order.
+        size_t current_line() const
+        {
+            return m_current_line;
+        }
+
+        /// Returns the number of lines not written yet.
+        size_t remaining_lines() const
+        {
+            return m_plan.height - m_current_line;
+        }
+
+        /**
+            \brief Writes the next strip of lines.
+            \param[in] buffer  The buffer holding the lines, with the stride of the image properties passed to open().
+            \param[in] buffer_size  The size of buffer.
+            \param[in] line_count  The number of lines to write.
+            \return Returns information about the result of the operation.
+        */
+        operation_result write_lines(const void* buffer, size_t buffer_size, size_t line_count)
+        {
+            operation_result result(operation_result_type::ok);
+            if (buffer == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (!is_open() || line_count > remaining_lines())
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else if (line_count * m_plan.stride_in_buffer > buffer_size)
+            {
+                result = operation_result_type::buffer_too_small;
+            }
+            else if (line_count)
+            {
+                // the lines are stored as a contiguous range in the file, reversed if flipped
+                const size_t first_line_in_file = m_plan.flip ? m_plan.height - m_current_line - line_count : m_current_line;
+                m_strip_buffer.resize(line_count * m_plan.stride_in_file);
+                bmp_file::memory_output output(m_strip_buffer.data(), m_strip_buffer.size());
+                result = bmp_file::write_lines(output, m_plan, reinterpret_cast<const uint8_t*>(buffer), line_count, m_line_buffer);
+                if (result)
+                {
+                    result = write_at(m_plan.offset + first_line_in_file * m_plan.stride_in_file, m_strip_buffer);
+                }
+                if (result)
+                {
+                    m_current_line += line_count;
+                }
+            }
+            return result;
+        }
+
+        /**
+            \brief Checks that all lines have been written and closes the file.
+            \return Returns information about the result of the operation, incomplete if lines are missing.
+        */
+        operation_result finish()
+        {
+            operation_result result(operation_result_type::ok);
+            if (!is_open())
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else if (remaining_lines() != 0)
+            {
+                result = operation_result_type::incomplete;
+            }
+            else
+            {
+                m_file.close();
+                if (!m_file)
+                {
+                    result = operation_result_type::file_write_error;
+                }
+            }
+            close();
+            return result;
+        }
+
+        /// Closes the file without checking it, an incomplete file is kept.
+        void close()
+        {
+            if (m_file.is_open())
+            {
+                m_file.close();
+            }
+            m_file.clear();
+            m_plan = bmp_file::encoding_plan();
+            m_current_line = 0;
+        }
+
+    private:
+        operation_result write_at(size_t position, const std::vector<uint8_t>& data)
+        {
+            operation_result result(operation_result_type::ok);
+            m_file.seekp(static_cast<std::streamoff>(position));
+            m_file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!m_file)
+            {
+                result = operation_result_type::file_write_error;
+            }
+            return result;
+        }
+
+        std::ofstream m_file;
+        bmp_file::encoding_plan m_plan;
+        size_t m_current_line = 0;
+        std::vector<uint8_t> m_strip_buffer;
+        std::vector<uint8_t> m_line_buffer;
+    };
+
+    /**
+        \brief Saves images on background threads, so that producers never wait for the disk.
+        Pending jobs are held in a bounded lock free ring, which any number of threads can push to.
+        The files are written like by bmp_file::save().
+    */
+    class bmp_save_queue
+    {
+    public:
+        /// Called on a worker thread once a job has been saved, e.g., to recycle its pixels.
+        typedef std::function<void(save_queue_job&, const operation_result&)> completion_handler;
+
+        /**
+            \brief Creates the queue and starts its workers.
+            \param[in] capacity  The number of pending jobs, it is rounded up to a power of two.
+            \param[in] thread_count  The number of worker threads, jobs are rejected with thread_start_error if no worker could be started.
+            \param[in] completion  Optional, called with each job and its result.
+        */
+        explicit bmp_save_queue(size_t capacity = 64, size_t thread_count = 1, const completion_handler& completion = completion_handler())
+            : m_slots(determine_slot_count(capacity))
+            , m_mask(m_slots.size() - 1)
+            , m_completion(completion)
+        {
+            for (size_t i = 0; i < m_slots.size(); ++i)
+            {
+                m_slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            m_workers.start(thread_count, [this](size_t) { work(); });
+        }
+
+        bmp_save_queue(const bmp_save_queue&) = delete;
+        bmp_save_queue& operator=(const bmp_save_queue&) = delete;
+
+        /// Saves the pending jobs and stops the workers.
+        ~bmp_save_queue()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+            }
+            m_wake_up.notify_all();
+            m_workers.join();
+        }
+
+        /**
+            \brief Queues a job without blocking.
+            \param[inout] job  The job to save, it is moved into the queue if accepted and left unchanged otherwise.
+            \return Returns ok if the job has been accepted, queue_full if it has been dropped, thread_start_error if there are no workers.
+        */
+        operation_result try_push(save_queue_job& job)
+        {
+            operation_result result(operation_result_type::ok);
+            if (m_workers.size() == 0)
+            {
+                result = operation_result_type::thread_start_error;
+            }
+            else if (!push_job(job))
+            {
+                m_dropped++;
+                result = operation_result_type::queue_full;
+            }
+            return result;
+        }
+
+        /**
+            \brief Queues a job, waits while the queue is full.
+            \param[inout] job  The job to save, it is moved into the queue.
+            \return Returns ok, thread_start_error if there are no workers.
+        */
+        operation_result push(save_queue_job& job)
+        {
+            if (m_workers.size() == 0)
+            {
+                return operation_result_type::thread_start_error;
+            }
+            while (!push_job(job))
+            {
+                // a worker taking a job checks for waiting threads after freeing its slot, see notify_progress
+                std::unique_lock<std::mutex> lock(m_progress_mutex);
+                m_waiting++;
+                if (!has_free_slot())
+                {
+                    m_progress.wait(lock);
+                }
+                m_waiting--;
+            }
+            return operation_result_type::ok;
+        }
+
+        /// Waits until all jobs queued so far have been completed.
+        void wait() const
+        {
+            std::unique_lock<std::mutex> lock(m_progress_mutex);
+            m_waiting++;
+            while (m_depth.load() != 0)
+            {
+                m_progress.wait(lock);
+            }
+            m_waiting--;
+        }
+
+        /// Returns the current counters.
+        save_queue_statistics statistics() const
+        {
+            save_queue_statistics result;
+            result.queued = m_queued.load();
+            result.saved = m_saved.load();
+            result.failed = m_failed.load();
+            result.dropped = m_dropped.load();
+            result.depth = m_depth.load();
+            result.max_depth = m_max_depth.load();
+            return result;
+        }
+
+        /// Returns the number of worker threads started.
+        size_t thread_count() const
+        {
+            return m_workers.size();
+        }
+
+    private:
+        /// Holds a job, the sequence tells producers and workers whose turn it is. Its accesses are seq_cst, they pair with m_sleeping and m_waiting to wake sleeping threads.
+        struct slot
+        {
+            std::atomic<size_t> sequence{0};
+            save_queue_job job;
+        };
+
+        static size_t determine_slot_count(size_t capacity)
+        {
+            size_t slot_count = 2;
+            while (slot_count < capacity)
+            {
+                slot_count *= 2;
+            }
+            return slot_count;
+        }
+
+        /// Returns false if the queue is full, jobs are counted as pending before they can be dequeued.
+        bool push_job(save_queue_job& job)
+        {
+            const size_t depth = ++m_depth;
+            if (!enqueue(job))
+            {
+                complete_job();
+                return false;
+            }
+            update_max_depth(depth);
+            m_queued++;
+            // the sequence of the slot and m_sleeping are seq_cst, either a worker going to sleep in work() sees the job or we see the worker
+            if (m_sleeping.load() != 0)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_wake_up.notify_one();
+            }
+            return true;
+        }
+
+        /// Returns true if the next push may succeed, without taking the slot.
+        bool has_free_slot() const
+        {
+            const size_t position = m_enqueue_position.load();
+            const size_t sequence = m_slots[position & m_mask].sequence.load();
+            return static_cast<std::ptrdiff_t>(sequence - position) >= 0;
+        }
+
+        /// Wakes the threads in push() and wait() after a slot has been freed or a job completed.
+        void notify_progress()
+        {
+            if (m_waiting.load() != 0)
+            {
+                std::lock_guard<std::mutex> lock(m_progress_mutex);
+                m_progress.notify_all();
+            }
+        }
+
+        /// Counts a pending job as done, the last one wakes the stopping workers and the waiting threads.
+        void complete_job()
+        {
+            if (--m_depth == 0)
+            {
+                if (m_sleeping.load() != 0)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_wake_up.notify_all();
+                }
+                notify_progress();
+            }
+        }
+
+        bool enqueue(save_queue_job& job)
+        {
+            size_t position = m_enqueue_position.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                slot& target = m_slots[position & m_mask];
+                const size_t sequence = target.sequence.load();
+                const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence - position);
+                if (difference == 0)
+                {
+                    if (m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        target.job = std::move(job);
+                        target.sequence.store(position + 1);
+                        return true;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    return false; // the slot still holds a job pushed one round before
+                }
+                else
+                {
+                    position = m_enqueue_position.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool dequeue(save_queue_job& job)
+        {
+            size_t position = m_dequeue_position.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                slot& source = m_slots[position & m_mask];
+                const size_t sequence = source.sequence.load();
+                const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+                if (difference == 0)
+                {
+                    if (m_dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        job = std::move(source.job);
+                        source.sequence.store(position + m_mask + 1);
+                        return true;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    return false; // empty
+                }
+                else
+                {
+                    position = m_dequeue_position.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void save(save_queue_job& job)
+        {
+            const operation_result result = bmp_file::save(job.filename.c_str(), job.pixels.data(), job.pixels.size(), job.properties, job.force_bottom_up, job.options);
+            if (result)
+            {
+                m_saved++;
+            }
+            else
+            {
+                m_failed++;
+            }
+            if (m_completion)
+            {
+                m_completion(job, result);
+            }
+            complete_job();
+        }
+
+        void update_max_depth(size_t depth)
+        {
+            size_t max_depth = m_max_depth.load();
+            while (depth > max_depth && !m_max_depth.compare_exchange_weak(max_depth, depth))
+            {
+            }
+        }
+
+        void work()
+        {
+            save_queue_job job;
+            for (;;)
+            {
+                if (!dequeue(job))
+                {
+                    // announce the sleep before looking again, so that a push either is seen here or sees the sleeping worker
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_sleeping++;
+                    bool dequeued = false;
+                    while (!(dequeued = dequeue(job)) && !(m_stopping && m_depth.load() == 0))
+                    {
+                        m_wake_up.wait(lock);
+                    }
+                    m_sleeping--;
+                    if (!dequeued)
+                    {
+                        break;
+                    }
+                }
+                notify_progress();
+                save(job);
+            }
+        }
+
+        std::vector<slot> m_slots;
+        size_t m_mask = 0;
+        std::atomic<size_t> m_enqueue_position{0};
+        std::atomic<size_t> m_dequeue_position{0};
+        std::atomic<size_t> m_queued{0};
+        std::atomic<size_t> m_saved{0};
+        std::atomic<size_t> m_failed{0};
+        std::atomic<size_t> m_dropped{0};
+        std::atomic<size_t> m_depth{0};
+        std::atomic<size_t> m_max_depth{0};
+        std::atomic<int> m_sleeping{0};
+        mutable std::atomic<int> m_waiting{0};
+        completion_handler m_completion;
+        std::mutex m_mutex;
+        std::condition_variable m_wake_up;
+        mutable std::mutex m_progress_mutex;
+        mutable std::condition_variable m_progress;
+        bool m_stopping = false;
+        bmp_file::worker_threads m_workers;
+    };
+
+    /**
+        \brief Keeps recently loaded images in memory, so that loading them again costs a lookup instead of reading and decoding the file.
+        Files are identified by their name, size and modification time, a changed file is loaded again. Data in memory is looked up by a hash of its content,
+        an entry keeps a copy of the content, which is compared on a hit, so that a collision of hashes cannot return another image.
+        The pixels and copies of all entries are bounded by the capacity, the least recently used entries are dropped first.
+        A cache can be used by several threads at the same time, images loaded by two threads at once may be decoded twice.
+    */
+    class bmp_image_cache
+    {
+    public:
+        /// Shares a cached image, it stays valid after the entry has been dropped from the cache.
+        typedef std::shared_ptr<const cached_image> image_pointer;
+
+        /**
+            \brief Creates an empty cache.
+            \param[in] capacity  The maximum size of the pixels and the copies of data of all entries in bytes, larger images are loaded but not cached.
+        */
+        explicit bmp_image_cache(size_t capacity = 256 * 1024 * 1024)
+            : m_capacity(capacity)
+        {
+        }
+
+        bmp_image_cache(const bmp_image_cache&) = delete;
+        bmp_image_cache& operator=(const bmp_image_cache&) = delete;
+
+        /**
+            \brief Loads an image from the cache or from the file, see bmp_file::load().
+            \param[in] filename  The name of the file.
+            \param[out] image  Receives the shared image, cleared on failure.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to. They are part of the key of an entry.
+            \return Returns information about the result of the operation.
+        */
+        template <typename char_type>
+        operation_result load(const char_type* filename, image_pointer& image, const load_options& options = load_options())
+        {
+            image.reset();
+            if (filename == nullptr)
+            {
+                return operation_result_type::null_argument;
+            }
+            const std::string key = create_key('f', filename, std::char_traits<char_type>::length(filename) * sizeof(char_type), options);
+            file_identity identity;
+            if (!query_file_identity(filename, identity))
+            {
+                // a dropped file must not be served from the cache
+                std::lock_guard<std::mutex> lock(m_mutex);
+                erase(key, true);
+                return operation_result_type::file_not_found;
+            }
+            if (find(key, identity, image))
+            {
+                return operation_result_type::ok;
+            }
+            std::shared_ptr<cached_image> loaded = std::make_shared<cached_image>();
+            operation_result result = bmp_file::load(filename, loaded->pixels, loaded->properties, false, false, options);
+            if (result)
+            {
+                image = loaded;
+                insert(key, identity, image);
+            }
+            return result;
+        }
+
+        /**
+            \brief Loads an image from the cache or from memory holding a BMP file, see bmp_file::load().
+            \param[in] data  The content of a BMP file, each load computes a hash of it and a hit compares it with the copy in the entry.
+            \param[in] data_size  The size of data.
+            \param[out] image  Receives the shared image, cleared on failure.
+            \param[in] options  Optional settings, e.g., the pixel format to convert to. They are part of the key of an entry.
+            \return Returns information about the result of the operation.
+        */
+        operation_result load(const void* data, size_t data_size, image_pointer& image, const load_options& options = load_options())
+        {
+            image.reset();
+            if (data == nullptr)
+            {
+                return operation_result_type::null_argument;
+            }
+            const uint8_t* p_data = reinterpret_cast<const uint8_t*>(data);
+            const uint64_t hash = compute_hash(p_data, data_size);
+            const std::string key = create_key('m', &hash, sizeof(hash), options);
+            file_identity identity;
+            identity.size = data_size;
+            if (find(key, identity, image, p_data))
+            {
+                return operation_result_type::ok;
+            }
+            std::shared_ptr<cached_image> loaded = std::make_shared<cached_image>();
+            operation_result result = bmp_file::load(data, data_size, loaded->pixels, loaded->properties, false, false, options);
+            if (result)
+            {
+                image = loaded;
+                insert(key, identity, image, std::vector<uint8_t>(p_data, p_data + data_size));
+            }
+            return result;
+        }
+
+        /// Drops all entries, images still in use stay valid.
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_entries.clear();
+            m_index.clear();
+            m_bytes = 0;
+        }
+
+        /// Returns the maximum size of the pixels of all entries in bytes.
+        size_t capacity() const
+        {
+            return m_capacity;
+        }
+
+        /// Returns the counters of the cache.
+        image_cache_statistics statistics() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            image_cache_statistics result = m_statistics;
+            result.entries = m_entries.size();
+            result.bytes = m_bytes;
+            return result;
+        }
+
+    private:
+        /// Identifies the version of a file, data in memory only uses the size.
+        struct file_identity
+        {
+            uint64_t size = 0; //!< The size in bytes.
+            uint64_t modification_time = 0; //!< The time of the last modification in nanoseconds or in 100 nanosecond intervals, depending on the platform.
+
+            bool operator==(const file_identity& other) const
+            {
+                return size == other.size && modification_time == other.modification_time;
+            }
+        };
+
+        struct entry
+        {
+            std::string key;
+            file_identity identity;
+            image_pointer image;
+            std::vector<uint8_t> data; //!< The content of data in memory, empty for files.
+
+            /// Returns the bytes counted against the capacity.
+            size_t size() const
+            {
+                return image->pixels.size() + data.size();
+            }
+        };
+
+        typedef std::list<entry> entry_list;
+
+#if defined(_WIN32)
+        static bool query_file_identity(const char* filename, file_identity& identity)
+        {
+            WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+            return GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes) && fill_identity(attributes, identity);
+        }
+
+        static bool query_file_identity(const wchar_t* filename, file_identity& identity)
+        {
+            WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+            return GetFileAttributesExW(filename, GetFileExInfoStandard, &attributes) && fill_identity(attributes, identity);
+        }
+
+        static bool fill_identity(const WIN32_FILE_ATTRIBUTE_DATA& attributes, file_identity& identity)
+        {
+            identity.size = static_cast<uint64_t>(attributes.nFileSizeHigh) << 32 | attributes.nFileSizeLow;
+            identity.modification_time = static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32 | attributes.ftLastWriteTime.dwLowDateTime;
+            return true;
+        }
+#else
+        static bool query_file_identity(const char* filename, file_identity& identity)
+        {
+            struct stat file_status = {};
+            if (stat(filename, &file_status) != 0)
+            {
+                return false;
+            }
+#if defined(__APPLE__)
+            const uint64_t nanoseconds = static_cast<uint64_t>(file_status.st_mtimespec.tv_nsec);
+#else
+            const uint64_t nanoseconds = static_cast<uint64_t>(file_status.st_mtim.tv_nsec);
+#endif
+            identity.size = static_cast<uint64_t>(file_status.st_size);
+            identity.modification_time = static_cast<uint64_t>(file_status.st_mtime) * 1000000000u + nanoseconds;
+            return true;
+        }
+#endif
+
+        /// The key holds the kind of source, the name or the hash and the options changing the pixels.
+        static std::string create_key(char kind, const void* p_name, size_t name_size, const load_options& options)
+        {
+            const uint32_t values[] = { static_cast<uint32_t>(options.pixel_format), options.region.x, options.region.y, options.region.width, options.region.height,
+                options.downscale_factor, static_cast<uint32_t>(options.downscale_filter) };
+            std::string key(1, kind);
+            key.append(reinterpret_cast<const char*>(values), sizeof(values));
+            key.append(reinterpret_cast<const char*>(p_name), name_size);
+            return key;
+        }
+
+        /// Computes a 64 bit hash of 8 byte words, it is not suited against deliberate collisions.
+        static uint64_t compute_hash(const uint8_t* p_data, size_t size)
+        {
+            const uint64_t prime = 0x100000001B3ull;
+            uint64_t hash = 0xCBF29CE484222325ull ^ size;
+            size_t i = 0;
+            for (; i + 8 <= size; i += 8)
+            {
+                uint64_t word = 0;
+                memcpy(&word, p_data + i, sizeof(word));
+                hash = (hash ^ word) * prime;
+                hash ^= hash >> 32;
+            }
+            for (; i < size; ++i)
+            {
+                hash = (hash ^ p_data[i]) * prime;
+            }
+            return hash;
+        }
+
+        /// Looks up an entry, the content of data in memory is compared with the copy in the entry, the size has been compared by the identity.
+        bool find(const std::string& key, const file_identity& identity, image_pointer& image, const uint8_t* p_data = nullptr)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::unordered_map<std::string, entry_list::iterator>::iterator position = m_index.find(key);
+            if (position != m_index.end() && position->second->identity == identity
+                && (p_data == nullptr || memcmp(position->second->data.data(), p_data, position->second->data.size()) == 0))
+            {
+                // the most recently used entry is at the front
+                m_entries.splice(m_entries.begin(), m_entries, position->second);
+                image = position->second->image;
+                m_statistics.hits++;
+                return true;
+            }
+            erase(key, true);
+            m_statistics.misses++;
+            return false;
+        }
+
+        void insert(const std::string& key, const file_identity& identity, const image_pointer& image, std::vector<uint8_t> data = std::vector<uint8_t>())
+        {
+            const size_t size = image->pixels.size() + data.size();
+            if (size > m_capacity)
+            {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            erase(key, false); // another thread has loaded the same image
+            entry new_entry;
+            new_entry.key = key;
+            new_entry.identity = identity;
+            new_entry.image = image;
+            new_entry.data.swap(data);
+            m_entries.push_front(std::move(new_entry));
+            m_index[key] = m_entries.begin();
+            m_bytes += size;
+            while (m_bytes > m_capacity)
+            {
+                m_statistics.evictions++;
+                erase(m_entries.back().key, false);
+            }
+        }
+
+        /// Drops an entry if present, m_mutex must be locked.
+        void erase(const std::string& key, bool invalidated)
+        {
+            std::unordered_map<std::string, entry_list::iterator>::iterator position = m_index.find(key);
+            if (position != m_index.end())
+            {
+                m_bytes -= position->second->size();
+                m_entries.erase(position->second);
+                m_index.erase(position);
+                if (invalidated)
+                {
+                    m_statistics.invalidations++;
+                }
+            }
+        }
+
+        const size_t m_capacity;
+        mutable std::mutex m_mutex;
+        entry_list m_entries;
+        std::unordered_map<std::string, entry_list::iterator> m_index;
+        size_t m_bytes = 0;
+        image_cache_statistics m_statistics;
+    };
+
+    /**
+        \brief Loads sequences of BMP files sharing the same header, e.g., frames of a video, with the work on the header done once.
+        The first frame is checked fully when the reader is opened. Each frame is then only checked by comparing its header and color table with
+        the bytes of the first frame, before its pixels are read and converted with the plan of the first frame. Frames with other headers are loaded
+        and checked fully and must result in the same image properties. A reader must not be used by several threads at the same time.
+    */
+    class bmp_sequence_reader
+    {
+    public:
+        /// Creates a closed reader.
+        bmp_sequence_reader() = default;
+
+        bmp_sequence_reader(const bmp_sequence_reader&) = delete;
+        bmp_sequence_reader& operator=(const bmp_sequence_reader&) = delete;
+
+        /**
+            \brief Checks the first frame of a sequence and prepares loading the frames, its pixels are not loaded.
+            \param[in] filename  The name of the first frame.
+            \param[inout] the_image_properties  The properties of the frames in the buffers. Used as input parameter if the force flags are set to true.
+            \param[in] force_line_padding  Use the line padding set in the_image_properties instead.
+            \param[in] force_orientation  Use the orientation set in the_image_properties instead.
+            \param[in] options  Optional settings applied to all frames, e.g., the pixel format to convert to.
+            \return Returns information about the result of the operation.
+        */
+        template <typename char_type>
+        operation_result open(const char_type* filename, image_properties& the_image_properties, bool force_line_padding = false, bool force_orientation = false, const load_options& options = load_options())
+        {
+            operation_result result;
+            close();
+            bmp_file::file_input input;
+            if (filename == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (force_orientation && the_image_properties.orientation == orientation_type::invalid)
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else if (!input.open(filename))
+            {
+                result = operation_result_type::file_not_found;
+                the_image_properties = image_properties(); // clear
+            }
+            else
+            {
+                bmp_file::bmp_header header = {};
+                orientation_type orientation_in_file = orientation_type::invalid;
+                result = bmp_file::load_image_layout(input, header, m_scratch.color_table, the_image_properties, force_line_padding, force_orientation, options, orientation_in_file);
+                if (result)
+                {
+                    result = bmp_file::prepare_decoding_plan(header, m_scratch.color_table, orientation_in_file, the_image_properties, options, m_plan);
+                }
+                if (result)
+                {
+                    // the header, the color table and anything else before the pixel data identify frames with the same layout
+                    m_prefix.resize(header.offset);
+                    if (!input.read_at(0, m_prefix.data(), m_prefix.size()))
+                    {
+                        result = operation_result_type::file_read_error;
+                    }
+                }
+            }
+            if (result)
+            {
+                m_image_properties = the_image_properties;
+                m_options = options;
+                m_frame_size = m_plan.stride_in_buffer * m_plan.height;
+            }
+            else
+            {
+                close();
+            }
+            return result;
+        }
+
+        /// Returns true if the first frame has been checked.
+        bool is_open() const
+        {
+            return m_frame_size != 0;
+        }
+
+        /// Returns the properties of the frames in the buffers.
+        const image_properties& properties() const
+        {
+            return m_image_properties;
+        }
+
+        /// Returns the size of a frame in a buffer in bytes.
+        size_t frame_size() const
+        {
+            return m_frame_size;
+        }
+
+        /**
+            \brief Loads a frame of the sequence.
+            \param[in] filename  The name of the frame.
+            \param[out] buffer  The buffer to store the image data in.
+            \param[in] buffer_size  The size of buffer, at least frame_size().
+            \return Returns information about the result of the operation, invalid_argument if the frame has other image properties than the first frame.
+        */
+        template <typename char_type>
+        operation_result load(const char_type* filename, void* buffer, size_t buffer_size)
+        {
+            operation_result result;
+            if (!is_open())
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else if (filename == nullptr || buffer == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (buffer_size < m_frame_size)
+            {
+                result = operation_result_type::buffer_too_small;
+            }
+            else
+            {
+                result = load_frame(filename, reinterpret_cast<uint8_t*>(buffer), m_scratch);
+            }
+            return result;
+        }
+
+        /**
+            \brief Loads a frame of the sequence into a vector.
+            \param[in] filename  The name of the frame.
+            \param[out] buffer  The vector to store the image data in, it is resized to frame_size() and cleared on failure.
+            \return Returns information about the result of the operation.
+        */
+        template <typename char_type>
+        operation_result load(const char_type* filename, std::vector<uint8_t>& buffer)
+        {
+            buffer.resize(m_frame_size);
+            operation_result result = load(filename, buffer.data(), buffer.size());
+            if (!result)
+            {
+                buffer.clear();
+            }
+            return result;
+        }
+
+        /**
+            \brief Loads frames into consecutive parts of a single buffer, e.g., a tensor of frame count x height x width x channels.
+            \param[in] filenames  The names of the frames, frame i is stored at offset i * frame_size().
+            \param[out] buffer  The buffer to store the frames in.
+            \param[in] buffer_size  The size of buffer, at least the number of frames times frame_size().
+            \param[in] thread_count  The number of threads loading frames, zero uses one thread per processor core.
+            \return Returns information about the result of the operation, the result of the first frame that failed.
+        */
+        template <typename string_type>
+        operation_result load_frames(const std::vector<string_type>& filenames, void* buffer, size_t buffer_size, size_t thread_count = 1)
+        {
+            operation_result result;
+            if (!is_open())
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            else if (buffer == nullptr)
+            {
+                result = operation_result_type::null_argument;
+            }
+            else if (buffer_size / m_frame_size < filenames.size())
+            {
+                result = operation_result_type::buffer_too_small;
+            }
+            else
+            {
+                uint8_t* p_frames = reinterpret_cast<uint8_t*>(buffer);
+                result = bmp_file::process_bands(filenames.size(), thread_count, [this, &filenames, p_frames](size_t first_frame, size_t frame_count)
+                {
+                    bmp_file::decoder_scratch scratch;
+                    operation_result frame_result(operation_result_type::ok);
+                    for (size_t frame = first_frame; frame < first_frame + frame_count && frame_result; ++frame)
+                    {
+                        frame_result = load_frame(filenames[frame].c_str(), p_frames + frame * m_frame_size, scratch);
+                    }
+                    return frame_result;
+                });
+            }
+            return result;
+        }
+
+        /**
+            \brief Loads frames into a single vector, see the other load_frames().
+            \param[in] filenames  The names of the frames, frame i is stored at offset i * frame_size().
+            \param[out] buffer  The vector to store the frames in, it is resized as needed and cleared on failure.
+            \param[in] thread_count  The number of threads loading frames, zero uses one thread per processor core.
+            \return Returns information about the result of the operation, the result of the first frame that failed.
+        */
+        template <typename string_type>
+        operation_result load_frames(const std::vector<string_type>& filenames, std::vector<uint8_t>& buffer, size_t thread_count = 1)
+        {
+            buffer.resize(filenames.size() * m_frame_size);
+            operation_result result = load_frames(filenames, buffer.data(), buffer.size(), thread_count);
+            if (!result)
+            {
+                buffer.clear();
+            }
+            return result;
+        }
+
+        /// Forgets the first frame.
+        void close()
+        {
+            m_prefix.clear();
+            m_plan = bmp_file::decoding_plan();
+            m_image_properties = image_properties();
+            m_options = load_options();
+            m_frame_size = 0;
+        }
+
+    private:
+        template <typename char_type>
+        operation_result load_frame(const char_type* filename, uint8_t* p_buffer, bmp_file::decoder_scratch& scratch) const
+        {
+            bmp_file::file_input input;
+            if (!input.open(filename))
+            {
+                return operation_result_type::file_not_found;
+            }
+
+            // the sizes of run length encoded frames differ, their pixel data needs the full check
+            if (m_plan.run_length_bits == 0)
+            {
+                const uint8_t* p_prefix = input.view_at(0, m_prefix.size(), scratch.block_buffer);
+                if (p_prefix != nullptr && memcmp(p_prefix, m_prefix.data(), m_prefix.size()) == 0)
+                {
+                    return bmp_file::load_lines(input, m_plan, 0, m_plan.height, p_buffer, scratch);
+                }
+            }
+
+            // another header, the frame is loaded like by bmp_file::load() with the layout of the first frame
+            image_properties frame_properties = m_image_properties;
+            load_options frame_options = m_options;
+            frame_options.thread_count = 1;
+            bmp_file::fixed_buffer allocate(p_buffer, m_frame_size);
+            operation_result result = bmp_file::load_image(input, allocate, frame_properties, true, true, frame_options, scratch);
+            if (result && (frame_properties.width != m_image_properties.width || frame_properties.height != m_image_properties.height || frame_properties.pixel_format != m_image_properties.pixel_format))
+            {
+                result = operation_result_type::invalid_argument;
+            }
+            return result;
+        }
+
+        std::vector<uint8_t> m_prefix;
+        bmp_file::decoding_plan m_plan;
+        image_properties m_image_properties;
+        load_options m_options;
+        size_t m_frame_size = 0;
+        bmp_file::decoder_scratch m_scratch;
     };
 }
@@ -42,4 +42,10 @@ int main()
         result = cppbmpfile::bmp_file::load("TestImage.bmp", bufferB.data(), bufferB.size(), imagePropertiesB);
         std::cout << cppbmpfile::operation_result_type_to_string(result) << std::endl;
     }
+
+    // reading, opening and parsing the file only once
+    cppbmpfile::image_properties imagePropertiesC;
+    std::vector<uint8_t> bufferC;
+    result = cppbmpfile::bmp_file::load("TestImage.bmp", bufferC, imagePropertiesC);
+    std::cout << cppbmpfile::operation_result_type_to_string(result) << std::endl;
 }
@@ -1,11 +1,314 @@
 ﻿#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
 #include <catch2/catch.hpp>
+#define CPPBMPFILE_ENABLE_STATISTICS
 #include <cppbmpfile/cppbmpfile.hpp>
 #include <string>
+#include <fstream>
+#include <iterator>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+static std::atomic<size_t> test_allocation_count(0);
+static std::atomic<size_t> test_allocation_limit(SIZE_MAX);
+
+// counts the allocations to check that loading with a decoder does not allocate, all forms are replaced so that memory is always released by the matching form
+// allocations larger than test_allocation_limit fail to check the handling of std::bad_alloc
+static void* allocate_counted(size_t size) noexcept
+{
+    ++test_allocation_count;
+    if (size > test_allocation_limit)
+    {
+        return nullptr;
+    }
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+static void* allocate_counted_or_throw(size_t size)
+{
+    void* p = allocate_counted(size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(size_t size)
+{
+    return allocate_counted_or_throw(size);
+}
+
+void* operator new[](size_t size)
+{
+    return allocate_counted_or_throw(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate_counted(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate_counted(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+#if defined(__cpp_aligned_new)
+static void* allocate_counted(size_t size, std::align_val_t alignment) noexcept
+{
+    // aligned_alloc() needs a multiple of the alignment
+    ++test_allocation_count;
+    const size_t align = static_cast<size_t>(alignment);
+    return std::aligned_alloc(align, (std::max(size, static_cast<size_t>(1)) + align - 1) / align * align);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* p = allocate_counted(size, alignment);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocate_counted(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocate_counted(size, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+#endif
 
 static const size_t test_file_width = 90;
 static const size_t test_file_height = 100;
 static const size_t test_file_padding = 2;
+
+inline std::vector<uint8_t> read_test_file(const char* filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+inline void append_test_value(std::vector<uint8_t>& data, uint32_t value, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        data.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+/// Creates the content of a BMP file, color table entries are given as 0x00RRGGBB, pixel data includes the line padding.
+inline std::vector<uint8_t> create_test_bmp(uint16_t bits_per_pixel, int32_t width, int32_t height, const std::vector<uint32_t>& color_table, const std::vector<uint8_t>& pixel_data, uint32_t compression = 0)
+{
+    const uint32_t offset = static_cast<uint32_t>(54 + color_table.size() * 4);
+    std::vector<uint8_t> data;
+    append_test_value(data, 0x4D42, 2);
+    append_test_value(data, static_cast<uint32_t>(offset + pixel_data.size()), 4);
+    append_test_value(data, 0, 4);
+    append_test_value(data, offset, 4);
+    append_test_value(data, 40, 4);
+    append_test_value(data, static_cast<uint32_t>(width), 4);
+    append_test_value(data, static_cast<uint32_t>(height), 4);
+    append_test_value(data, 1, 2);
+    append_test_value(data, bits_per_pixel, 2);
+    append_test_value(data, compression, 4);
+    append_test_value(data, compression ? static_cast<uint32_t>(pixel_data.size()) : 0, 4);
+    append_test_value(data, 0, 4);
+    append_test_value(data, 0, 4);
+    append_test_value(data, static_cast<uint32_t>(color_table.size()), 4);
+    append_test_value(data, 0, 4);
+    for (uint32_t entry : color_table)
+    {
+        append_test_value(data, entry, 4);
+    }
+    data.insert(data.end(), pixel_data.begin(), pixel_data.end());
+    return data;
+}
+
+inline size_t test_byte_per_pixel(cppbmpfile::pixel_format_type pixel_format)
+{
+    switch (pixel_format)
+    {
+    case cppbmpfile::pixel_format_type::Mono8: return 1;
+    case cppbmpfile::pixel_format_type::BGR8: case cppbmpfile::pixel_format_type::RGB8: return 3;
+    case cppbmpfile::pixel_format_type::BGRA8: case cppbmpfile::pixel_format_type::RGBA8: return 4;
+    default: return 0;
+    }
+}
+
+/// Converts a single pixel as reference for the conversions of the library.
+inline void convert_test_pixel(const uint8_t* p_source, cppbmpfile::pixel_format_type source_format, uint8_t* p_target, cppbmpfile::pixel_format_type target_format)
+{
+    uint8_t b = p_source[0];
+    uint8_t g = b;
+    uint8_t r = b;
+    uint8_t a = 255;
+    if (test_byte_per_pixel(source_format) >= 3)
+    {
+        g = p_source[1];
+        r = p_source[2];
+        if (source_format == cppbmpfile::pixel_format_type::RGB8 || source_format == cppbmpfile::pixel_format_type::RGBA8)
+        {
+            std::swap(b, r);
+        }
+    }
+    if (test_byte_per_pixel(source_format) == 4)
+    {
+        a = p_source[3];
+    }
+    switch (target_format)
+    {
+    case cppbmpfile::pixel_format_type::Mono8: p_target[0] = static_cast<uint8_t>((29 * b + 150 * g + 77 * r + 128) >> 8); break;
+    case cppbmpfile::pixel_format_type::BGR8: p_target[0] = b; p_target[1] = g; p_target[2] = r; break;
+    case cppbmpfile::pixel_format_type::RGB8: p_target[0] = r; p_target[1] = g; p_target[2] = b; break;
+    case cppbmpfile::pixel_format_type::BGRA8: p_target[0] = b; p_target[1] = g; p_target[2] = r; p_target[3] = a; break;
+    case cppbmpfile::pixel_format_type::RGBA8: p_target[0] = r; p_target[1] = g; p_target[2] = b; p_target[3] = a; break;
+    default: break;
+    }
+}
+
+/// Converts an image as reference for the conversions of the library, the line padding is kept zero.
+inline std::vector<uint8_t> convert_test_image(const std::vector<uint8_t>& source, const cppbmpfile::image_properties& source_props, const cppbmpfile::image_properties& target_props)
+{
+    const size_t source_stride = source_props.width * test_byte_per_pixel(source_props.pixel_format) + source_props.line_padding;
+    const size_t target_stride = target_props.width * test_byte_per_pixel(target_props.pixel_format) + target_props.line_padding;
+    std::vector<uint8_t> target(target_stride * target_props.height);
+    for (size_t line = 0; line < source_props.height; ++line)
+    {
+        const size_t target_line = source_props.orientation == target_props.orientation ? line : source_props.height - line - 1;
+        for (size_t column = 0; column < source_props.width; ++column)
+        {
+            convert_test_pixel(source.data() + line * source_stride + column * test_byte_per_pixel(source_props.pixel_format), source_props.pixel_format,
+                target.data() + target_line * target_stride + column * test_byte_per_pixel(target_props.pixel_format), target_props.pixel_format);
+        }
+    }
+    return target;
+}
+
+/// Copies a region given from the top of the image, the lines keep the orientation of the image.
+inline std::vector<uint8_t> crop_test_image(const std::vector<uint8_t>& source, const cppbmpfile::image_properties& source_props, const cppbmpfile::image_region& region, size_t target_line_padding)
+{
+    const size_t byte_per_pixel = test_byte_per_pixel(source_props.pixel_format);
+    const size_t source_stride = source_props.width * byte_per_pixel + source_props.line_padding;
+    const size_t target_stride = region.width * byte_per_pixel + target_line_padding;
+    std::vector<uint8_t> target(target_stride * region.height);
+    for (size_t line = 0; line < region.height; ++line)
+    {
+        const bool top_down = source_props.orientation == cppbmpfile::orientation_type::top_down;
+        const size_t source_line = top_down ? region.y + line : source_props.height - region.y - line - 1;
+        const size_t target_line = top_down ? line : region.height - line - 1;
+        memcpy(target.data() + target_line * target_stride, source.data() + source_line * source_stride + region.x * byte_per_pixel, region.width * byte_per_pixel);
+    }
+    return target;
+}
+
+/// Reduces blocks of factor x factor pixels starting at the top left of the image, the lines keep the orientation of the image.
+inline std::vector<uint8_t> downscale_test_image(const std::vector<uint8_t>& source, const cppbmpfile::image_properties& source_props, size_t factor, bool average, size_t target_line_padding)
+{
+    const size_t byte_per_pixel = test_byte_per_pixel(source_props.pixel_format);
+    const size_t source_stride = source_props.width * byte_per_pixel + source_props.line_padding;
+    const size_t width = source_props.width / factor;
+    const size_t height = source_props.height / factor;
+    const size_t target_stride = width * byte_per_pixel + target_line_padding;
+    const bool top_down = source_props.orientation == cppbmpfile::orientation_type::top_down;
+    std::vector<uint8_t> target(target_stride * height);
+    for (size_t line = 0; line < height; ++line)
+    {
+        uint8_t* p_target_line = target.data() + (top_down ? line : height - line - 1) * target_stride;
+        for (size_t column = 0; column < width; ++column)
+        {
+            for (size_t channel = 0; channel < byte_per_pixel; ++channel)
+            {
+                size_t sum = 0;
+                const size_t block_size = average ? factor : 1;
+                for (size_t y = line * factor; y < line * factor + block_size; ++y)
+                {
+                    const uint8_t* p_source_line = source.data() + (top_down ? y : source_props.height - y - 1) * source_stride;
+                    for (size_t x = column * factor; x < column * factor + block_size; ++x)
+                    {
+                        sum += p_source_line[x * byte_per_pixel + channel];
+                    }
+                }
+                const size_t count = block_size * block_size;
+                p_target_line[column * byte_per_pixel + channel] = static_cast<uint8_t>((sum + count / 2) / count);
+            }
+        }
+    }
+    return target;
+}
+
 TEST_CASE("result type to string", "[cpp_bmp_file]")
 {
     CHECK(std::string(operation_result_type_to_string(cppbmpfile::operation_result_type::ok)) == "BMP file operation successful.");
@@ -635,4 +938,2593 @@ TEST_CASE("test load save variants", "[cpp_bmp_file]")
     test_variants("V2_256_color.bmp", "V3_256_color.bmp", 0, cppbmpfile::orientation_type::top_down);
     test_variants("V3_256_color.bmp", "V4_256_color.bmp", 50, cppbmpfile::orientation_type::bottom_up);
     test_compare_variants(TEST_DATA_ROOT_PATH "/testimages/256_color.bmp", "V4_256_color.bmp");
-}
\ No newline at end of file
+}
+
+TEST_CASE("test load from memory", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/Mono8_non_linear.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/256_color.bmp"
+    };
+    for (const char* filename : filenames)
+    {
+        cppbmpfile::image_properties propsA;
+        cppbmpfile::image_properties propsB;
+        cppbmpfile::operation_result result;
+        std::vector<uint8_t> data = read_test_file(filename);
+        REQUIRE(!data.empty());
+
+        result = cppbmpfile::bmp_file::load(filename, propsA);
+        CHECK(result);
+        result = cppbmpfile::bmp_file::load(data.data(), data.size(), propsB);
+        CHECK(result);
+        CHECK(propsA.height == propsB.height);
+        CHECK(propsA.width == propsB.width);
+        CHECK(propsA.pixel_format == propsB.pixel_format);
+        CHECK(propsA.orientation == propsB.orientation);
+        CHECK(propsA.line_padding == propsB.line_padding);
+
+        std::vector<uint8_t> bufferA(cppbmpfile::bmp_file::compute_buffer_size(propsA));
+        std::vector<uint8_t> bufferB(bufferA.size());
+        result = cppbmpfile::bmp_file::load(filename, bufferA.data(), bufferA.size(), propsA);
+        CHECK(result);
+        result = cppbmpfile::bmp_file::load(data.data(), data.size(), bufferB.data(), bufferB.size(), propsB);
+        CHECK(result);
+        CHECK(bufferA == bufferB);
+
+        // flipped with different padding
+        propsA.orientation = propsB.orientation = cppbmpfile::orientation_type::top_down;
+        propsA.line_padding = propsB.line_padding = 7;
+        bufferA.resize(cppbmpfile::bmp_file::compute_buffer_size(propsA));
+        bufferB.resize(bufferA.size());
+        result = cppbmpfile::bmp_file::load(filename, bufferA.data(), bufferA.size(), propsA, true, true);
+        CHECK(result);
+        result = cppbmpfile::bmp_file::load(data.data(), data.size(), bufferB.data(), bufferB.size(), propsB, true, true);
+        CHECK(result);
+        CHECK(bufferA == bufferB);
+
+        // truncated data, the last two bytes are padding
+        result = cppbmpfile::bmp_file::load(data.data(), data.size() - 3, bufferB.data(), bufferB.size(), propsB);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_read_error);
+        result = cppbmpfile::bmp_file::load(data.data(), 10, propsB);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::not_a_bmp_file);
+    }
+}
+
+TEST_CASE("test load from memory invalid arguments", "[cpp_bmp_file]")
+{
+    cppbmpfile::image_properties props;
+    cppbmpfile::operation_result result;
+    std::vector<uint8_t> data = read_test_file(TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp");
+    std::vector<uint8_t> buffer((test_file_width + test_file_padding) * test_file_height);
+
+    result = cppbmpfile::bmp_file::load(static_cast<const void*>(nullptr), data.size(), props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+
+    result = cppbmpfile::bmp_file::load(static_cast<const void*>(nullptr), data.size(), buffer.data(), buffer.size(), props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+
+    result = cppbmpfile::bmp_file::load(data.data(), data.size(), nullptr, buffer.size(), props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+
+    result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer.data(), 10, props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+
+    props.orientation = cppbmpfile::orientation_type::invalid;
+    result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer.data(), buffer.size(), props, false, true);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+
+    // the magnitude of the smallest height cannot be represented
+    const int32_t smallest_height = INT32_MIN;
+    std::memcpy(&data[22], &smallest_height, sizeof(smallest_height));
+    result = cppbmpfile::bmp_file::load(data.data(), data.size(), props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::corrupt);
+}
+
+TEST_CASE("test save to memory", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp"
+    };
+    for (const char* filename : filenames)
+    {
+        cppbmpfile::image_properties propsA;
+        cppbmpfile::image_properties propsB;
+        cppbmpfile::operation_result result;
+        result = cppbmpfile::bmp_file::load(filename, propsA);
+        CHECK(result);
+        std::vector<uint8_t> bufferA(cppbmpfile::bmp_file::compute_buffer_size(propsA));
+        result = cppbmpfile::bmp_file::load(filename, bufferA.data(), bufferA.size(), propsA);
+        CHECK(result);
+
+        size_t file_size = cppbmpfile::bmp_file::compute_file_size(propsA);
+        CHECK(file_size == read_test_file(filename).size());
+        std::vector<uint8_t> data(file_size);
+        result = cppbmpfile::bmp_file::save_to_memory(data.data(), data.size() - 1, bufferA.data(), bufferA.size(), propsA);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+        result = cppbmpfile::bmp_file::save_to_memory(data.data(), data.size(), bufferA.data(), bufferA.size(), propsA);
+        CHECK(result);
+
+        // the file written must match the memory content
+        result = cppbmpfile::bmp_file::save("memory_out.bmp", bufferA.data(), bufferA.size(), propsA);
+        CHECK(result);
+        CHECK(read_test_file("memory_out.bmp") == data);
+
+        std::vector<uint8_t> bufferB(bufferA.size());
+        result = cppbmpfile::bmp_file::load(data.data(), data.size(), bufferB.data(), bufferB.size(), propsB);
+        CHECK(result);
+        CHECK(bufferA == bufferB);
+
+        // top down, resizing vector
+        std::vector<uint8_t> data_top_down;
+        propsA.orientation = cppbmpfile::orientation_type::top_down;
+        result = cppbmpfile::bmp_file::save_to_memory(data_top_down, bufferA.data(), bufferA.size(), propsA, false);
+        CHECK(result);
+        CHECK(data_top_down.size() == file_size);
+        result = cppbmpfile::bmp_file::load(data_top_down.data(), data_top_down.size(), bufferB.data(), bufferB.size(), propsB);
+        CHECK(result);
+        CHECK(propsB.orientation == cppbmpfile::orientation_type::top_down);
+        CHECK(bufferA == bufferB);
+    }
+}
+
+TEST_CASE("test save to memory invalid arguments", "[cpp_bmp_file]")
+{
+    cppbmpfile::image_properties props;
+    cppbmpfile::operation_result result;
+    props.height = test_file_height;
+    props.width = test_file_width;
+    props.pixel_format = cppbmpfile::pixel_format_type::Mono8;
+    props.orientation = cppbmpfile::orientation_type::bottom_up;
+    props.line_padding = test_file_padding;
+    std::vector<uint8_t> buffer(cppbmpfile::bmp_file::compute_buffer_size(props));
+    std::vector<uint8_t> data(cppbmpfile::bmp_file::compute_file_size(props));
+    CHECK(data.size() == 54 + 1024 + (test_file_width + test_file_padding) * test_file_height);
+
+    result = cppbmpfile::bmp_file::save_to_memory(nullptr, data.size(), buffer.data(), buffer.size(), props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+    result = cppbmpfile::bmp_file::save_to_memory(data.data(), data.size(), nullptr, buffer.size(), props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+    result = cppbmpfile::bmp_file::save_to_memory(data.data(), data.size(), buffer.data(), 10, props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+
+    props.width = 0;
+    CHECK(cppbmpfile::bmp_file::compute_file_size(props) == 0);
+    result = cppbmpfile::bmp_file::save_to_memory(data, buffer.data(), buffer.size(), props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    CHECK(data.empty());
+}
+
+TEST_CASE("test save in chunks", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp"
+    };
+    for (const char* filename : filenames)
+    {
+        cppbmpfile::image_properties props;
+        cppbmpfile::operation_result result;
+        result = cppbmpfile::bmp_file::load(filename, props);
+        CHECK(result);
+        std::vector<uint8_t> buffer(cppbmpfile::bmp_file::compute_buffer_size(props));
+        result = cppbmpfile::bmp_file::load(filename, buffer.data(), buffer.size(), props);
+        CHECK(result);
+
+        cppbmpfile::save_options options;
+        for (bool run_length_encoding : { false, true })
+        {
+            if (run_length_encoding)
+            {
+                options.pixel_format = cppbmpfile::pixel_format_type::Mono8;
+            }
+            options.run_length_encoding = run_length_encoding;
+            std::vector<uint8_t> data;
+            result = cppbmpfile::bmp_file::save_to_memory(data, buffer.data(), buffer.size(), props, true, options);
+            CHECK(result);
+
+            // the chunk size must not change the content of the file
+            for (size_t chunk_size : { 0, 1, 3, 54, 1000, 4096, 1 << 20 })
+            {
+                options.chunk_size = chunk_size;
+                result = cppbmpfile::bmp_file::save("chunk_out.bmp", buffer.data(), buffer.size(), props, true, options);
+                CHECK(result);
+                CHECK(read_test_file("chunk_out.bmp") == data);
+            }
+            options.chunk_size = cppbmpfile::save_options().chunk_size;
+        }
+    }
+}
+
+TEST_CASE("test asynchronous load and save", "[cpp_bmp_file]")
+{
+    const char* filename = TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp";
+    cppbmpfile::image_properties props;
+    std::vector<uint8_t> expected;
+    cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(filename, expected, props);
+    CHECK(result);
+
+    // several operations in flight
+    std::vector<uint8_t> buffers[4];
+    cppbmpfile::image_properties properties[4];
+    std::vector<std::future<cppbmpfile::operation_result>> loads;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        loads.push_back(cppbmpfile::bmp_file::load_async(filename, buffers[i], properties[i]));
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+        CHECK(loads[i].get());
+        CHECK(buffers[i] == expected);
+        CHECK(properties[i].width == props.width);
+    }
+
+    auto save = cppbmpfile::bmp_file::save_async("async_out.bmp", expected.data(), expected.size(), props);
+    CHECK(save.get());
+    std::vector<uint8_t> data;
+    result = cppbmpfile::bmp_file::save_to_memory(data, expected.data(), expected.size(), props);
+    CHECK(result);
+    CHECK(read_test_file("async_out.bmp") == data);
+
+    std::vector<uint8_t> buffer(expected.size());
+    cppbmpfile::image_properties loaded_props;
+    result = cppbmpfile::bmp_file::load_async("async_out.bmp", buffer.data(), buffer.size(), loaded_props).get();
+    CHECK(result);
+    CHECK(buffer == expected);
+
+    // errors are reported by the future
+    result = cppbmpfile::bmp_file::load_async("does_not_exist.bmp", buffer, loaded_props).get();
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+    result = cppbmpfile::bmp_file::save_async(static_cast<const char*>(nullptr), expected.data(), expected.size(), props).get();
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+
+    // the destructor of the future waits until the borrowed buffer is released
+    buffer.clear();
+    {
+        auto dropped = cppbmpfile::bmp_file::load_async(filename, buffer, loaded_props);
+    }
+    CHECK(buffer == expected);
+}
+
+TEST_CASE("test save queue", "[cpp_bmp_file]")
+{
+    const char* filename = TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp";
+    cppbmpfile::image_properties props;
+    std::vector<uint8_t> pixels;
+    cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(filename, pixels, props);
+    CHECK(result);
+    std::vector<uint8_t> expected;
+    result = cppbmpfile::bmp_file::save_to_memory(expected, pixels.data(), pixels.size(), props);
+    CHECK(result);
+
+    SECTION("several producers")
+    {
+        std::atomic<size_t> recycled(0);
+        const size_t frame_count = 40;
+        {
+            cppbmpfile::bmp_save_queue queue(8, 2, [&recycled](cppbmpfile::save_queue_job& job, const cppbmpfile::operation_result& job_result)
+            {
+                if (job_result && !job.pixels.empty())
+                {
+                    ++recycled;
+                }
+            });
+            CHECK(queue.thread_count() == 2);
+            auto produce = [&queue, &pixels, &props](size_t first)
+            {
+                for (size_t frame = first; frame < frame_count; frame += 2)
+                {
+                    cppbmpfile::save_queue_job job;
+                    job.filename = "queue_out_" + std::to_string(frame) + ".bmp";
+                    job.pixels = pixels;
+                    job.properties = props;
+                    queue.push(job);
+                }
+            };
+            std::thread producer(produce, 0);
+            produce(1);
+            producer.join();
+            queue.wait();
+            const cppbmpfile::save_queue_statistics statistics = queue.statistics();
+            CHECK(statistics.queued == frame_count);
+            CHECK(statistics.saved == frame_count);
+            CHECK(statistics.failed == 0);
+            CHECK(statistics.dropped == 0);
+            CHECK(statistics.depth == 0);
+            CHECK(statistics.max_depth >= 1);
+            CHECK(statistics.max_depth <= 8 + 2 + 2); // pending, in progress and being pushed
+        }
+        CHECK(recycled == frame_count);
+        for (size_t frame = 0; frame < frame_count; ++frame)
+        {
+            CHECK(read_test_file(("queue_out_" + std::to_string(frame) + ".bmp").c_str()) == expected);
+        }
+    }
+
+    SECTION("drops when full")
+    {
+        // the completion handler holds the only worker until the test releases it
+        std::atomic<bool> release(false);
+        cppbmpfile::bmp_save_queue queue(2, 1, [&release](cppbmpfile::save_queue_job&, const cppbmpfile::operation_result&)
+        {
+            while (!release)
+            {
+                std::this_thread::yield();
+            }
+        });
+        size_t accepted = 0;
+        size_t dropped = 0;
+        for (size_t frame = 0; frame < 10; ++frame)
+        {
+            cppbmpfile::save_queue_job job;
+            job.filename = "queue_drop_out.bmp";
+            job.pixels = pixels;
+            job.properties = props;
+            result = queue.try_push(job);
+            if (result)
+            {
+                ++accepted;
+                CHECK(job.pixels.empty());
+            }
+            else
+            {
+                ++dropped;
+                CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::queue_full);
+                CHECK(job.pixels == pixels);
+            }
+        }
+        // two pending jobs and at most one taken by the worker
+        CHECK(accepted >= 2);
+        CHECK(accepted <= 3);
+        CHECK(queue.statistics().dropped == dropped);
+        release = true;
+        queue.wait();
+        CHECK(queue.statistics().saved == accepted);
+    }
+
+    SECTION("failures are counted")
+    {
+        cppbmpfile::bmp_save_queue queue;
+        cppbmpfile::save_queue_job job;
+        job.filename = "queue_invalid_out.bmp";
+        job.properties = props; // no pixels
+        CHECK(queue.try_push(job));
+        queue.wait();
+        CHECK(queue.statistics().failed == 1);
+    }
+    SECTION("no workers")
+    {
+        cppbmpfile::bmp_save_queue queue(8, 0);
+        CHECK(queue.thread_count() == 0);
+        cppbmpfile::save_queue_job job;
+        job.filename = "queue_no_workers_out.bmp";
+        job.pixels = pixels;
+        job.properties = props;
+        result = queue.try_push(job);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::thread_start_error);
+        result = queue.push(job);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::thread_start_error);
+        CHECK(job.pixels == pixels);
+        queue.wait();
+        CHECK(queue.statistics().queued == 0);
+    }
+
+    SECTION("blocking pushes")
+    {
+        const size_t frame_count = 20;
+        cppbmpfile::bmp_save_queue queue(2, 1);
+        for (size_t frame = 0; frame < frame_count; ++frame)
+        {
+            cppbmpfile::save_queue_job job;
+            job.filename = "queue_blocking_out.bmp";
+            job.pixels = pixels;
+            job.properties = props;
+            CHECK(queue.push(job));
+        }
+        queue.wait();
+        CHECK(queue.statistics().saved == frame_count);
+        CHECK(queue.statistics().dropped == 0);
+    }
+}
+
+TEST_CASE("test load single pass", "[cpp_bmp_file]")
+{
+    const char* filename = TEST_DATA_ROOT_PATH "/testimages/256_color.bmp";
+    cppbmpfile::image_properties propsA;
+    cppbmpfile::image_properties propsB;
+    cppbmpfile::image_properties propsC;
+    cppbmpfile::operation_result result;
+    result = cppbmpfile::bmp_file::load(filename, propsA);
+    CHECK(result);
+    std::vector<uint8_t> bufferA(cppbmpfile::bmp_file::compute_buffer_size(propsA));
+    result = cppbmpfile::bmp_file::load(filename, bufferA.data(), bufferA.size(), propsA);
+    CHECK(result);
+
+    std::vector<uint8_t> bufferB;
+    result = cppbmpfile::bmp_file::load(filename, bufferB, propsB);
+    CHECK(result);
+    CHECK(propsB.pixel_format == propsA.pixel_format);
+    CHECK(bufferA == bufferB);
+
+    std::vector<uint8_t> data = read_test_file(filename);
+    std::vector<uint8_t> bufferC;
+    result = cppbmpfile::bmp_file::load(data.data(), data.size(), bufferC, propsC);
+    CHECK(result);
+    CHECK(bufferA == bufferC);
+
+    size_t requested_size = 0;
+    std::vector<uint8_t> bufferD;
+    result = cppbmpfile::bmp_file::load(filename, [&](size_t size) -> void* { requested_size = size; bufferD.resize(size); return bufferD.data(); }, propsC);
+    CHECK(result);
+    CHECK(requested_size == bufferA.size());
+    CHECK(bufferA == bufferD);
+
+    result = cppbmpfile::bmp_file::load(filename, [](size_t) -> void* { return nullptr; }, propsC);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+    result = cppbmpfile::bmp_file::load(filename, std::function<void*(size_t)>(), propsC);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/NotThere.bmp", bufferB, propsB);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+    CHECK(bufferB.empty());
+}
+
+TEST_CASE("test load truncated oversized image", "[cpp_bmp_file]")
+{
+    // only the header of a BGRA8 file claiming a huge image, the pixels must not be allocated
+    const char* filename = "truncated_oversized.bmp";
+    const int32_t sizes[] = { 40000, INT32_MAX };
+    for (int32_t size : sizes)
+    {
+        std::vector<uint8_t> data = read_test_file(TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp");
+        data.resize(54);
+        const uint32_t image_size_bytes = 0;
+        std::memcpy(&data[18], &size, sizeof(size));
+        std::memcpy(&data[22], &size, sizeof(size));
+        std::memcpy(&data[34], &image_size_bytes, sizeof(image_size_bytes));
+        {
+            std::ofstream file(filename, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        }
+
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> buffer;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_read_error);
+        CHECK(buffer.empty());
+        result = cppbmpfile::bmp_file::load(filename, buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_read_error);
+        CHECK(buffer.empty());
+
+        cppbmpfile::bmp_decoder decoder;
+        result = decoder.load(data.data(), data.size(), buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_read_error);
+        CHECK(buffer.empty());
+    }
+    std::remove(filename);
+}
+
+TEST_CASE("test mapped file", "[cpp_bmp_file]")
+{
+    cppbmpfile::bmp_mapped_file mapped_file;
+    cppbmpfile::operation_result result;
+    CHECK(!mapped_file.is_open());
+
+    result = mapped_file.open(TEST_DATA_ROOT_PATH "/testimages/NotThere.bmp");
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+    result = mapped_file.open(TEST_DATA_ROOT_PATH "/testimages/TooSmall.bmp");
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::not_a_bmp_file);
+    CHECK(!mapped_file.is_open());
+    result = mapped_file.open((const char*)nullptr);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+
+    const char* raw_filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp"
+    };
+    for (const char* filename : raw_filenames)
+    {
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> buffer;
+        result = cppbmpfile::bmp_file::load(filename, buffer, props);
+        CHECK(result);
+
+        result = mapped_file.open(filename);
+        CHECK(result);
+        CHECK(mapped_file.is_open());
+        CHECK(mapped_file.properties().width == props.width);
+        CHECK(mapped_file.properties().height == props.height);
+        CHECK(mapped_file.properties().pixel_format == props.pixel_format);
+        CHECK(mapped_file.properties().orientation == props.orientation);
+        CHECK(mapped_file.properties().line_padding == props.line_padding);
+        const uint8_t* p_pixels = reinterpret_cast<const uint8_t*>(mapped_file.pixels());
+        REQUIRE(p_pixels != nullptr);
+        CHECK(std::vector<uint8_t>(p_pixels, p_pixels + buffer.size()) == buffer);
+    }
+
+    const char* converted_filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8_non_linear.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/256_color.bmp"
+    };
+    for (const char* filename : converted_filenames)
+    {
+        cppbmpfile::image_properties propsA;
+        cppbmpfile::image_properties propsB;
+        std::vector<uint8_t> bufferA;
+        result = cppbmpfile::bmp_file::load(filename, bufferA, propsA);
+        CHECK(result);
+
+        result = mapped_file.open(filename);
+        CHECK(result);
+        CHECK(mapped_file.pixels() == nullptr);
+        std::vector<uint8_t> bufferB(bufferA.size());
+        result = mapped_file.load(bufferB.data(), bufferB.size(), propsB);
+        CHECK(result);
+        CHECK(bufferA == bufferB);
+    }
+
+    mapped_file.close();
+    CHECK(!mapped_file.is_open());
+    CHECK(mapped_file.pixels() == nullptr);
+    std::vector<uint8_t> buffer(10);
+    cppbmpfile::image_properties props;
+    result = mapped_file.load(buffer.data(), buffer.size(), props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+}
+
+TEST_CASE("test probe", "[cpp_bmp_file]")
+{
+    cppbmpfile::bmp_probe probe;
+    cppbmpfile::image_properties props;
+    cppbmpfile::operation_result result;
+    CHECK(!probe.is_open());
+    result = probe.properties(props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+
+    result = probe.open(TEST_DATA_ROOT_PATH "/testimages/NotThere.bmp");
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+    result = probe.open(TEST_DATA_ROOT_PATH "/testimages/TooSmall.bmp");
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::not_a_bmp_file);
+    CHECK(!probe.is_open());
+    result = probe.open((const char*)nullptr);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/Mono8_flipped.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/Mono8_non_linear.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/256_color.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8_flipped.bmp"
+    };
+    for (const char* filename : filenames)
+    {
+        cppbmpfile::image_properties expected;
+        result = cppbmpfile::bmp_file::load(filename, expected);
+        CHECK(result);
+        const std::vector<uint8_t> data = read_test_file(filename);
+
+        for (bool from_memory : { false, true })
+        {
+            result = from_memory ? probe.open(data.data(), data.size()) : probe.open(filename);
+            CHECK(result);
+            CHECK(probe.is_open());
+            CHECK(probe.width() == expected.width);
+            CHECK(probe.height() == expected.height);
+            CHECK(probe.orientation() == expected.orientation);
+            CHECK(probe.bits_per_pixel() == (data[28] | data[29] << 8));
+            CHECK(probe.data_offset() == static_cast<uint32_t>(data[10] | data[11] << 8));
+            CHECK(probe.compression() == 0);
+
+            // classified on the first call only
+            for (int call = 0; call < 2; ++call)
+            {
+                result = probe.properties(props);
+                CHECK(result);
+                CHECK(props.width == expected.width);
+                CHECK(props.height == expected.height);
+                CHECK(props.pixel_format == expected.pixel_format);
+                CHECK(props.orientation == expected.orientation);
+                CHECK(props.line_padding == expected.line_padding);
+            }
+            cppbmpfile::load_options options;
+            options.pixel_format = cppbmpfile::pixel_format_type::RGBA8;
+            result = probe.properties(props, options);
+            CHECK(result);
+            CHECK(props.pixel_format == cppbmpfile::pixel_format_type::RGBA8);
+        }
+    }
+
+    // a header without its color table
+    const std::vector<uint8_t> data = read_test_file(TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp");
+    result = probe.open(data.data(), 60);
+    CHECK(result);
+    result = probe.properties(props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_read_error);
+    result = probe.open(data.data(), 20);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::not_a_bmp_file);
+    CHECK(!probe.is_open());
+}
+
+TEST_CASE("test load flipped with the line padding of the file", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/Mono8_non_linear.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/256_color.bmp"
+    };
+    for (const char* filename : filenames)
+    {
+        cppbmpfile::image_properties propsA;
+        cppbmpfile::image_properties propsB;
+        cppbmpfile::operation_result result;
+        std::vector<uint8_t> bufferA;
+        std::vector<uint8_t> bufferB;
+        result = cppbmpfile::bmp_file::load(filename, bufferA, propsA);
+        CHECK(result);
+        propsB.orientation = cppbmpfile::orientation_type::top_down;
+        result = cppbmpfile::bmp_file::load(filename, bufferB, propsB, false, true);
+        CHECK(result);
+        REQUIRE(bufferA.size() == bufferB.size());
+        const size_t stride = bufferA.size() / propsA.height;
+        for (size_t line = 0; line < propsA.height; ++line)
+        {
+            const uint8_t* p_line_a = bufferA.data() + line * stride;
+            const uint8_t* p_line_b = bufferB.data() + (propsA.height - line - 1) * stride;
+            CHECK(std::vector<uint8_t>(p_line_a, p_line_a + stride - propsA.line_padding) == std::vector<uint8_t>(p_line_b, p_line_b + stride - propsA.line_padding));
+        }
+    }
+}
+
+TEST_CASE("test load color table expansion", "[cpp_bmp_file]")
+{
+    std::vector<uint32_t> color_table(256);
+    for (size_t i = 0; i < color_table.size(); ++i)
+    {
+        color_table[i] = static_cast<uint32_t>(i * 0x010203 + 0x805030) & 0xFFFFFF;
+    }
+    for (int32_t width = 1; width < 70; ++width)
+    {
+        const int32_t height = 3;
+        const size_t stride_in_file = (width + 3) / 4 * 4;
+        std::vector<uint8_t> pixel_data(stride_in_file * height);
+        for (size_t i = 0; i < pixel_data.size(); ++i)
+        {
+            pixel_data[i] = static_cast<uint8_t>(i * 37 + width);
+        }
+        std::vector<uint8_t> data = create_test_bmp(8, width, height, color_table, pixel_data);
+
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> buffer;
+        props.line_padding = 0;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props, true);
+        REQUIRE(result);
+        CHECK(props.pixel_format == cppbmpfile::pixel_format_type::BGR8);
+        REQUIRE(buffer.size() == static_cast<size_t>(width * height * 3));
+        for (int32_t line = 0; line < height; ++line)
+        {
+            for (int32_t column = 0; column < width; ++column)
+            {
+                const uint32_t entry = color_table[pixel_data[line * stride_in_file + column]];
+                const uint8_t* p_pixel = buffer.data() + (line * width + column) * 3;
+                if (p_pixel[0] != (entry & 0xFF) || p_pixel[1] != ((entry >> 8) & 0xFF) || p_pixel[2] != (entry >> 16))
+                {
+                    CHECK(p_pixel[0] == (entry & 0xFF));
+                    CHECK(p_pixel[1] == ((entry >> 8) & 0xFF));
+                    CHECK(p_pixel[2] == (entry >> 16));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("test load indices beyond a small color table", "[cpp_bmp_file]")
+{
+    std::vector<uint32_t> color_table = { 0x102030, 0x405060 };
+    std::vector<uint8_t> pixel_data = { 0, 1, 200, 0 };
+    std::vector<uint8_t> data = create_test_bmp(8, 3, 1, color_table, pixel_data);
+    cppbmpfile::image_properties props;
+    std::vector<uint8_t> buffer;
+    cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+    REQUIRE(result);
+    CHECK(props.pixel_format == cppbmpfile::pixel_format_type::BGR8);
+    std::vector<uint8_t> expected = { 0x30, 0x20, 0x10, 0x60, 0x50, 0x40, 0, 0, 0 };
+    buffer.resize(expected.size());
+    CHECK(buffer == expected);
+}
+
+TEST_CASE("test load mono8 lookup table", "[cpp_bmp_file]")
+{
+    std::vector<uint32_t> color_table(256);
+    for (size_t i = 0; i < color_table.size(); ++i)
+    {
+        color_table[i] = static_cast<uint32_t>((255 - i) * 0x010101);
+    }
+    for (int32_t width = 1; width < 140; ++width)
+    {
+        const int32_t height = 2;
+        const size_t stride_in_file = (width + 3) / 4 * 4;
+        std::vector<uint8_t> pixel_data(stride_in_file * height);
+        for (size_t i = 0; i < pixel_data.size(); ++i)
+        {
+            pixel_data[i] = static_cast<uint8_t>(i * 13 + width);
+        }
+        std::vector<uint8_t> data = create_test_bmp(8, width, height, color_table, pixel_data);
+
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> buffer;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+        REQUIRE(result);
+        CHECK(props.pixel_format == cppbmpfile::pixel_format_type::Mono8);
+        REQUIRE(buffer.size() == pixel_data.size());
+        for (int32_t line = 0; line < height; ++line)
+        {
+            for (int32_t column = 0; column < width; ++column)
+            {
+                const size_t offset = line * stride_in_file + column;
+                if (buffer[offset] != 255 - pixel_data[offset])
+                {
+                    CHECK(static_cast<int>(buffer[offset]) == 255 - pixel_data[offset]);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("test reader", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/Mono8_non_linear.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/256_color.bmp"
+    };
+    const cppbmpfile::orientation_type orientations[] = { cppbmpfile::orientation_type::bottom_up, cppbmpfile::orientation_type::top_down };
+    for (const char* filename : filenames)
+    {
+        for (cppbmpfile::orientation_type orientation : orientations)
+        {
+            for (size_t line_padding = 0; line_padding < 3; ++line_padding)
+            {
+                cppbmpfile::image_properties propsA;
+                cppbmpfile::image_properties propsB;
+                cppbmpfile::operation_result result;
+                propsA.orientation = propsB.orientation = orientation;
+                propsA.line_padding = propsB.line_padding = line_padding;
+                std::vector<uint8_t> bufferA;
+                result = cppbmpfile::bmp_file::load(filename, bufferA, propsA, true, true);
+                CHECK(result);
+
+                cppbmpfile::bmp_reader reader;
+                result = reader.open(filename, propsB, true, true);
+                CHECK(result);
+                CHECK(reader.is_open());
+                CHECK(reader.remaining_lines() == propsA.height);
+                const size_t stride = bufferA.size() / propsA.height;
+                const size_t strip_line_count = 7;
+                std::vector<uint8_t> strip(strip_line_count * stride);
+                std::vector<uint8_t> bufferB;
+                size_t lines_read = 0;
+                do
+                {
+                    result = reader.read_lines(strip.data(), strip.size(), strip_line_count, lines_read);
+                    CHECK(result);
+                    bufferB.insert(bufferB.end(), strip.begin(), strip.begin() + lines_read * stride);
+                } while (result && lines_read == strip_line_count);
+                CHECK(reader.remaining_lines() == 0);
+                CHECK(bufferA == bufferB);
+
+                // read the last line again
+                result = reader.seek_line(propsA.height - 1);
+                CHECK(result);
+                result = reader.read_lines(strip.data(), strip.size(), strip_line_count, lines_read);
+                CHECK(result);
+                CHECK(lines_read == 1);
+                CHECK(std::equal(strip.begin(), strip.begin() + stride, bufferA.end() - stride));
+            }
+        }
+    }
+}
+
+TEST_CASE("test reader invalid arguments", "[cpp_bmp_file]")
+{
+    cppbmpfile::bmp_reader reader;
+    cppbmpfile::image_properties props;
+    cppbmpfile::operation_result result;
+    std::vector<uint8_t> buffer(10);
+    size_t lines_read = 0;
+
+    result = reader.read_lines(buffer.data(), buffer.size(), 1, lines_read);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    result = reader.open(TEST_DATA_ROOT_PATH "/testimages/NotThere.bmp", props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+    result = reader.open(TEST_DATA_ROOT_PATH "/testimages/TooSmall.bmp", props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::not_a_bmp_file);
+    CHECK(!reader.is_open());
+
+    result = reader.open(TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp", props);
+    CHECK(result);
+    result = reader.read_lines(nullptr, buffer.size(), 1, lines_read);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+    result = reader.read_lines(buffer.data(), buffer.size(), 1, lines_read);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+    CHECK(lines_read == 0);
+    result = reader.seek_line(props.height + 1);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+}
+
+TEST_CASE("test writer", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp"
+    };
+    const cppbmpfile::orientation_type orientations[] = { cppbmpfile::orientation_type::bottom_up, cppbmpfile::orientation_type::top_down };
+    for (const char* filename : filenames)
+    {
+        for (cppbmpfile::orientation_type orientation : orientations)
+        {
+            for (int force_bottom_up = 0; force_bottom_up < 2; ++force_bottom_up)
+            {
+                cppbmpfile::image_properties props;
+                cppbmpfile::operation_result result;
+                props.orientation = orientation;
+                props.line_padding = 5;
+                std::vector<uint8_t> buffer;
+                result = cppbmpfile::bmp_file::load(filename, buffer, props, true, true);
+                CHECK(result);
+                result = cppbmpfile::bmp_file::save("writer_expected.bmp", buffer.data(), buffer.size(), props, force_bottom_up != 0);
+                CHECK(result);
+
+                cppbmpfile::bmp_writer writer;
+                result = writer.open("writer_out.bmp", props, force_bottom_up != 0);
+                CHECK(result);
+                const size_t stride = buffer.size() / props.height;
+                const size_t strip_line_count = 7;
+                while (result && writer.remaining_lines())
+                {
+                    const size_t line_count = std::min(strip_line_count, writer.remaining_lines());
+                    const size_t offset = writer.current_line() * stride;
+                    result = writer.write_lines(buffer.data() + offset, buffer.size() - offset, line_count);
+                    CHECK(result);
+                }
+                result = writer.finish();
+                CHECK(result);
+                CHECK(!writer.is_open());
+                CHECK(read_test_file("writer_out.bmp") == read_test_file("writer_expected.bmp"));
+            }
+        }
+    }
+}
+
+TEST_CASE("test writer invalid arguments", "[cpp_bmp_file]")
+{
+    cppbmpfile::bmp_writer writer;
+    cppbmpfile::image_properties props;
+    cppbmpfile::operation_result result;
+    std::vector<uint8_t> buffer(test_file_width * 2);
+
+    result = writer.write_lines(buffer.data(), buffer.size(), 1);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    result = writer.finish();
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    result = writer.open("writer_invalid.bmp", props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+
+    props.height = test_file_height;
+    props.width = test_file_width;
+    props.pixel_format = cppbmpfile::pixel_format_type::Mono8;
+    props.orientation = cppbmpfile::orientation_type::top_down;
+    result = writer.open("writer_invalid.bmp", props);
+    CHECK(result);
+    result = writer.write_lines(nullptr, buffer.size(), 1);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+    result = writer.write_lines(buffer.data(), buffer.size(), 3);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+    result = writer.write_lines(buffer.data(), buffer.size(), 2);
+    CHECK(result);
+    CHECK(writer.current_line() == 2);
+    result = writer.finish();
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::incomplete);
+    CHECK(!writer.is_open());
+}
+
+TEST_CASE("test load batch", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/256_color.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/Mono8_flipped.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/NotThere.bmp"
+    };
+    for (size_t thread_count = 0; thread_count < 4; ++thread_count)
+    {
+        std::vector<cppbmpfile::batch_load_job> jobs;
+        for (const char* filename : filenames)
+        {
+            cppbmpfile::batch_load_job job;
+            job.filename = filename;
+            jobs.push_back(job);
+        }
+        std::vector<uint8_t> caller_buffer(test_file_width * test_file_height * 4);
+        jobs[2].buffer = caller_buffer.data();
+        jobs[2].buffer_size = caller_buffer.size();
+        jobs[4].properties.orientation = cppbmpfile::orientation_type::top_down;
+        jobs[4].force_orientation = true;
+
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load_batch(jobs, thread_count);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+
+        for (const cppbmpfile::batch_load_job& job : jobs)
+        {
+            cppbmpfile::image_properties props = job.properties;
+            std::vector<uint8_t> expected;
+            cppbmpfile::operation_result expected_result = cppbmpfile::bmp_file::load(job.filename.c_str(), expected, props, false, job.force_orientation);
+            CHECK(job.result.operator cppbmpfile::operation_result_type() == expected_result.operator cppbmpfile::operation_result_type());
+            if (!expected_result)
+            {
+                CHECK(job.pixels.empty());
+                continue;
+            }
+            CHECK(job.properties.width == props.width);
+            CHECK(job.properties.height == props.height);
+            CHECK(job.properties.pixel_format == props.pixel_format);
+            CHECK(job.properties.orientation == props.orientation);
+            if (job.buffer != nullptr)
+            {
+                CHECK(job.pixels.empty());
+                CHECK(std::equal(expected.begin(), expected.end(), static_cast<const uint8_t*>(job.buffer)));
+            }
+            else
+            {
+                CHECK(job.pixels == expected);
+            }
+        }
+    }
+
+    std::vector<cppbmpfile::batch_load_job> no_jobs;
+    CHECK(cppbmpfile::bmp_file::load_batch(no_jobs));
+
+    for (size_t thread_count = 1; thread_count < 4; ++thread_count)
+    {
+        std::vector<cppbmpfile::batch_load_job> jobs(8);
+        for (cppbmpfile::batch_load_job& job : jobs)
+        {
+            job.filename = TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp";
+        }
+
+        // pixels that cannot be allocated are reported in the results
+        test_allocation_limit = test_file_width * test_file_height - 1;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load_batch(jobs, thread_count);
+        test_allocation_limit = SIZE_MAX;
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+        for (const cppbmpfile::batch_load_job& job : jobs)
+        {
+            CHECK(job.result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+        }
+
+        // an exception thrown on a worker, here by allocating the color table, is rethrown by the calling thread
+        bool thrown = false;
+        test_allocation_limit = 256 * 4 - 1;
+        try
+        {
+            cppbmpfile::bmp_file::load_batch(jobs, thread_count);
+        }
+        catch (const std::bad_alloc&)
+        {
+            thrown = true;
+        }
+        test_allocation_limit = SIZE_MAX;
+        CHECK(thrown);
+    }
+}
+
+TEST_CASE("test load pixel format conversion", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/Mono8_non_linear.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/256_color.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8_flipped.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8_flipped.bmp"
+    };
+    const cppbmpfile::pixel_format_type pixel_formats[] = {
+        cppbmpfile::pixel_format_type::Mono8,
+        cppbmpfile::pixel_format_type::BGR8,
+        cppbmpfile::pixel_format_type::BGRA8,
+        cppbmpfile::pixel_format_type::RGB8,
+        cppbmpfile::pixel_format_type::RGBA8
+    };
+    const cppbmpfile::orientation_type orientations[] = { cppbmpfile::orientation_type::bottom_up, cppbmpfile::orientation_type::top_down };
+    for (const char* filename : filenames)
+    {
+        cppbmpfile::image_properties file_props;
+        std::vector<uint8_t> file_pixels;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(filename, file_pixels, file_props);
+        REQUIRE(result);
+        for (cppbmpfile::pixel_format_type pixel_format : pixel_formats)
+        {
+            for (cppbmpfile::orientation_type orientation : orientations)
+            {
+                cppbmpfile::load_options options;
+                options.pixel_format = pixel_format;
+                cppbmpfile::image_properties props;
+                props.orientation = orientation;
+                std::vector<uint8_t> pixels;
+                result = cppbmpfile::bmp_file::load(filename, pixels, props, false, true, options);
+                CHECK(result);
+                CHECK(props.pixel_format == pixel_format);
+                CHECK((props.width * test_byte_per_pixel(pixel_format) + props.line_padding) % 4 == 0);
+                CHECK(props.line_padding < 4);
+                CHECK(pixels.size() == cppbmpfile::bmp_file::compute_buffer_size(props));
+
+                // compare without padding
+                props.line_padding = 0;
+                std::vector<uint8_t> unpadded;
+                result = cppbmpfile::bmp_file::load(filename, unpadded, props, true, true, options);
+                CHECK(result);
+                CHECK(unpadded == convert_test_image(file_pixels, file_props, props));
+
+                cppbmpfile::image_properties properties_only;
+                result = cppbmpfile::bmp_file::load(filename, properties_only, options);
+                CHECK(result);
+                CHECK(properties_only.pixel_format == pixel_format);
+                CHECK(cppbmpfile::bmp_file::compute_buffer_size(properties_only) == pixels.size());
+            }
+        }
+    }
+
+    // the reader converts strips of lines
+    cppbmpfile::load_options options;
+    options.pixel_format = cppbmpfile::pixel_format_type::RGBA8;
+    cppbmpfile::image_properties props;
+    std::vector<uint8_t> expected;
+    cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", expected, props, false, false, options);
+    CHECK(result);
+    cppbmpfile::bmp_reader reader;
+    result = reader.open(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", props, false, false, options);
+    CHECK(result);
+    std::vector<uint8_t> pixels(expected.size());
+    size_t lines_read = 0;
+    result = reader.read_lines(pixels.data(), pixels.size(), props.height, lines_read);
+    CHECK(result);
+    CHECK(lines_read == props.height);
+    CHECK(pixels == expected);
+}
+
+TEST_CASE("test save pixel format conversion", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/256_color.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8_flipped.bmp"
+    };
+    const cppbmpfile::pixel_format_type pixel_formats[] = {
+        cppbmpfile::pixel_format_type::Mono8,
+        cppbmpfile::pixel_format_type::BGR8,
+        cppbmpfile::pixel_format_type::BGRA8,
+        cppbmpfile::pixel_format_type::RGB8,
+        cppbmpfile::pixel_format_type::RGBA8
+    };
+    const cppbmpfile::pixel_format_type file_pixel_formats[] = {
+        cppbmpfile::pixel_format_type::invalid,
+        cppbmpfile::pixel_format_type::Mono8,
+        cppbmpfile::pixel_format_type::BGR8,
+        cppbmpfile::pixel_format_type::BGRA8
+    };
+    for (const char* filename : filenames)
+    {
+        for (cppbmpfile::pixel_format_type pixel_format : pixel_formats)
+        {
+            cppbmpfile::load_options load_options;
+            load_options.pixel_format = pixel_format;
+            cppbmpfile::image_properties props;
+            std::vector<uint8_t> pixels;
+            cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(filename, pixels, props, false, false, load_options);
+            REQUIRE(result);
+
+            for (cppbmpfile::pixel_format_type file_pixel_format : file_pixel_formats)
+            {
+                cppbmpfile::save_options options;
+                options.pixel_format = file_pixel_format;
+                std::vector<uint8_t> data;
+                result = cppbmpfile::bmp_file::save_to_memory(data, pixels.data(), pixels.size(), props, true, options);
+                CHECK(result);
+                CHECK(data.size() == cppbmpfile::bmp_file::compute_file_size(props, options));
+
+                cppbmpfile::image_properties expected_props = props;
+                expected_props.line_padding = 0;
+                if (file_pixel_format != cppbmpfile::pixel_format_type::invalid)
+                {
+                    expected_props.pixel_format = file_pixel_format;
+                }
+                else if (pixel_format == cppbmpfile::pixel_format_type::RGB8)
+                {
+                    expected_props.pixel_format = cppbmpfile::pixel_format_type::BGR8;
+                }
+                else if (pixel_format == cppbmpfile::pixel_format_type::RGBA8)
+                {
+                    expected_props.pixel_format = cppbmpfile::pixel_format_type::BGRA8;
+                }
+                cppbmpfile::image_properties saved_props = expected_props;
+                std::vector<uint8_t> saved_pixels;
+                result = cppbmpfile::bmp_file::load(data.data(), data.size(), saved_pixels, saved_props, true, true);
+                CHECK(result);
+                CHECK(saved_props.pixel_format == expected_props.pixel_format);
+                CHECK(saved_pixels == convert_test_image(pixels, props, expected_props));
+
+                // the writer converts strips of lines
+                cppbmpfile::bmp_writer writer;
+                result = writer.open("writer_converted_out.bmp", props, true, options);
+                CHECK(result);
+                const size_t stride = pixels.size() / props.height;
+                while (result && writer.remaining_lines())
+                {
+                    const size_t line_count = std::min(static_cast<size_t>(7), writer.remaining_lines());
+                    const size_t offset = writer.current_line() * stride;
+                    result = writer.write_lines(pixels.data() + offset, pixels.size() - offset, line_count);
+                    CHECK(result);
+                }
+                CHECK(writer.finish());
+                CHECK(read_test_file("writer_converted_out.bmp") == data);
+            }
+        }
+    }
+
+    // only the pixel formats of BMP files can be stored
+    cppbmpfile::image_properties props;
+    std::vector<uint8_t> pixels;
+    cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", pixels, props);
+    CHECK(result);
+    cppbmpfile::save_options options;
+    options.pixel_format = cppbmpfile::pixel_format_type::RGB8;
+    std::vector<uint8_t> data;
+    result = cppbmpfile::bmp_file::save_to_memory(data, pixels.data(), pixels.size(), props, true, options);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    CHECK(cppbmpfile::bmp_file::compute_file_size(props, options) == 0);
+    cppbmpfile::bmp_writer writer;
+    result = writer.open("writer_invalid.bmp", props, true, options);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    result = cppbmpfile::bmp_file::save("RGB8_out.bmp", pixels.data(), pixels.size(), props, true, options);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+}
+
+/// Scales the masked bits of a pixel to 8 bit as reference for the bit field decoding.
+inline uint8_t scale_test_bit_field(uint32_t pixel, uint32_t mask, uint8_t missing_value)
+{
+    if (mask == 0)
+    {
+        return missing_value;
+    }
+    uint32_t bits = 0;
+    while ((mask & 1) == 0)
+    {
+        mask >>= 1;
+        pixel >>= 1;
+    }
+    for (; mask != 0; mask >>= 1)
+    {
+        ++bits;
+    }
+    uint32_t value = pixel & ((1u << bits) - 1);
+    if (bits > 8)
+    {
+        value >>= bits - 8;
+        bits = 8;
+    }
+    const uint32_t max_value = (1u << bits) - 1;
+    return static_cast<uint8_t>((value * 255 + max_value / 2) / max_value);
+}
+
+TEST_CASE("test load packed and bit field pixels", "[cpp_bmp_file]")
+{
+    const int32_t width = 300; // more than one chunk of unpacked pixels
+    const int32_t height = 3;
+    uint32_t random = 12345;
+    std::vector<uint8_t> random_data(width * 4 * height);
+    for (uint8_t& value : random_data)
+    {
+        random = random * 1103515245 + 12345;
+        value = static_cast<uint8_t>(random >> 16);
+    }
+
+    SECTION("1 bit indices")
+    {
+        const size_t stride = (width + 31) / 32 * 4;
+        const std::vector<uint8_t> pixel_data(random_data.begin(), random_data.begin() + stride * height);
+        const std::vector<uint8_t> data = create_test_bmp(1, width, height, { 0x000000, 0xFFFFFF }, pixel_data);
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> buffer;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+        CHECK(result);
+        CHECK(props.pixel_format == cppbmpfile::pixel_format_type::Mono8);
+        CHECK(props.line_padding == 0);
+        CHECK(buffer.size() == static_cast<size_t>(width * height));
+        for (int32_t line = 0; line < height; ++line)
+        {
+            for (int32_t column = 0; column < width; ++column)
+            {
+                const bool bit = ((pixel_data[line * stride + column / 8] >> (7 - column % 8)) & 1) != 0;
+                CHECK(buffer[line * width + column] == (bit ? 255 : 0));
+            }
+        }
+    }
+
+    SECTION("4 bit indices")
+    {
+        const size_t stride = (width * 4 + 31) / 32 * 4;
+        const std::vector<uint8_t> pixel_data(random_data.begin(), random_data.begin() + stride * height);
+        std::vector<uint32_t> color_table;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            color_table.push_back(i * 0x0F0301);
+        }
+        const std::vector<uint8_t> data = create_test_bmp(4, width, height, color_table, pixel_data);
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> buffer;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+        CHECK(result);
+        CHECK(props.pixel_format == cppbmpfile::pixel_format_type::BGR8);
+        CHECK(props.line_padding == 0);
+        for (int32_t line = 0; line < height; ++line)
+        {
+            for (int32_t column = 0; column < width; ++column)
+            {
+                const uint8_t value = pixel_data[line * stride + column / 2];
+                const uint32_t entry = color_table[column % 2 == 0 ? value >> 4 : value & 0x0F];
+                const uint8_t* p_pixel = buffer.data() + (line * width + column) * 3;
+                CHECK(p_pixel[0] == static_cast<uint8_t>(entry));
+                CHECK(p_pixel[1] == static_cast<uint8_t>(entry >> 8));
+                CHECK(p_pixel[2] == static_cast<uint8_t>(entry >> 16));
+            }
+        }
+    }
+
+    SECTION("bit fields")
+    {
+        struct bit_field_case
+        {
+            uint16_t bits_per_pixel;
+            uint32_t compression;
+            uint32_t masks[4];
+            cppbmpfile::pixel_format_type pixel_format;
+        };
+        const bit_field_case cases[] = {
+            { 16, 0, { 0x7C00, 0x03E0, 0x001F, 0 }, cppbmpfile::pixel_format_type::BGR8 },
+            { 16, 3, { 0xF800, 0x07E0, 0x001F, 0 }, cppbmpfile::pixel_format_type::BGR8 },
+            { 16, 6, { 0x0F00, 0x00F0, 0x000F, 0xF000 }, cppbmpfile::pixel_format_type::BGRA8 },
+            { 32, 3, { 0x00FF0000, 0x0000FF00, 0x000000FF, 0 }, cppbmpfile::pixel_format_type::BGRA8 },
+            { 32, 6, { 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000 }, cppbmpfile::pixel_format_type::BGRA8 },
+            { 32, 6, { 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000 }, cppbmpfile::pixel_format_type::BGRA8 },
+            { 32, 3, { 0x3FF00000, 0x000FFC00, 0x000003FF, 0 }, cppbmpfile::pixel_format_type::BGRA8 }
+        };
+        for (const bit_field_case& test_case : cases)
+        {
+            const size_t byte_per_pixel = test_case.bits_per_pixel / 8;
+            const size_t stride = (width * byte_per_pixel + 3) / 4 * 4;
+            const std::vector<uint8_t> pixel_data(random_data.begin(), random_data.begin() + stride * height);
+            const size_t mask_count = test_case.compression == 6 ? 4 : test_case.compression == 3 ? 3 : 0;
+            const std::vector<uint32_t> masks(test_case.masks, test_case.masks + mask_count);
+            std::vector<uint8_t> data = create_test_bmp(test_case.bits_per_pixel, width, height, masks, pixel_data, test_case.compression);
+            data[46] = 0; // the masks are no color table entries
+
+            cppbmpfile::image_properties props;
+            std::vector<uint8_t> buffer;
+            cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+            CHECK(result);
+            CHECK(props.pixel_format == test_case.pixel_format);
+            const size_t byte_per_pixel_in_buffer = test_case.pixel_format == cppbmpfile::pixel_format_type::BGRA8 ? 4 : 3;
+            const size_t stride_in_buffer = width * byte_per_pixel_in_buffer + props.line_padding;
+            CHECK(stride_in_buffer % 4 == 0);
+            bool equal = true;
+            for (int32_t line = 0; line < height; ++line)
+            {
+                for (int32_t column = 0; column < width; ++column)
+                {
+                    uint32_t pixel = 0;
+                    memcpy(&pixel, pixel_data.data() + line * stride + column * byte_per_pixel, byte_per_pixel);
+                    const uint8_t* p_pixel = buffer.data() + line * stride_in_buffer + column * byte_per_pixel_in_buffer;
+                    equal = equal && p_pixel[0] == scale_test_bit_field(pixel, test_case.masks[2], 0);
+                    equal = equal && p_pixel[1] == scale_test_bit_field(pixel, test_case.masks[1], 0);
+                    equal = equal && p_pixel[2] == scale_test_bit_field(pixel, test_case.masks[0], 0);
+                    if (byte_per_pixel_in_buffer == 4)
+                    {
+                        // without an alpha mask, e.g., X8R8G8B8, the pixels are opaque
+                        equal = equal && p_pixel[3] == scale_test_bit_field(pixel, test_case.masks[3], 255);
+                    }
+                }
+            }
+            CHECK(equal);
+
+            // the unpacked pixels are converted further
+            cppbmpfile::load_options options;
+            options.pixel_format = cppbmpfile::pixel_format_type::RGBA8;
+            cppbmpfile::image_properties converted_props;
+            std::vector<uint8_t> converted;
+            result = cppbmpfile::bmp_file::load(data.data(), data.size(), converted, converted_props, false, false, options);
+            CHECK(result);
+            CHECK(converted == convert_test_image(buffer, props, converted_props));
+            options.pixel_format = cppbmpfile::pixel_format_type::BGR8;
+            result = cppbmpfile::bmp_file::load(data.data(), data.size(), converted, converted_props, false, false, options);
+            CHECK(result);
+            CHECK(converted == convert_test_image(buffer, props, converted_props));
+        }
+    }
+
+    SECTION("invalid bit fields")
+    {
+        const std::vector<uint8_t> pixel_data(random_data.begin(), random_data.begin() + width * 2 * height);
+        std::vector<uint8_t> data = create_test_bmp(16, width, height, { 0xF0F0, 0x0F00, 0x000F }, pixel_data, 3);
+        data[46] = 0;
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> buffer;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::corrupt);
+
+        const std::vector<uint8_t> pixel_data_24(random_data.begin(), random_data.begin() + width * 3 * height);
+        data = create_test_bmp(24, width, height, { 0xFF0000, 0x00FF00, 0x0000FF }, pixel_data_24, 3);
+        data[46] = 0;
+        result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::unsupported_compression);
+    }
+}
+
+TEST_CASE("test run length encoding", "[cpp_bmp_file]")
+{
+    SECTION("save load mono8")
+    {
+        const cppbmpfile::orientation_type orientations[] = { cppbmpfile::orientation_type::bottom_up, cppbmpfile::orientation_type::top_down };
+        for (cppbmpfile::orientation_type orientation : orientations)
+        {
+            cppbmpfile::image_properties props;
+            props.orientation = orientation;
+            std::vector<uint8_t> pixels;
+            cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp", pixels, props, false, true);
+            REQUIRE(result);
+            // flat areas, short runs and single pixels, the padding stays zero
+            const size_t stride = props.width + props.line_padding;
+            for (size_t i = 0; i < pixels.size() / 2; ++i)
+            {
+                pixels[i] = i % stride < props.width ? static_cast<uint8_t>(i / 1000) : 0;
+            }
+
+            cppbmpfile::save_options options;
+            options.run_length_encoding = true;
+            std::vector<uint8_t> data;
+            result = cppbmpfile::bmp_file::save_to_memory(data, pixels.data(), pixels.size(), props, false, options);
+            CHECK(result);
+            CHECK(data.size() <= cppbmpfile::bmp_file::compute_file_size(props, options));
+            uint32_t compression = 0;
+            memcpy(&compression, data.data() + 30, sizeof(compression));
+            CHECK(compression == 1);
+
+            cppbmpfile::image_properties loaded_props;
+            loaded_props.orientation = orientation;
+            std::vector<uint8_t> loaded;
+            result = cppbmpfile::bmp_file::load(data.data(), data.size(), loaded, loaded_props, false, true);
+            CHECK(result);
+            CHECK(loaded_props.pixel_format == cppbmpfile::pixel_format_type::Mono8);
+            CHECK(loaded == pixels);
+
+            // the pixels are converted before encoding
+            cppbmpfile::save_options mono8_options = options;
+            mono8_options.pixel_format = cppbmpfile::pixel_format_type::Mono8;
+            cppbmpfile::load_options load_options;
+            load_options.pixel_format = cppbmpfile::pixel_format_type::BGR8;
+            cppbmpfile::image_properties bgr8_props;
+            std::vector<uint8_t> bgr8;
+            result = cppbmpfile::bmp_file::load(data.data(), data.size(), bgr8, bgr8_props, false, false, load_options);
+            CHECK(result);
+            std::vector<uint8_t> bgr8_data;
+            result = cppbmpfile::bmp_file::save_to_memory(bgr8_data, bgr8.data(), bgr8.size(), bgr8_props, true, mono8_options);
+            CHECK(result);
+            CHECK(bgr8_data == data);
+
+            const char* filename = "run_length_encoded.bmp";
+            result = cppbmpfile::bmp_file::save(filename, pixels.data(), pixels.size(), props, true, options);
+            CHECK(result);
+            CHECK(read_test_file(filename) == data);
+        }
+    }
+
+    SECTION("flat images are small")
+    {
+        cppbmpfile::image_properties props;
+        props.width = 1000;
+        props.height = 1000;
+        props.pixel_format = cppbmpfile::pixel_format_type::Mono8;
+        props.line_padding = 0;
+        std::vector<uint8_t> pixels(props.width * props.height, 0);
+        std::fill(pixels.begin() + pixels.size() / 2, pixels.end(), static_cast<uint8_t>(255));
+        cppbmpfile::save_options options;
+        options.run_length_encoding = true;
+        std::vector<uint8_t> data;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::save_to_memory(data, pixels.data(), pixels.size(), props, true, options);
+        CHECK(result);
+        CHECK(data.size() * 50 < pixels.size());
+        std::vector<uint8_t> loaded;
+        result = cppbmpfile::bmp_file::load(data.data(), data.size(), loaded, props, true);
+        CHECK(result);
+        CHECK(loaded == pixels);
+    }
+
+    SECTION("decode rle8")
+    {
+        // a run, a delta, absolute mode with padding and an end of bitmap before the last line
+        const std::vector<uint8_t> pixel_data = {
+            3, 1, 0, 2, 1, 1, 1, 2, 0, 0,
+            0, 3, 3, 4, 5, 0, 1, 2, 0, 0,
+            0, 1
+        };
+        const std::vector<uint8_t> data = create_test_bmp(8, 6, 4, { 0x000000, 0x101010, 0x202020, 0x303030, 0x404040, 0x505050 }, pixel_data, 1);
+        cppbmpfile::image_properties props;
+        props.line_padding = 0;
+        std::vector<uint8_t> buffer;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props, true);
+        CHECK(result);
+        CHECK(props.pixel_format == cppbmpfile::pixel_format_type::Mono8);
+        CHECK(props.orientation == cppbmpfile::orientation_type::bottom_up);
+        const std::vector<uint8_t> expected = {
+            0x10, 0x10, 0x10, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x20, 0x00,
+            0x30, 0x40, 0x50, 0x20, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        };
+        CHECK(buffer == expected);
+
+        // the decoded lines are flipped into the orientation of the buffer
+        props.orientation = cppbmpfile::orientation_type::top_down;
+        result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props, true, true);
+        CHECK(result);
+        for (size_t line = 0; line < 4; ++line)
+        {
+            CHECK(std::equal(buffer.begin() + line * 6, buffer.begin() + line * 6 + 6, expected.begin() + (3 - line) * 6));
+        }
+    }
+
+    SECTION("decode rle4")
+    {
+        // runs alternate between two indices, absolute mode holds two indices per byte
+        const std::vector<uint8_t> pixel_data = {
+            5, 0x12, 0, 0,
+            0, 3, 0x34, 0x50, 2, 0x66, 0, 0
+        };
+        std::vector<uint32_t> color_table;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            color_table.push_back(i * 0x111111);
+        }
+        const std::vector<uint8_t> data = create_test_bmp(4, 5, 2, color_table, pixel_data, 2);
+        cppbmpfile::image_properties props;
+        props.line_padding = 0;
+        std::vector<uint8_t> buffer;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props, true);
+        CHECK(result);
+        CHECK(props.pixel_format == cppbmpfile::pixel_format_type::Mono8);
+        const std::vector<uint8_t> expected = {
+            0x11, 0x22, 0x11, 0x22, 0x11,
+            0x33, 0x44, 0x55, 0x66, 0x66
+        };
+        CHECK(buffer == expected);
+    }
+
+    SECTION("invalid data")
+    {
+        const std::vector<uint8_t> truncated = { 3, 1, 0, 0, 0, 3, 1 };
+        std::vector<uint8_t> data = create_test_bmp(8, 6, 4, { 0x000000, 0xFFFFFF }, truncated, 1);
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> buffer;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::corrupt);
+
+        // the size of the compressed data is required
+        const std::vector<uint8_t> pixel_data = { 0, 1 };
+        data = create_test_bmp(8, 6, 4, { 0x000000, 0xFFFFFF }, pixel_data, 1);
+        data[34] = 0;
+        result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::corrupt);
+
+        // RLE8 is limited to 8 bit and RLE4 to 4 bit indices
+        data = create_test_bmp(4, 6, 4, { 0x000000, 0xFFFFFF }, pixel_data, 1);
+        result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::unsupported_compression);
+
+        // the reader can not decode strips of lines
+        data = create_test_bmp(8, 6, 4, { 0x000000, 0xFFFFFF }, pixel_data, 1);
+        std::ofstream file("run_length_encoded_reader.bmp", std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        file.close();
+        cppbmpfile::bmp_reader reader;
+        result = reader.open("run_length_encoded_reader.bmp", props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::unsupported_compression);
+    }
+
+    SECTION("invalid options")
+    {
+        cppbmpfile::image_properties props;
+        props.width = 10;
+        props.height = 10;
+        props.pixel_format = cppbmpfile::pixel_format_type::BGR8;
+        props.line_padding = 2;
+        std::vector<uint8_t> pixels(32 * 10);
+        cppbmpfile::save_options options;
+        options.run_length_encoding = true;
+        std::vector<uint8_t> data;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::save_to_memory(data, pixels.data(), pixels.size(), props, true, options);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+        CHECK(cppbmpfile::bmp_file::compute_file_size(props, options) == 0);
+
+        options.pixel_format = cppbmpfile::pixel_format_type::Mono8;
+        result = cppbmpfile::bmp_file::save_to_memory(data, pixels.data(), pixels.size(), props, true, options);
+        CHECK(result);
+
+        cppbmpfile::bmp_writer writer;
+        result = writer.open("run_length_encoded_writer.bmp", props, true, options);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+
+        // the size in the worst case does not fit in the header, the uncompressed file does
+        props.width = 50000;
+        props.height = 50000;
+        props.pixel_format = cppbmpfile::pixel_format_type::Mono8;
+        props.line_padding = 0;
+        CHECK(cppbmpfile::bmp_file::compute_file_size(props, options) == 0);
+        result = cppbmpfile::bmp_file::save_to_memory(data.data(), data.size(), pixels.data(), pixels.size(), props, true, options);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+        options.run_length_encoding = false;
+        CHECK(cppbmpfile::bmp_file::compute_file_size(props, options) == 1078 + size_t(50000) * 50000);
+    }
+}
+
+TEST_CASE("test load region", "[cpp_bmp_file]")
+{
+    std::vector<std::vector<uint8_t>> files = {
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp"),
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/Mono8_flipped.bmp"),
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp"),
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/BGRA8_flipped.bmp"),
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/256_color.bmp")
+    };
+    // packed indices, bit fields and run length encoded indices of the same size
+    uint32_t random = 12345;
+    std::vector<uint8_t> random_data(test_file_width * 2 * test_file_height);
+    for (uint8_t& value : random_data)
+    {
+        random = random * 1103515245 + 12345;
+        value = static_cast<uint8_t>(random >> 16);
+    }
+    files.push_back(create_test_bmp(1, static_cast<int32_t>(test_file_width), static_cast<int32_t>(test_file_height), { 0x000000, 0xFFFFFF }, random_data));
+    files.push_back(create_test_bmp(4, static_cast<int32_t>(test_file_width), -static_cast<int32_t>(test_file_height), { 0x000000, 0x00FF00, 0x0000FF, 0xFF0000 }, random_data));
+    files.push_back(create_test_bmp(16, static_cast<int32_t>(test_file_width), static_cast<int32_t>(test_file_height), {}, random_data));
+    {
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> pixels;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(files[0].data(), files[0].size(), pixels, props);
+        REQUIRE(result);
+        cppbmpfile::save_options options;
+        options.run_length_encoding = true;
+        files.emplace_back();
+        result = cppbmpfile::bmp_file::save_to_memory(files.back(), pixels.data(), pixels.size(), props, true, options);
+        REQUIRE(result);
+    }
+
+    std::vector<cppbmpfile::image_region> regions(5);
+    regions[0].width = test_file_width;
+    regions[0].height = test_file_height;
+    regions[1].x = 1;
+    regions[1].y = 2;
+    regions[1].width = 3;
+    regions[1].height = 4;
+    regions[2].x = 5;
+    regions[2].y = 7;
+    regions[2].width = 50;
+    regions[2].height = 60;
+    regions[3].x = test_file_width - 1;
+    regions[3].y = test_file_height - 1;
+    regions[3].width = 1;
+    regions[3].height = 1;
+    regions[4].x = 3;
+    regions[4].width = 21;
+    regions[4].height = test_file_height;
+    const cppbmpfile::orientation_type orientations[] = { cppbmpfile::orientation_type::bottom_up, cppbmpfile::orientation_type::top_down };
+    const cppbmpfile::pixel_format_type pixel_formats[] = { cppbmpfile::pixel_format_type::invalid, cppbmpfile::pixel_format_type::RGBA8 };
+    for (const std::vector<uint8_t>& data : files)
+    {
+        for (cppbmpfile::orientation_type orientation : orientations)
+        {
+            for (cppbmpfile::pixel_format_type pixel_format : pixel_formats)
+            {
+                cppbmpfile::load_options options;
+                options.pixel_format = pixel_format;
+                cppbmpfile::image_properties full_props;
+                full_props.orientation = orientation;
+                std::vector<uint8_t> full;
+                cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), full, full_props, false, true, options);
+                REQUIRE(result);
+
+                for (const cppbmpfile::image_region& region : regions)
+                {
+                    options.region = region;
+                    cppbmpfile::image_properties props;
+                    props.orientation = orientation;
+                    std::vector<uint8_t> buffer;
+                    result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props, false, true, options);
+                    CHECK(result);
+                    CHECK(props.width == region.width);
+                    CHECK(props.height == region.height);
+                    CHECK(props.pixel_format == full_props.pixel_format);
+                    CHECK((region.width * test_byte_per_pixel(props.pixel_format) + props.line_padding) % 4 == 0);
+                    CHECK(buffer == crop_test_image(full, full_props, region, props.line_padding));
+                }
+            }
+        }
+    }
+
+    // the size of the region is returned without loading the pixels
+    cppbmpfile::load_options options;
+    options.region = regions[2];
+    cppbmpfile::image_properties props;
+    cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", props, options);
+    CHECK(result);
+    CHECK(props.width == regions[2].width);
+    CHECK(props.height == regions[2].height);
+    CHECK(props.line_padding == 2);
+
+    // the lines of a region are read from a file
+    std::vector<uint8_t> full;
+    cppbmpfile::image_properties full_props;
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", full, full_props);
+    REQUIRE(result);
+    std::vector<uint8_t> buffer(cppbmpfile::bmp_file::compute_buffer_size(props));
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", buffer.data(), buffer.size(), props, false, false, options);
+    CHECK(result);
+    CHECK(buffer == crop_test_image(full, full_props, regions[2], props.line_padding));
+
+    cppbmpfile::bmp_reader reader;
+    result = reader.open(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", props, false, false, options);
+    CHECK(result);
+    std::vector<uint8_t> lines(buffer.size());
+    size_t lines_read = 0;
+    result = reader.read_lines(lines.data(), lines.size(), props.height, lines_read);
+    CHECK(result);
+    CHECK(lines_read == props.height);
+    CHECK(lines == buffer);
+
+    // the region needs to be inside the image
+    options.region.x = test_file_width - 2;
+    options.region.width = 3;
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", props, options);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    CHECK(props.width == 0);
+    options.region = regions[2];
+    options.region.y = test_file_height;
+    std::vector<uint8_t> pixels;
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", pixels, props, false, false, options);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    CHECK(pixels.empty());
+}
+
+TEST_CASE("test load downscaled", "[cpp_bmp_file]")
+{
+    std::vector<std::vector<uint8_t>> files = {
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp"),
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/BGR8_flipped.bmp"),
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp"),
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/256_color.bmp")
+    };
+    {
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> pixels;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(files[0].data(), files[0].size(), pixels, props);
+        REQUIRE(result);
+        cppbmpfile::save_options options;
+        options.run_length_encoding = true;
+        files.emplace_back();
+        result = cppbmpfile::bmp_file::save_to_memory(files.back(), pixels.data(), pixels.size(), props, true, options);
+        REQUIRE(result);
+    }
+
+    const uint32_t factors[] = { 2, 3, 8 };
+    const cppbmpfile::downscale_filter_type filters[] = { cppbmpfile::downscale_filter_type::decimate, cppbmpfile::downscale_filter_type::box };
+    const cppbmpfile::orientation_type orientations[] = { cppbmpfile::orientation_type::bottom_up, cppbmpfile::orientation_type::top_down };
+    const cppbmpfile::pixel_format_type pixel_formats[] = { cppbmpfile::pixel_format_type::invalid, cppbmpfile::pixel_format_type::RGBA8 };
+    cppbmpfile::image_region region;
+    region.x = 3;
+    region.y = 5;
+    region.width = 37;
+    region.height = 41;
+    const cppbmpfile::image_region regions[] = { cppbmpfile::image_region(), region };
+    for (const std::vector<uint8_t>& data : files)
+    {
+        for (cppbmpfile::orientation_type orientation : orientations)
+        {
+            for (cppbmpfile::pixel_format_type pixel_format : pixel_formats)
+            {
+                for (const cppbmpfile::image_region& full_region : regions)
+                {
+                    cppbmpfile::load_options options;
+                    options.pixel_format = pixel_format;
+                    options.region = full_region;
+                    cppbmpfile::image_properties full_props;
+                    full_props.orientation = orientation;
+                    std::vector<uint8_t> full;
+                    cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), full, full_props, false, true, options);
+                    REQUIRE(result);
+
+                    for (uint32_t factor : factors)
+                    {
+                        for (cppbmpfile::downscale_filter_type filter : filters)
+                        {
+                            options.downscale_factor = factor;
+                            options.downscale_filter = filter;
+                            cppbmpfile::image_properties props;
+                            props.orientation = orientation;
+                            std::vector<uint8_t> buffer;
+                            result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props, false, true, options);
+                            CHECK(result);
+                            CHECK(props.width == full_props.width / factor);
+                            CHECK(props.height == full_props.height / factor);
+                            CHECK((props.width * test_byte_per_pixel(props.pixel_format) + props.line_padding) % 4 == 0);
+                            CHECK(buffer == downscale_test_image(full, full_props, factor, filter == cppbmpfile::downscale_filter_type::box, props.line_padding));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // the reader returns strips of downscaled lines
+    cppbmpfile::load_options options;
+    options.downscale_factor = 4;
+    options.downscale_filter = cppbmpfile::downscale_filter_type::box;
+    cppbmpfile::image_properties props;
+    std::vector<uint8_t> buffer;
+    cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", buffer, props, false, false, options);
+    CHECK(result);
+    cppbmpfile::bmp_reader reader;
+    result = reader.open(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", props, false, false, options);
+    CHECK(result);
+    std::vector<uint8_t> lines(buffer.size());
+    const size_t stride = buffer.size() / props.height;
+    while (result && reader.remaining_lines())
+    {
+        const size_t offset = reader.current_line() * stride;
+        size_t lines_read = 0;
+        result = reader.read_lines(lines.data() + offset, lines.size() - offset, 7, lines_read);
+        CHECK(result);
+    }
+    CHECK(lines == buffer);
+
+    // the factor needs to leave at least one pixel
+    options.downscale_factor = 0;
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", props, options);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    options.downscale_factor = test_file_width + 1;
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", buffer, props, false, false, options);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    CHECK(buffer.empty());
+}
+
+TEST_CASE("test decoder", "[cpp_bmp_file]")
+{
+    std::vector<std::vector<uint8_t>> files = {
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/256_color.bmp"),
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/BGR8_flipped.bmp"),
+        read_test_file(TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp")
+    };
+    {
+        cppbmpfile::image_properties props;
+        std::vector<uint8_t> pixels;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(files[2].data(), files[2].size(), pixels, props);
+        REQUIRE(result);
+        cppbmpfile::save_options options;
+        options.run_length_encoding = true;
+        files.emplace_back();
+        result = cppbmpfile::bmp_file::save_to_memory(files.back(), pixels.data(), pixels.size(), props, true, options);
+        REQUIRE(result);
+    }
+    std::vector<cppbmpfile::load_options> options(4);
+    options[1].pixel_format = cppbmpfile::pixel_format_type::RGBA8;
+    options[1].region.x = 3;
+    options[1].region.y = 4;
+    options[1].region.width = 50;
+    options[1].region.height = 60;
+    options[2].downscale_factor = 3;
+    options[2].downscale_filter = cppbmpfile::downscale_filter_type::box;
+    options[3].thread_count = 3; // the scratch memory of the bands is kept as well
+
+    cppbmpfile::bmp_decoder decoder;
+    std::vector<uint8_t> buffer;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (const std::vector<uint8_t>& data : files)
+        {
+            for (const cppbmpfile::load_options& load_options : options)
+            {
+                cppbmpfile::image_properties expected_props;
+                std::vector<uint8_t> expected;
+                cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(data.data(), data.size(), expected, expected_props, false, false, load_options);
+                REQUIRE(result);
+
+                // the scratch memory and the buffer have grown in the first pass, clearing keeps the capacity and zeroes the padding
+                cppbmpfile::image_properties props;
+                buffer.clear();
+                const size_t allocation_count = test_allocation_count;
+                result = decoder.load(data.data(), data.size(), buffer, props, false, false, load_options);
+                if (pass == 1 && load_options.thread_count == 1)
+                {
+                    // starting threads allocates their state
+                    CHECK(test_allocation_count == allocation_count);
+                }
+                CHECK(result);
+                CHECK(buffer == expected);
+            }
+        }
+    }
+
+    // the buffer may be provided by a pool
+    std::vector<uint8_t> pool(test_file_width * 4 * test_file_height);
+    cppbmpfile::image_properties props;
+    cppbmpfile::operation_result result = decoder.load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp",
+        [&pool](size_t size) -> void* { return size <= pool.size() ? pool.data() : nullptr; }, props);
+    CHECK(result);
+    std::vector<uint8_t> expected;
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", expected, props);
+    CHECK(result);
+    CHECK(std::equal(expected.begin(), expected.end(), pool.begin()));
+    result = decoder.load(files[0].data(), files[0].size(), [](size_t) -> void* { return nullptr; }, props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+
+    decoder.release_memory();
+    result = decoder.load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", buffer, props);
+    CHECK(result);
+    CHECK(buffer == expected);
+    result = decoder.load(static_cast<const char*>(nullptr), buffer, props);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+}
+
+TEST_CASE("test load and save by several threads", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/256_color.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGR8_flipped.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/Mono8_non_linear.bmp"
+    };
+    std::vector<cppbmpfile::load_options> options(4);
+    options[1].pixel_format = cppbmpfile::pixel_format_type::RGB8;
+    options[2].region.x = 3;
+    options[2].region.y = 4;
+    options[2].region.width = 50;
+    options[2].region.height = 61;
+    options[3].downscale_factor = 3;
+    options[3].downscale_filter = cppbmpfile::downscale_filter_type::box;
+
+    for (const char* filename : filenames)
+    {
+        const std::vector<uint8_t> data = read_test_file(filename);
+        for (cppbmpfile::load_options load_options : options)
+        {
+            for (bool flip : { false, true })
+            {
+                cppbmpfile::image_properties expected_props;
+                std::vector<uint8_t> expected;
+                cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(filename, expected_props, load_options);
+                REQUIRE(result);
+                if (flip)
+                {
+                    expected_props.orientation = expected_props.orientation == cppbmpfile::orientation_type::top_down ? cppbmpfile::orientation_type::bottom_up : cppbmpfile::orientation_type::top_down;
+                }
+                result = cppbmpfile::bmp_file::load(filename, expected, expected_props, false, flip, load_options);
+                REQUIRE(result);
+
+                // more threads than lines leave some threads without a band
+                for (size_t thread_count : { 0, 2, 3, 7, 1000 })
+                {
+                    load_options.thread_count = thread_count;
+                    cppbmpfile::image_properties props = expected_props;
+                    std::vector<uint8_t> buffer;
+                    result = cppbmpfile::bmp_file::load(filename, buffer, props, false, flip, load_options);
+                    CHECK(result);
+                    CHECK(buffer == expected);
+                    buffer.clear();
+                    result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props, false, flip, load_options);
+                    CHECK(result);
+                    CHECK(buffer == expected);
+                }
+                load_options.thread_count = 1;
+
+                std::vector<cppbmpfile::save_options> all_save_options(3);
+                all_save_options[1].pixel_format = cppbmpfile::pixel_format_type::Mono8;
+                all_save_options[2].pixel_format = cppbmpfile::pixel_format_type::Mono8;
+                all_save_options[2].run_length_encoding = true;
+                for (cppbmpfile::save_options save_options : all_save_options)
+                {
+                    for (bool force_bottom_up : { false, true })
+                    {
+                        std::vector<uint8_t> expected_file;
+                        result = cppbmpfile::bmp_file::save_to_memory(expected_file, expected.data(), expected.size(), expected_props, force_bottom_up, save_options);
+                        REQUIRE(result);
+                        for (size_t thread_count : { 0, 3, 1000 })
+                        {
+                            save_options.thread_count = thread_count;
+                            std::vector<uint8_t> file;
+                            result = cppbmpfile::bmp_file::save_to_memory(file, expected.data(), expected.size(), expected_props, force_bottom_up, save_options);
+                            CHECK(result);
+                            CHECK(file == expected_file);
+                            result = cppbmpfile::bmp_file::save("threads_out.bmp", expected.data(), expected.size(), expected_props, force_bottom_up, save_options);
+                            CHECK(result);
+                            CHECK(read_test_file("threads_out.bmp") == expected_file);
+                            // several pieces per band
+                            cppbmpfile::save_options piece_options = save_options;
+                            piece_options.chunk_size = 100;
+                            result = cppbmpfile::bmp_file::save("threads_out.bmp", expected.data(), expected.size(), expected_props, force_bottom_up, piece_options);
+                            CHECK(result);
+                            CHECK(read_test_file("threads_out.bmp") == expected_file);
+                        }
+                        save_options.thread_count = 1;
+                    }
+                }
+            }
+        }
+    }
+
+    cppbmpfile::load_options load_options;
+    load_options.thread_count = 4;
+    cppbmpfile::image_properties props;
+    std::vector<uint8_t> buffer;
+    cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/NotThere.bmp", buffer, props, false, false, load_options);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/TooSmall.bmp", buffer, props, false, false, load_options);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::not_a_bmp_file);
+    // 9 lines in bands of 3 lines leave the fourth band empty, it must not be loaded past the end of the buffer
+    cppbmpfile::load_options region_options;
+    region_options.region.x = 1;
+    region_options.region.y = 2;
+    region_options.region.width = 40;
+    region_options.region.height = 9;
+    std::vector<uint8_t> expected;
+    REQUIRE(cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", expected, props, false, false, region_options));
+    region_options.thread_count = 4;
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", buffer, props, false, false, region_options);
+    CHECK(result);
+    CHECK(buffer == expected);
+
+    // an exception thrown by a band, here by allocating a piece of 25 lines, is rethrown by the calling thread
+    REQUIRE(cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp", buffer, props));
+    cppbmpfile::save_options save_options;
+    save_options.thread_count = 4;
+    bool thrown = false;
+    test_allocation_limit = cppbmpfile::bmp_file::compute_buffer_size(props) / props.height * 25 - 1;
+    try
+    {
+        cppbmpfile::bmp_file::save("bands_out.bmp", buffer.data(), buffer.size(), props, true, save_options);
+    }
+    catch (const std::bad_alloc&)
+    {
+        thrown = true;
+    }
+    test_allocation_limit = SIZE_MAX;
+    CHECK(thrown);
+    std::remove("bands_out.bmp");
+}
+
+TEST_CASE("test statistics", "[cpp_bmp_file]")
+{
+    cppbmpfile::operation_statistics statistics;
+    cppbmpfile::load_options load_options;
+    load_options.statistics = &statistics;
+    cppbmpfile::image_properties props;
+    std::vector<uint8_t> buffer;
+
+    const char* filename = TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp";
+    cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(filename, buffer, props, false, false, load_options);
+    REQUIRE(result);
+    CHECK(statistics.bytes_read == 54 + 1024 + buffer.size() - props.line_padding); // the padding of the last line is not read
+    CHECK(statistics.read_calls == 3); // header, color table and pixels
+    CHECK(statistics.open_nanoseconds > 0);
+    CHECK(statistics.header_nanoseconds > 0);
+    CHECK(statistics.color_table_nanoseconds > 0);
+    CHECK(statistics.pixel_nanoseconds > 0);
+    CHECK(statistics.read_nanoseconds > 0);
+    CHECK(statistics.bulk_reads == 1);
+    CHECK(statistics.copies == 1);
+    CHECK(statistics.flips == 0);
+    CHECK(statistics.bytes_written == 0);
+
+    // the counters add up until reset
+    props.orientation = cppbmpfile::orientation_type::top_down;
+    result = cppbmpfile::bmp_file::load(filename, buffer, props, false, true, load_options);
+    REQUIRE(result);
+    CHECK(statistics.read_calls == 6);
+    CHECK(statistics.bulk_reads == 2);
+    CHECK(statistics.flips == 1);
+    statistics.reset();
+    CHECK(statistics.read_calls == 0);
+    CHECK(statistics.copies == 0);
+
+    const std::vector<uint8_t> data = read_test_file(TEST_DATA_ROOT_PATH "/testimages/Mono8_non_linear.bmp");
+    result = cppbmpfile::bmp_file::load(data.data(), data.size(), buffer, props, false, false, load_options);
+    REQUIRE(result);
+    CHECK(statistics.lookups == 1);
+    CHECK(statistics.open_nanoseconds == 0);
+    CHECK(statistics.bytes_read >= buffer.size());
+
+    statistics.reset();
+    load_options.thread_count = 3;
+    result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/256_color.bmp", buffer, props, false, false, load_options);
+    REQUIRE(result);
+    CHECK(statistics.expansions == 1);
+    CHECK(statistics.banded_images == 1);
+    CHECK(statistics.bulk_reads == 0);
+    CHECK(statistics.read_calls >= 2 + 3);
+
+    // saving
+    cppbmpfile::save_options save_options;
+    save_options.statistics = &statistics;
+    statistics.reset();
+    result = cppbmpfile::bmp_file::save("statistics_out.bmp", buffer.data(), buffer.size(), props, true, save_options);
+    REQUIRE(result);
+    CHECK(statistics.bytes_written == read_test_file("statistics_out.bmp").size());
+    CHECK(statistics.write_calls == 1);
+    CHECK(statistics.open_nanoseconds > 0);
+    CHECK(statistics.header_nanoseconds > 0);
+    CHECK(statistics.pixel_nanoseconds > 0);
+    CHECK(statistics.write_nanoseconds > 0);
+    CHECK(statistics.copies == 1);
+
+    statistics.reset();
+    save_options.chunk_size = 1000;
+    save_options.pixel_format = cppbmpfile::pixel_format_type::Mono8;
+    save_options.run_length_encoding = true;
+    result = cppbmpfile::bmp_file::save("statistics_out.bmp", buffer.data(), buffer.size(), props, true, save_options);
+    REQUIRE(result);
+    CHECK(statistics.bytes_written == read_test_file("statistics_out.bmp").size() + 54); // the header is written twice
+    CHECK(statistics.write_calls > 2);
+    CHECK(statistics.run_length_images == 1);
+    CHECK(statistics.luminance_conversions == 1);
+
+    // without statistics nothing is counted
+    statistics.reset();
+    result = cppbmpfile::bmp_file::load(filename, buffer, props);
+    REQUIRE(result);
+    CHECK(statistics.read_calls == 0);
+}
+
+TEST_CASE("test image view", "[cpp_bmp_file]")
+{
+    const char* filename = TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp";
+    const std::vector<uint8_t> data = read_test_file(filename);
+    cppbmpfile::image_properties props;
+    props.line_padding = 0;
+    props.orientation = cppbmpfile::orientation_type::top_down;
+    std::vector<uint8_t> expected;
+    REQUIRE(cppbmpfile::bmp_file::load(filename, expected, props, true, true));
+    const size_t line_size = test_file_width * 3;
+
+    // the view is a part of a canvas, the bytes around it must be kept, a pitch equal to the stride in the file must not read the padding
+    for (size_t x : { 0, 5 })
+    {
+        for (bool negative : { false, true })
+        {
+            for (size_t thread_count : { 1, 3 })
+            {
+                const size_t pitch = x == 0 ? line_size + test_file_padding : line_size + 7 * 3;
+                const size_t y = 2;
+                const size_t canvas_height = test_file_height + 4;
+                std::vector<uint8_t> canvas(pitch * canvas_height, 0xAB);
+                cppbmpfile::image_view view;
+                view.width = test_file_width;
+                view.height = test_file_height;
+                view.pixel_format = cppbmpfile::pixel_format_type::BGR8;
+                view.row_pitch = negative ? -static_cast<std::ptrdiff_t>(pitch) : static_cast<std::ptrdiff_t>(pitch);
+                view.data = canvas.data() + (negative ? y + test_file_height - 1 : y) * pitch + x * 3;
+                cppbmpfile::load_options options;
+                options.thread_count = thread_count;
+
+                cppbmpfile::image_properties view_props;
+                cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(filename, view, view_props, options);
+                REQUIRE(result);
+                CHECK(view_props.orientation == (negative ? cppbmpfile::orientation_type::bottom_up : cppbmpfile::orientation_type::top_down));
+                CHECK(view_props.line_padding == pitch - line_size);
+                bool equal = true;
+                for (size_t line = 0; line < canvas_height; ++line)
+                {
+                    for (size_t column = 0; column < pitch; ++column)
+                    {
+                        const bool inside = line >= y && line < y + test_file_height && column >= x * 3 && column < x * 3 + line_size;
+                        const size_t top_line = negative ? y + test_file_height - 1 - line : line - y;
+                        const uint8_t value = inside ? expected[top_line * line_size + column - x * 3] : 0xAB;
+                        equal = equal && canvas[line * pitch + column] == value;
+                    }
+                }
+                CHECK(equal);
+
+                // the same from memory
+                std::fill(canvas.begin(), canvas.end(), static_cast<uint8_t>(0));
+                result = cppbmpfile::bmp_file::load(data.data(), data.size(), view, view_props, options);
+                REQUIRE(result);
+                const uint8_t* p_top = static_cast<const uint8_t*>(view.data);
+                CHECK(std::equal(p_top, p_top + line_size, expected.begin()));
+                const uint8_t* p_bottom = p_top + (test_file_height - 1) * view.row_pitch;
+                CHECK(std::equal(p_bottom, p_bottom + line_size, expected.end() - line_size));
+
+                // saving the view gives the same file as saving the buffer
+                std::vector<uint8_t> saved;
+                std::vector<uint8_t> saved_from_view;
+                REQUIRE(cppbmpfile::bmp_file::save_to_memory(saved, expected.data(), expected.size(), props));
+                REQUIRE(cppbmpfile::bmp_file::save_to_memory(saved_from_view, view));
+                CHECK(saved == saved_from_view);
+            }
+        }
+    }
+
+    SECTION("conversion to the pixel format of the view")
+    {
+        std::vector<uint8_t> canvas(test_file_width * 4 * test_file_height);
+        cppbmpfile::image_view view;
+        view.data = canvas.data();
+        view.width = test_file_width;
+        view.height = test_file_height;
+        view.row_pitch = test_file_width * 4;
+        view.pixel_format = cppbmpfile::pixel_format_type::RGBA8;
+        cppbmpfile::image_properties view_props;
+        REQUIRE(cppbmpfile::bmp_file::load(filename, view, view_props));
+        CHECK(view_props.pixel_format == cppbmpfile::pixel_format_type::RGBA8);
+        CHECK(canvas[0] == expected[2]);
+        CHECK(canvas[2] == expected[0]);
+
+        cppbmpfile::bmp_decoder decoder;
+        std::fill(canvas.begin(), canvas.end(), static_cast<uint8_t>(0));
+        REQUIRE(decoder.load(data.data(), data.size(), view, view_props));
+        CHECK(canvas[0] == expected[2]);
+        REQUIRE(cppbmpfile::bmp_file::save("image_view_out.bmp", view));
+        std::vector<uint8_t> loaded;
+        cppbmpfile::image_properties loaded_props;
+        loaded_props.line_padding = 0;
+        loaded_props.orientation = cppbmpfile::orientation_type::top_down;
+        cppbmpfile::load_options options;
+        options.pixel_format = cppbmpfile::pixel_format_type::BGR8; // RGBA8 is stored as BGRA8
+        REQUIRE(cppbmpfile::bmp_file::load("image_view_out.bmp", loaded, loaded_props, true, true, options));
+        CHECK(loaded == expected);
+    }
+
+    SECTION("invalid views")
+    {
+        std::vector<uint8_t> canvas(data.size());
+        cppbmpfile::image_view view;
+        view.width = test_file_width;
+        view.height = test_file_height;
+        view.row_pitch = static_cast<std::ptrdiff_t>(line_size);
+        view.pixel_format = cppbmpfile::pixel_format_type::BGR8;
+        cppbmpfile::image_properties view_props;
+        cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(filename, view, view_props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+        view.data = canvas.data();
+        result = cppbmpfile::bmp_file::load(static_cast<const char*>(nullptr), view, view_props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+        view.row_pitch = -static_cast<std::ptrdiff_t>(line_size) + 1;
+        result = cppbmpfile::bmp_file::load(filename, view, view_props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+        view.row_pitch = static_cast<std::ptrdiff_t>(line_size);
+        view.pixel_format = cppbmpfile::pixel_format_type::invalid;
+        result = cppbmpfile::bmp_file::load(filename, view, view_props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+        std::vector<uint8_t> saved(1);
+        result = cppbmpfile::bmp_file::save_to_memory(saved, view);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+        CHECK(saved.empty());
+
+        // the size of the image must match the view
+        view.pixel_format = cppbmpfile::pixel_format_type::BGR8;
+        view.height = test_file_height - 1;
+        result = cppbmpfile::bmp_file::load(filename, view, view_props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+        cppbmpfile::load_options options;
+        options.region.width = test_file_width;
+        options.region.height = test_file_height - 1;
+        CHECK(cppbmpfile::bmp_file::load(filename, view, view_props, options));
+    }
+}
+
+TEST_CASE("test image cache", "[cpp_bmp_file]")
+{
+    const std::vector<uint8_t> bgr8 = read_test_file(TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp");
+    const std::vector<uint8_t> mono8 = read_test_file(TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp");
+    const char* filename = "image_cache.bmp";
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(bgr8.data()), static_cast<std::streamsize>(bgr8.size()));
+    }
+    std::vector<uint8_t> expected;
+    cppbmpfile::image_properties props;
+    REQUIRE(cppbmpfile::bmp_file::load(filename, expected, props));
+
+    cppbmpfile::bmp_image_cache cache;
+    cppbmpfile::bmp_image_cache::image_pointer first;
+    cppbmpfile::bmp_image_cache::image_pointer second;
+    REQUIRE(cache.load(filename, first));
+    REQUIRE(cache.load(filename, second));
+    CHECK(first == second);
+    CHECK(first->pixels == expected);
+    CHECK(first->properties.pixel_format == cppbmpfile::pixel_format_type::BGR8);
+    cppbmpfile::image_cache_statistics statistics = cache.statistics();
+    CHECK(statistics.misses == 1);
+    CHECK(statistics.hits == 1);
+    CHECK(statistics.entries == 1);
+    CHECK(statistics.bytes == expected.size());
+
+    // other options are another entry
+    cppbmpfile::load_options options;
+    options.pixel_format = cppbmpfile::pixel_format_type::Mono8;
+    REQUIRE(cache.load(filename, second, options));
+    CHECK(first != second);
+    CHECK(second->properties.pixel_format == cppbmpfile::pixel_format_type::Mono8);
+    CHECK(cache.statistics().entries == 2);
+
+    // a changed file is loaded again, the old image stays valid
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(mono8.data()), static_cast<std::streamsize>(mono8.size()));
+    }
+    REQUIRE(cache.load(filename, second));
+    CHECK(first != second);
+    CHECK(second->properties.pixel_format == cppbmpfile::pixel_format_type::Mono8);
+    CHECK(first->pixels == expected);
+    statistics = cache.statistics();
+    CHECK(statistics.invalidations == 1);
+
+    // a removed file is not served
+    std::remove(filename);
+    cppbmpfile::operation_result result = cache.load(filename, second);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+    CHECK(!second);
+    CHECK(cache.statistics().invalidations == 2);
+    CHECK(cache.statistics().entries == 1);
+    cache.clear();
+    CHECK(cache.statistics().entries == 0);
+    CHECK(cache.statistics().bytes == 0);
+
+    SECTION("data in memory")
+    {
+        REQUIRE(cache.load(bgr8.data(), bgr8.size(), first));
+        REQUIRE(cache.load(std::vector<uint8_t>(bgr8).data(), bgr8.size(), second));
+        CHECK(first == second);
+        CHECK(first->pixels == expected);
+        REQUIRE(cache.load(mono8.data(), mono8.size(), second));
+        CHECK(first != second);
+        CHECK(cache.statistics().bytes == expected.size() + bgr8.size() + second->pixels.size() + mono8.size());
+        result = cache.load(static_cast<const void*>(nullptr), 0, second);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+    }
+
+    SECTION("least recently used entries are evicted")
+    {
+        // the entries of data in memory hold a copy of the data as well
+        cppbmpfile::bmp_image_cache small_cache(expected.size() + bgr8.size() + 2 * mono8.size());
+        REQUIRE(small_cache.load(bgr8.data(), bgr8.size(), first));
+        REQUIRE(small_cache.load(mono8.data(), mono8.size(), second));
+        CHECK(small_cache.statistics().entries == 2);
+        REQUIRE(small_cache.load(bgr8.data(), bgr8.size(), first)); // bgr8 becomes the most recent entry
+        options.pixel_format = cppbmpfile::pixel_format_type::BGRA8;
+        REQUIRE(small_cache.load(mono8.data(), mono8.size(), second, options));
+        statistics = small_cache.statistics();
+        CHECK(statistics.evictions == 2);
+        CHECK(statistics.entries == 1);
+        CHECK(statistics.bytes <= small_cache.capacity());
+        CHECK(first->pixels == expected);
+
+        // images larger than the capacity are not cached
+        cppbmpfile::bmp_image_cache tiny_cache(16);
+        REQUIRE(tiny_cache.load(bgr8.data(), bgr8.size(), first));
+        CHECK(first->pixels == expected);
+        CHECK(tiny_cache.statistics().entries == 0);
+    }
+
+    SECTION("several threads")
+    {
+        const size_t previous_loads = statistics.hits + statistics.misses;
+        std::atomic<size_t> failures(0);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i)
+        {
+            threads.emplace_back([&]()
+            {
+                for (int j = 0; j < 50; ++j)
+                {
+                    cppbmpfile::bmp_image_cache::image_pointer image;
+                    if (!cache.load(j % 2 ? bgr8.data() : mono8.data(), j % 2 ? bgr8.size() : mono8.size(), image) || (j % 2 && image->pixels != expected))
+                    {
+                        failures++;
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        CHECK(failures == 0);
+        statistics = cache.statistics();
+        CHECK(statistics.hits + statistics.misses == previous_loads + 200);
+        CHECK(statistics.entries == 2);
+    }
+}
+
+TEST_CASE("test load from an open file", "[cpp_bmp_file]")
+{
+    const char* filename = TEST_DATA_ROOT_PATH "/testimages/BGR8.bmp";
+    std::vector<uint8_t> expected;
+    cppbmpfile::image_properties expected_props;
+    REQUIRE(cppbmpfile::bmp_file::load(filename, expected, expected_props));
+    cppbmpfile::image_properties props;
+    std::vector<uint8_t> buffer;
+    cppbmpfile::operation_result result;
+
+    SECTION("file handles")
+    {
+        FILE* file = fopen(filename, "rb");
+        REQUIRE(file != nullptr);
+        REQUIRE(fseek(file, 10, SEEK_SET) == 0);
+        for (size_t thread_count : { 1, 3 })
+        {
+            cppbmpfile::load_options options;
+            options.thread_count = thread_count;
+            result = cppbmpfile::bmp_file::load(cppbmpfile::open_file(file), buffer, props, false, false, options);
+            CHECK(result);
+            CHECK(buffer == expected);
+            std::vector<uint8_t> fixed(expected.size());
+            result = cppbmpfile::bmp_file::load(cppbmpfile::open_file(file), fixed.data(), fixed.size(), props, false, false, options);
+            CHECK(result);
+            CHECK(fixed == expected);
+        }
+        CHECK(ftell(file) == 10); // the position of the file is kept
+        fclose(file);
+
+        result = cppbmpfile::bmp_file::load(cppbmpfile::open_file(static_cast<FILE*>(nullptr)), buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+        CHECK(buffer.empty());
+    }
+
+    SECTION("probe then load")
+    {
+        cppbmpfile::operation_statistics statistics;
+        cppbmpfile::load_options options;
+        options.statistics = &statistics;
+        cppbmpfile::bmp_probe probe;
+        result = probe.open_for_load(filename);
+        REQUIRE(result);
+        CHECK(probe.is_file_open());
+        REQUIRE(probe.properties(props));
+        result = probe.load(buffer, props, false, false, options);
+        CHECK(result);
+        CHECK(buffer == expected);
+        CHECK(statistics.open_nanoseconds == 0); // the file is not opened again
+        std::vector<uint8_t> fixed(expected.size());
+        result = probe.load(fixed.data(), fixed.size(), props);
+        CHECK(result);
+        CHECK(fixed == expected);
+        probe.clear();
+        CHECK(!probe.is_file_open());
+        result = probe.load(buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+
+        // a file larger than the prefix needs to be kept open
+        REQUIRE(probe.open(filename));
+        CHECK(!probe.is_file_open());
+        result = probe.load(buffer, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+        CHECK(buffer.empty());
+
+        // a small file is held by the prefix
+        const std::vector<uint8_t> pixel_data(8 * 4, 1);
+        const std::vector<uint8_t> small_data = create_test_bmp(8, 6, 4, { 0x000000, 0xFFFFFF }, pixel_data);
+        {
+            std::ofstream file("probe_small.bmp", std::ios::binary);
+            file.write(reinterpret_cast<const char*>(small_data.data()), static_cast<std::streamsize>(small_data.size()));
+        }
+        std::vector<uint8_t> small_expected;
+        REQUIRE(cppbmpfile::bmp_file::load(small_data.data(), small_data.size(), small_expected, expected_props));
+        REQUIRE(probe.open("probe_small.bmp"));
+        result = probe.load(buffer, props);
+        CHECK(result);
+        CHECK(buffer == small_expected);
+
+        // data in memory
+        const std::vector<uint8_t> large_data = read_test_file(filename);
+        REQUIRE(probe.open(large_data.data(), large_data.size()));
+        result = probe.load(buffer, props);
+        CHECK(result);
+        CHECK(buffer == expected);
+        result = probe.load(nullptr, 0, props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+    }
+
+#if defined(CPPBMPFILE_HAS_FILESYSTEM)
+    SECTION("filesystem paths")
+    {
+        const std::filesystem::path path(filename);
+        result = cppbmpfile::bmp_file::load(path, buffer, props);
+        CHECK(result);
+        CHECK(buffer == expected);
+        REQUIRE(cppbmpfile::bmp_file::save(std::filesystem::path("filesystem_out.bmp"), buffer.data(), buffer.size(), props));
+        result = cppbmpfile::bmp_file::load(std::filesystem::path("filesystem_out.bmp"), props);
+        CHECK(result);
+        cppbmpfile::bmp_probe probe;
+        REQUIRE(probe.open_for_load(path));
+        result = probe.load(buffer, props);
+        CHECK(result);
+        CHECK(buffer == expected);
+    }
+#endif
+}
+
+TEST_CASE("test load with access hints", "[cpp_bmp_file]")
+{
+    const char* filenames[] = {
+        TEST_DATA_ROOT_PATH "/testimages/Mono8.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/256_color.bmp",
+        TEST_DATA_ROOT_PATH "/testimages/BGRA8_flipped.bmp"
+    };
+    for (const char* filename : filenames)
+    {
+        std::vector<uint8_t> expected;
+        cppbmpfile::image_properties expected_props;
+        REQUIRE(cppbmpfile::bmp_file::load(filename, expected, expected_props));
+        for (int hints = 1; hints < 8; ++hints)
+        {
+            cppbmpfile::load_options options;
+            options.sequential_access = (hints & 1) != 0;
+            options.drop_cache = (hints & 2) != 0;
+            options.direct_io = (hints & 4) != 0;
+            std::vector<uint8_t> buffer;
+            cppbmpfile::image_properties props;
+            cppbmpfile::operation_result result = cppbmpfile::bmp_file::load(filename, buffer, props, false, false, options);
+            CHECK(result);
+            CHECK(buffer == expected);
+            CHECK(props.orientation == expected_props.orientation);
+
+            result = cppbmpfile::bmp_file::load(TEST_DATA_ROOT_PATH "/testimages/NotThere.bmp", buffer, props, false, false, options);
+            CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+        }
+    }
+}
+
+TEST_CASE("test sequence reader", "[cpp_bmp_file]")
+{
+    cppbmpfile::image_properties props;
+    props.width = 33;
+    props.height = 20;
+    props.pixel_format = cppbmpfile::pixel_format_type::BGR8;
+    props.line_padding = 1;
+    std::vector<std::string> filenames;
+    std::vector<std::vector<uint8_t>> frames;
+    for (int i = 0; i < 7; ++i)
+    {
+        std::vector<uint8_t> pixels(cppbmpfile::bmp_file::compute_buffer_size(props));
+        for (size_t j = 0; j < pixels.size(); ++j)
+        {
+            pixels[j] = static_cast<uint8_t>(j * (i + 1));
+        }
+        filenames.push_back("sequence_" + std::to_string(i) + ".bmp");
+        REQUIRE(cppbmpfile::bmp_file::save(filenames.back().c_str(), pixels.data(), pixels.size(), props));
+        std::vector<uint8_t> expected;
+        cppbmpfile::image_properties expected_props;
+        REQUIRE(cppbmpfile::bmp_file::load(filenames.back().c_str(), expected, expected_props));
+        frames.push_back(expected);
+    }
+
+    cppbmpfile::bmp_sequence_reader reader;
+    cppbmpfile::image_properties sequence_props;
+    std::vector<uint8_t> buffer;
+    cppbmpfile::operation_result result = reader.load(filenames[0].c_str(), buffer);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    result = reader.open(filenames[0].c_str(), sequence_props);
+    REQUIRE(result);
+    CHECK(reader.is_open());
+    CHECK(sequence_props.width == props.width);
+    CHECK(reader.frame_size() == frames[0].size());
+    for (size_t i = 0; i < filenames.size(); ++i)
+    {
+        result = reader.load(filenames[i].c_str(), buffer);
+        CHECK(result);
+        CHECK(buffer == frames[i]);
+    }
+
+    // frames into a single buffer
+    for (size_t thread_count : { 1, 3, 0 })
+    {
+        std::vector<uint8_t> tensor;
+        result = reader.load_frames(filenames, tensor, thread_count);
+        REQUIRE(result);
+        REQUIRE(tensor.size() == filenames.size() * reader.frame_size());
+        for (size_t i = 0; i < filenames.size(); ++i)
+        {
+            CHECK(std::equal(frames[i].begin(), frames[i].end(), tensor.begin() + i * reader.frame_size()));
+        }
+    }
+    std::vector<uint8_t> small(reader.frame_size() * 2);
+    result = reader.load_frames(filenames, small.data(), small.size());
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+    result = reader.load(filenames[0].c_str(), small.data(), reader.frame_size() - 1);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::buffer_too_small);
+
+    // a missing frame is reported in order
+    std::vector<std::string> with_missing = filenames;
+    with_missing[4] = "sequence_missing.bmp";
+    result = reader.load_frames(with_missing, buffer, 2);
+    CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+    CHECK(buffer.empty());
+
+    SECTION("frames with another header")
+    {
+        // a top down frame is checked fully and stored in the layout of the sequence
+        cppbmpfile::image_properties top_down_props = props;
+        top_down_props.orientation = cppbmpfile::orientation_type::top_down;
+        std::vector<uint8_t> pixels(frames[1]);
+        std::reverse(pixels.begin(), pixels.end()); // any content
+        std::vector<uint8_t> flipped(pixels.size());
+        const size_t stride = cppbmpfile::bmp_file::compute_buffer_size(props) / props.height;
+        for (size_t line = 0; line < props.height; ++line)
+        {
+            std::copy(pixels.begin() + line * stride, pixels.begin() + (line + 1) * stride, flipped.begin() + (props.height - line - 1) * stride);
+        }
+        REQUIRE(cppbmpfile::bmp_file::save("sequence_top_down.bmp", flipped.data(), flipped.size(), top_down_props, false));
+        result = reader.load("sequence_top_down.bmp", buffer);
+        CHECK(result);
+        for (size_t line = 0; line < props.height; ++line)
+        {
+            CHECK(std::equal(buffer.begin() + line * stride, buffer.begin() + line * stride + props.width * 3, pixels.begin() + line * stride));
+        }
+
+        // other image properties are rejected
+        cppbmpfile::image_properties other_props = props;
+        other_props.pixel_format = cppbmpfile::pixel_format_type::BGRA8;
+        other_props.line_padding = 0;
+        std::vector<uint8_t> other(cppbmpfile::bmp_file::compute_buffer_size(other_props), 7);
+        REQUIRE(cppbmpfile::bmp_file::save("sequence_other.bmp", other.data(), other.size(), other_props));
+        result = reader.load("sequence_other.bmp", buffer);
+        CHECK(!result);
+        CHECK(buffer.empty());
+
+        // unless they are converted to the pixel format of the sequence
+        cppbmpfile::load_options options;
+        options.pixel_format = cppbmpfile::pixel_format_type::BGR8;
+        REQUIRE(reader.open(filenames[0].c_str(), sequence_props, false, false, options));
+        result = reader.load("sequence_other.bmp", buffer);
+        CHECK(result);
+        CHECK(buffer[0] == 7);
+        result = reader.load(filenames[2].c_str(), buffer);
+        CHECK(result);
+        CHECK(buffer == frames[2]);
+    }
+
+    SECTION("invalid arguments")
+    {
+        result = reader.open("sequence_missing.bmp", sequence_props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::file_not_found);
+        CHECK(!reader.is_open());
+        result = reader.open(static_cast<const char*>(nullptr), sequence_props);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::null_argument);
+        result = reader.open(TEST_DATA_ROOT_PATH "/testimages/TooSmall.bmp", sequence_props);
+        CHECK(!result);
+        CHECK(!reader.is_open());
+        result = reader.load_frames(filenames, buffer);
+        CHECK(result.operator cppbmpfile::operation_result_type() == cppbmpfile::operation_result_type::invalid_argument);
+    }
+}